@@ -16,14 +16,12 @@ Source0:        https://github.com/NSLS-II/arptools/archive/%v{version}/arptools
 
 BuildRequires:  cmake
 BuildRequires:  libpcap-devel
-BuildRequires:  libnet-devel
 BuildRequires:  libconfig-devel
 BuildRequires:  systemd-devel
 %{?el7:BuildRequires:  mariadb-devel}
 %{?el8:BuildRequires:  mariadb-connector-c-devel}
 %{?el8:BuildRequires:  systemd-rpm-macros}
 Requires:       libpcap
-Requires:       libnet
 
 %description
 arpwatch ARP packet monitor
@@ -37,6 +35,7 @@ VERBOSE=1 make
 
 %install
 %make_install
+mkdir -p %{buildroot}%{_sharedstatedir}/arpwatch
 
 %post
 %systemd_post arpwatch.service
@@ -51,6 +50,7 @@ VERBOSE=1 make
 %license LICENSE
 %{_bindir}/arpwatch
 %{_unitdir}/arpwatch.service
+%dir %{_sharedstatedir}/arpwatch
 
 %changelog
 * Thu Jul 22 2021 Stuart Campbell <scampbell@bnl.gov> 0.1.2-2
@@ -0,0 +1,529 @@
+//
+//  arptools
+//
+//  Stuart B. Wilkins, Brookhaven National Laboratory
+//
+//
+//  BSD 3-Clause License
+//
+//  Copyright (c) 2021, Brookhaven Science Associates
+//  All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without
+//  modification, are permitted provided that the following conditions are met:
+//
+//  1. Redistributions of source code must retain the above copyright notice,
+//     this list of conditions and the following disclaimer.
+//
+//  2. Redistributions in binary form must reproduce the above copyright notice,
+//     this list of conditions and the following disclaimer in the documentation
+//     and/or other materials provided with the distribution.
+//
+//  3. Neither the name of the copyright holder nor the names of its
+//     contributors may be used to endorse or promote products derived from
+//     this software without specific prior written permission.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+//  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+//  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+//  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+//  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+//  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+//  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+//  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+//  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+//  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+//  THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+//
+// arpwatch-bench : replay saved captures through capture_callback(),
+// the buffer and a sink thread, exactly as the daemon runs them, and
+// report the cost as JSON.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <arpa/inet.h>
+#include <pcap.h>
+
+#include "arpwatch.h"
+#include "capture.h"
+#include "buffer.h"
+#include "registry.h"
+#include "metrics.h"
+#include "recorder.h"
+#include "sink.h"
+#include "log.h"
+#include "debug.h"
+
+#define BENCH_CLASS_OTHER        0
+#define BENCH_CLASS_ARP          1
+#define BENCH_CLASS_IP           2
+#define BENCH_CLASS_UDP          3
+#define BENCH_CLASS_DHCP         4
+#define BENCH_CLASS_EPICS        5
+#define BENCH_CLASSES            6
+
+#define BENCH_SINK               "null"
+#define BENCH_SQLITE_DATABASE    "/tmp/arpwatch-bench.db"
+#define BENCH_SINK_DELAY         1          // Seconds
+#define BENCH_DRAIN_TIMEOUT      600        // Seconds
+#define BENCH_CALIBRATE          10000
+
+int debug_flag = 0;
+
+static const char *bench_class_name[BENCH_CLASSES] = {
+  "other", "arp", "ip", "udp", "dhcp", "epics"
+};
+
+typedef struct {
+  struct pcap_pkthdr hdr;
+  u_char *data;
+  int class;
+} bench_packet;
+
+typedef struct {
+  uint64_t packets;
+  uint64_t nsec;
+} bench_class;
+
+typedef struct {
+  bench_packet *packet;
+  size_t num;
+  size_t size;
+} bench_capture;
+
+//
+// Allocations made by arpwatch code, linked with
+// -Wl,--wrap=malloc,--wrap=calloc,--wrap=realloc. Allocations made
+// inside shared libraries (libpcap, SQLite) are not seen.
+//
+
+static uint64_t bench_allocs = 0;
+static uint64_t bench_alloc_bytes = 0;
+
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t num, size_t size);
+void *__real_realloc(void *ptr, size_t size);
+
+static void bench_count(size_t size) {
+  __atomic_add_fetch(&bench_allocs, 1, __ATOMIC_RELAXED);
+  __atomic_add_fetch(&bench_alloc_bytes, size, __ATOMIC_RELAXED);
+}
+
+void *__wrap_malloc(size_t size) {
+  bench_count(size);
+  return __real_malloc(size);
+}
+
+void *__wrap_calloc(size_t num, size_t size) {
+  bench_count(num * size);
+  return __real_calloc(num, size);
+}
+
+void *__wrap_realloc(void *ptr, size_t size) {
+  bench_count(size);
+  return __real_realloc(ptr, size);
+}
+
+static uint64_t bench_now(void) {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (uint64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+static int bench_classify(const struct pcap_pkthdr *hdr,
+                          const u_char *packet) {
+  // The same classes as the PROFILE build
+
+  size_t pos = sizeof(struct ethernet_header);
+  if (hdr->caplen < pos) {
+    return BENCH_CLASS_OTHER;
+  }
+
+  uint16_t type = ntohs(((struct ethernet_header *)packet)->ether_type);
+  if (type == ETHERTYPE_8021Q) {
+    pos = sizeof(struct ethernet_header_8021q);
+    if (hdr->caplen < pos) {
+      return BENCH_CLASS_OTHER;
+    }
+    type = ntohs(((struct ethernet_header_8021q *)packet)->ether_type);
+  }
+
+  if (type == ETHERTYPE_ARP) {
+    return BENCH_CLASS_ARP;
+  }
+  if (type != ETHERTYPE_IP) {
+    return BENCH_CLASS_OTHER;
+  }
+
+  struct ipbdy *ip = (struct ipbdy *)(packet + pos);
+  pos += sizeof(struct ipbdy);
+  if ((hdr->caplen < pos + sizeof(struct udphdr)) ||
+      (ip->proto != IP_PROTO_UDP)) {
+    return BENCH_CLASS_IP;
+  }
+
+  struct udphdr *udp = (struct udphdr *)(packet + pos);
+  uint16_t sport = ntohs(udp->sport);
+  uint16_t dport = ntohs(udp->dport);
+  if ((sport == DHCP_DISCOVER_SPORT) && (dport == DHCP_DISCOVER_DPORT)) {
+    return BENCH_CLASS_DHCP;
+  }
+  if ((dport == EPICS_DPORT) || (dport == EPICS_BEACON_DPORT) ||
+      (dport == EPICS_PVA_DPORT)) {
+    return BENCH_CLASS_EPICS;
+  }
+
+  return BENCH_CLASS_UDP;
+}
+
+static int bench_load(bench_capture *cap, const char *filename) {
+  // Read the whole file up front so file I/O is not measured
+
+  char errbuf[PCAP_ERRBUF_SIZE];
+  pcap_t *pcap = pcap_open_offline(filename, errbuf);
+  if (!pcap) {
+    fprintf(stderr, "%s : %s\n", filename, errbuf);
+    return -1;
+  }
+
+  if (pcap_datalink(pcap) != DLT_EN10MB) {
+    fprintf(stderr, "%s : Not an ethernet capture\n", filename);
+    pcap_close(pcap);
+    return -1;
+  }
+
+  struct pcap_pkthdr *hdr;
+  const u_char *data;
+  int rtn;
+  while ((rtn = pcap_next_ex(pcap, &hdr, &data)) == 1) {
+    if (cap->num == cap->size) {
+      size_t size = cap->size ? cap->size * 2 : 4096;
+      bench_packet *packet = realloc(cap->packet,
+                                     size * sizeof(bench_packet));
+      if (!packet) {
+        fprintf(stderr, "Unable to allocate memory for packets\n");
+        pcap_close(pcap);
+        return -1;
+      }
+      cap->packet = packet;
+      cap->size = size;
+    }
+
+    bench_packet *p = &cap->packet[cap->num];
+    p->hdr = *hdr;
+    p->data = malloc(hdr->caplen);
+    if (!p->data) {
+      fprintf(stderr, "Unable to allocate memory for packets\n");
+      pcap_close(pcap);
+      return -1;
+    }
+    memcpy(p->data, data, hdr->caplen);
+    p->class = bench_classify(hdr, data);
+    cap->num++;
+  }
+
+  if (rtn == PCAP_ERROR) {
+    fprintf(stderr, "%s : %s\n", filename, pcap_geterr(pcap));
+  }
+
+  pcap_close(pcap);
+  return (rtn == PCAP_ERROR) ? -1 : 0;
+}
+
+static void bench_free(bench_capture *cap) {
+  for (size_t i = 0; i < cap->num; i++) {
+    free(cap->packet[i].data);
+  }
+  free(cap->packet);
+}
+
+static uint64_t bench_calibrate(void) {
+  // Cost of reading the clock, taken off every packet
+
+  uint64_t start = bench_now();
+  for (int i = 0; i < BENCH_CALIBRATE; i++) {
+    bench_now();
+  }
+
+  return (bench_now() - start) / BENCH_CALIBRATE;
+}
+
+static void bench_wait(uint64_t start, uint64_t offset, double scale) {
+  uint64_t target = start + (uint64_t)(offset / scale);
+  struct timespec ts;
+  ts.tv_sec = target / 1000000000;
+  ts.tv_nsec = target % 1000000000;
+  clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL);
+}
+
+static uint64_t bench_replay(arpwatch_params *params, bench_capture *cap,
+                             int loops, double scale, uint64_t overhead,
+                             bench_class *class) {
+  if (!cap->num) {
+    return 0;
+  }
+
+  // With scale > 0 packets are sent at scale times their
+  // captured rate
+
+  const struct timeval *first = &cap->packet[0].hdr.ts;
+  const struct timeval *last = &cap->packet[cap->num - 1].hdr.ts;
+  uint64_t length = ((int64_t)(last->tv_sec - first->tv_sec) * 1000000 +
+                     (last->tv_usec - first->tv_usec)) * 1000;
+
+  uint64_t start = bench_now();
+  for (int l = 0; l < loops; l++) {
+    for (size_t i = 0; i < cap->num; i++) {
+      bench_packet *p = &cap->packet[i];
+
+      if (scale > 0) {
+        uint64_t offset = ((int64_t)(p->hdr.ts.tv_sec - first->tv_sec) *
+                           1000000 + (p->hdr.ts.tv_usec - first->tv_usec)) *
+                          1000 + l * length;
+        bench_wait(start, offset, scale);
+      }
+
+      uint64_t t0 = bench_now();
+      capture_callback((u_char *)params, &p->hdr, p->data);
+      uint64_t t = bench_now() - t0;
+
+      class[p->class].packets++;
+      class[p->class].nsec += (t > overhead) ? t - overhead : 0;
+    }
+  }
+
+  return bench_now() - start;
+}
+
+static int bench_setup(arpwatch_params *params, registry_data *registry,
+                       metrics_data *metrics, const char *sink,
+                       const char *database, int buffer_size,
+                       int sink_delay) {
+  // Defaults as read_interface_config() would set them, with no
+  // networks so no ARP thread is needed
+
+  memset(params, 0, sizeof(arpwatch_params));
+  strncpy(params->device, "bench", ARPWATCH_CONFIG_MAX_STRING - 1);
+  strncpy(params->label, "bench", ARPWATCH_CONFIG_MAX_STRING - 1);
+  strncpy(params->location, "bench", ARPWATCH_CONFIG_MAX_STRING - 1);
+  strncpy(params->daemon_hostname, "arpwatch-bench",
+          ARPWATCH_CONFIG_MAX_STRING - 1);
+  strncpy(params->sink, sink, ARPWATCH_CONFIG_MAX_STRING - 1);
+  strncpy(params->sqlite_database, database,
+          ARPWATCH_CONFIG_MAX_STRING - 1);
+
+  params->buffer_size = buffer_size;
+  params->mysql_loop_delay = sink_delay;
+  params->last_seen_granularity = ARPWATCH_LAST_SEEN_GRANULARITY;
+  params->recorder_frames = ARPWATCH_RECORDER_FRAMES;
+  params->recorder_anomalies = ARPWATCH_RECORDER_ANOMALIES;
+  params->capture_cpu = ARPWATCH_CPU_NONE;
+  params->sink_cpu = ARPWATCH_CPU_NONE;
+  params->arp_cpu = ARPWATCH_CPU_NONE;
+  params->registry = registry;
+  params->metrics = metrics_slot(metrics, params->device);
+  pthread_mutex_init(&params->config_mutex, NULL);
+
+  if (!sink_find(params->sink)) {
+    fprintf(stderr, "Unknown sink %s\n", params->sink);
+    return -1;
+  }
+
+  if (hosts_init(&params->hosts) != HOSTS_NOERR ||
+      probe_init(&params->probes) != PROBE_NOERR ||
+      buffer_init(&params->data_buffer, buffer_size, 1) != BUFFER_NOERR ||
+      recorder_init(&params->recorder, params->recorder_frames,
+                    params->recorder_anomalies,
+                    CAPTURE_SNAPLEN) != RECORDER_NOERR) {
+    fprintf(stderr, "Unable to allocate memory\n");
+    return -1;
+  }
+
+  return 0;
+}
+
+static void bench_json(FILE *fp, const char *sink, int loops, double scale,
+                       uint64_t packets, uint64_t replay_ns,
+                       uint64_t drain_ns, uint64_t overhead,
+                       bench_class *class, arpwatch_params *params,
+                       uint64_t allocs, uint64_t alloc_bytes) {
+  metrics_interface *m = params->metrics;
+
+  fprintf(fp, "{\n");
+  fprintf(fp, "  \"sink\": \"%s\",\n", sink);
+  fprintf(fp, "  \"loops\": %d,\n", loops);
+  fprintf(fp, "  \"scale\": %g,\n", scale);
+  fprintf(fp, "  \"buffer_size\": %d,\n", params->buffer_size);
+  fprintf(fp, "  \"packets\": %lu,\n", (unsigned long)packets);
+  fprintf(fp, "  \"replay_seconds\": %.6f,\n", replay_ns / 1e9);
+  fprintf(fp, "  \"drain_seconds\": %.6f,\n", drain_ns / 1e9);
+  fprintf(fp, "  \"packets_per_second\": %.0f,\n",
+          replay_ns ? packets * 1e9 / replay_ns : 0.0);
+  fprintf(fp, "  \"clock_overhead_ns\": %lu,\n", (unsigned long)overhead);
+
+  fprintf(fp, "  \"classes\": {\n");
+  int first = 1;
+  for (int c = 0; c < BENCH_CLASSES; c++) {
+    if (!class[c].packets) {
+      continue;
+    }
+    fprintf(fp, "%s    \"%s\": {\"packets\": %lu, \"ns_per_packet\": %.1f}",
+            first ? "" : ",\n", bench_class_name[c],
+            (unsigned long)class[c].packets,
+            (double)class[c].nsec / class[c].packets);
+    first = 0;
+  }
+  fprintf(fp, "\n  },\n");
+
+  fprintf(fp, "  \"ring_overruns\": %d,\n",
+          buffer_overruns(&params->data_buffer));
+  if (m) {
+    fprintf(fp, "  \"duplicates\": %lu,\n",
+            (unsigned long)m->capture.duplicates);
+    fprintf(fp, "  \"records\": %lu,\n", (unsigned long)m->sink.records);
+    fprintf(fp, "  \"rows_written\": %lu,\n",
+            (unsigned long)m->sink.rows_written);
+    fprintf(fp, "  \"flushes\": %lu,\n", (unsigned long)m->sink.flushes);
+  }
+  fprintf(fp, "  \"allocations\": %lu,\n", (unsigned long)allocs);
+  fprintf(fp, "  \"allocation_bytes\": %lu\n", (unsigned long)alloc_bytes);
+  fprintf(fp, "}\n");
+}
+
+static void bench_usage(const char *name) {
+  fprintf(stderr,
+          "Usage: %s [options] file.pcap ...\n"
+          "  -s sink    Sink to write to, null (default) or sqlite\n"
+          "  -d file    SQLite database (default %s)\n"
+          "  -b size    Buffer size in records (default %d)\n"
+          "  -w sec     Seconds between sink flushes (default %d)\n"
+          "  -t scale   Replay at scale times real time (default 0, "
+          "as fast as possible)\n"
+          "  -l loops   Number of times to replay the files (default 1)\n"
+          "  -o file    Write the JSON report to file\n",
+          name, BENCH_SQLITE_DATABASE, ARPWATCH_BUFFER_SIZE,
+          BENCH_SINK_DELAY);
+}
+
+int main(int argc, char *argv[]) {
+  const char *sink = BENCH_SINK;
+  const char *database = BENCH_SQLITE_DATABASE;
+  const char *output = NULL;
+  int buffer_size = ARPWATCH_BUFFER_SIZE;
+  int sink_delay = BENCH_SINK_DELAY;
+  int loops = 1;
+  double scale = 0;
+  int opt;
+
+  while ((opt = getopt(argc, argv, "s:d:b:w:t:l:o:h")) != -1) {
+    switch (opt) {
+      case 's':
+        sink = optarg;
+        break;
+      case 'd':
+        database = optarg;
+        break;
+      case 'b':
+        buffer_size = atoi(optarg);
+        break;
+      case 'w':
+        sink_delay = atoi(optarg);
+        break;
+      case 't':
+        scale = atof(optarg);
+        break;
+      case 'l':
+        loops = atoi(optarg);
+        break;
+      case 'o':
+        output = optarg;
+        break;
+      default:
+        bench_usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+  }
+
+  if ((optind >= argc) || (buffer_size <= 0) || (loops <= 0)) {
+    bench_usage(argv[0]);
+    return EXIT_FAILURE;
+  }
+
+  bench_capture cap = {NULL, 0, 0};
+  for (int i = optind; i < argc; i++) {
+    if (bench_load(&cap, argv[i])) {
+      bench_free(&cap);
+      return EXIT_FAILURE;
+    }
+  }
+
+  registry_data registry;
+  metrics_data metrics;
+  arpwatch_params params;
+  if (registry_init(&registry) != REGISTRY_NOERR ||
+      metrics_init(&metrics) != METRICS_NOERR ||
+      bench_setup(&params, &registry, &metrics, sink, database,
+                  buffer_size, sink_delay)) {
+    return EXIT_FAILURE;
+  }
+
+  log_start();
+  if (sink_setup(&params, 1)) {
+    return EXIT_FAILURE;
+  }
+
+  uint64_t overhead = bench_calibrate();
+  bench_class class[BENCH_CLASSES];
+  memset(class, 0, sizeof(class));
+
+  uint64_t allocs = __atomic_load_n(&bench_allocs, __ATOMIC_RELAXED);
+  uint64_t alloc_bytes = __atomic_load_n(&bench_alloc_bytes,
+                                         __ATOMIC_RELAXED);
+
+  uint64_t replay_ns = bench_replay(&params, &cap, loops, scale, overhead,
+                                    class);
+
+  allocs = __atomic_load_n(&bench_allocs, __ATOMIC_RELAXED) - allocs;
+  alloc_bytes = __atomic_load_n(&bench_alloc_bytes, __ATOMIC_RELAXED) -
+                alloc_bytes;
+
+  // Let the sink write what is left
+
+  uint64_t drain = bench_now();
+  sink_stop(BENCH_DRAIN_TIMEOUT);
+  uint64_t drain_ns = bench_now() - drain;
+  log_stop();
+
+  FILE *fp = stdout;
+  if (output && !(fp = fopen(output, "w"))) {
+    perror(output);
+    return EXIT_FAILURE;
+  }
+
+  bench_json(fp, sink, loops, scale, (uint64_t)cap.num * loops, replay_ns,
+             drain_ns, overhead, class, &params, allocs, alloc_bytes);
+
+  if (fp != stdout) {
+    fclose(fp);
+  }
+
+  buffer_free(&params.data_buffer);
+  hosts_free(&params.hosts);
+  probe_free(&params.probes);
+  recorder_free(&params.recorder);
+  pthread_mutex_destroy(&params.config_mutex);
+  registry_free(&registry);
+  metrics_free(&metrics);
+  bench_free(&cap);
+
+  return EXIT_SUCCESS;
+}
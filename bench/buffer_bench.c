@@ -0,0 +1,508 @@
+//
+//  arptools
+//
+//  Stuart B. Wilkins, Brookhaven National Laboratory
+//
+//
+//  BSD 3-Clause License
+//
+//  Copyright (c) 2021, Brookhaven Science Associates
+//  All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without
+//  modification, are permitted provided that the following conditions are met:
+//
+//  1. Redistributions of source code must retain the above copyright notice,
+//     this list of conditions and the following disclaimer.
+//
+//  2. Redistributions in binary form must reproduce the above copyright notice,
+//     this list of conditions and the following disclaimer in the documentation
+//     and/or other materials provided with the distribution.
+//
+//  3. Neither the name of the copyright holder nor the names of its
+//     contributors may be used to endorse or promote products derived from
+//     this software without specific prior written permission.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+//  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+//  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+//  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+//  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+//  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+//  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+//  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+//  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+//  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+//  THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+//
+// arpwatch-buffer-bench : measure the capture buffer on its own.
+// Runs producer/consumer throughput with enqueue and end to end
+// latency, the cost of the dedupe scan against occupancy and
+// wrap-around when nothing drains the ring, for every buffer
+// implementation, ring size and record size, and prints a table.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <time.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <sched.h>
+
+#include "arpwatch.h"
+#include "buffer.h"
+#include "debug.h"
+
+#define BB_RECORDS               1000000
+#define BB_DEDUPE_INSERTS        2000
+#define BB_WRAP_FACTOR           3
+#define BB_MAX_SIZES             16
+
+int debug_flag = 0;
+
+//
+// Buffer implementations under test. A new buffer is added here
+// with wrappers around its functions.
+//
+
+typedef struct {
+  const char *name;
+  void* (*init)(int size);
+  void (*free)(void *buffer);
+  arp_data* (*get_head)(void *buffer);
+  int (*advance_head)(void *buffer, int unique);
+  arp_data* (*get_tail)(void *buffer);
+  void (*advance_tail)(void *buffer);
+  int (*overruns)(void *buffer);
+} bb_impl;
+
+static void *bb_mutex_init(int size) {
+  buffer_data *buffer = malloc(sizeof(buffer_data));
+  if (!buffer) {
+    return NULL;
+  }
+
+  // As the daemon sets it up, overwriting the oldest when full
+
+  if (buffer_init(buffer, size, 1) != BUFFER_NOERR) {
+    free(buffer);
+    return NULL;
+  }
+
+  return buffer;
+}
+
+static void bb_mutex_free(void *buffer) {
+  buffer_free(buffer);
+  free(buffer);
+}
+
+static arp_data *bb_mutex_get_head(void *buffer) {
+  return buffer_get_head(buffer);
+}
+
+static int bb_mutex_advance_head(void *buffer, int unique) {
+  return buffer_advance_head(buffer, unique);
+}
+
+static arp_data *bb_mutex_get_tail(void *buffer) {
+  return buffer_get_tail(buffer, 0);
+}
+
+static void bb_mutex_advance_tail(void *buffer) {
+  buffer_advance_tail(buffer);
+}
+
+static int bb_mutex_overruns(void *buffer) {
+  return buffer_overruns(buffer);
+}
+
+static const bb_impl bb_impls[] = {
+  {"mutex", bb_mutex_init, bb_mutex_free, bb_mutex_get_head,
+   bb_mutex_advance_head, bb_mutex_get_tail, bb_mutex_advance_tail,
+   bb_mutex_overruns},
+};
+
+#define BB_IMPLS  ((int)(sizeof(bb_impls) / sizeof(bb_impls[0])))
+
+//
+// arp_data has a fixed size, records differ in how much of it the
+// capture thread fills and the sink reads
+//
+
+typedef struct {
+  const char *name;
+  size_t bytes;
+} bb_record;
+
+static const bb_record bb_records[] = {
+  {"arp", offsetof(arp_data, dhcp_name)},
+  {"dhcp", offsetof(arp_data, pv_name)},
+  {"epics", sizeof(arp_data)},
+};
+
+#define BB_RECORD_TYPES  ((int)(sizeof(bb_records) / sizeof(bb_records[0])))
+
+static const int bb_default_sizes[] = {1024, 16384, ARPWATCH_BUFFER_SIZE};
+static const int bb_occupancy[] = {1, 10, 50, 90};
+
+#define BB_OCCUPANCIES   ((int)(sizeof(bb_occupancy) / sizeof(int)))
+
+typedef struct {
+  const bb_impl *impl;
+  const bb_record *record;
+  void *buffer;
+  arp_data *template;
+  int records;
+  int done;
+  uint32_t *enqueue;           // Nanoseconds per record
+  uint32_t *latency;           // Nanoseconds per record consumed
+  int consumed;
+  uint64_t checksum;
+} bb_run;
+
+static uint64_t bb_now(void) {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (uint64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+static void bb_fill(arp_data *d, const arp_data *template, size_t bytes,
+                    uint32_t n) {
+  // Distinct on the fields compared by the dedupe scan
+
+  memcpy(d, template, bytes);
+  d->ip_addr.s_addr = htonl(0x0A000000 | (n & 0x00FFFFFF));
+  d->hw_addr[2] = n >> 24;
+  d->hw_addr[3] = n >> 16;
+  d->hw_addr[4] = n >> 8;
+  d->hw_addr[5] = n;
+}
+
+static int bb_compare(const void *a, const void *b) {
+  uint32_t x = *(const uint32_t *)a;
+  uint32_t y = *(const uint32_t *)b;
+  return (x > y) - (x < y);
+}
+
+static uint32_t bb_percentile(uint32_t *v, int num, double p) {
+  if (!num) {
+    return 0;
+  }
+  int i = (int)(p * (num - 1));
+  return v[i];
+}
+
+static uint32_t bb_clamp(uint64_t ns) {
+  return ns > UINT32_MAX ? UINT32_MAX : (uint32_t)ns;
+}
+
+static void *bb_producer(void *arg) {
+  bb_run *run = (bb_run *)arg;
+  const bb_impl *impl = run->impl;
+
+  for (int i = 0; i < run->records; i++) {
+    uint64_t t0 = bb_now();
+    arp_data *d = impl->get_head(run->buffer);
+    bb_fill(d, run->template, run->record->bytes, i);
+    d->queued = t0;
+    impl->advance_head(run->buffer, 0);
+    run->enqueue[i] = bb_clamp(bb_now() - t0);
+  }
+
+  __atomic_store_n(&run->done, 1, __ATOMIC_RELEASE);
+  return NULL;
+}
+
+static void *bb_consumer(void *arg) {
+  bb_run *run = (bb_run *)arg;
+  const bb_impl *impl = run->impl;
+  size_t words = run->record->bytes / sizeof(uint64_t);
+
+  // Poll as the sink does, but without its loop delay
+
+  for (;;) {
+    arp_data *d = impl->get_tail(run->buffer);
+    if (!d) {
+      if (__atomic_load_n(&run->done, __ATOMIC_ACQUIRE) &&
+          !impl->get_tail(run->buffer)) {
+        break;
+      }
+      sched_yield();
+      continue;
+    }
+
+    const uint64_t *w = (const uint64_t *)d;
+    for (size_t i = 0; i < words; i++) {
+      run->checksum += w[i];
+    }
+
+    if (run->consumed < run->records) {
+      run->latency[run->consumed] = bb_clamp(bb_now() - d->queued);
+    }
+    run->consumed++;
+    impl->advance_tail(run->buffer);
+  }
+
+  return NULL;
+}
+
+static int bb_throughput(const bb_impl *impl, const bb_record *record,
+                         int size, int records, arp_data *template) {
+  bb_run run;
+  memset(&run, 0, sizeof(run));
+  run.impl = impl;
+  run.record = record;
+  run.template = template;
+  run.records = records;
+  run.enqueue = malloc(records * sizeof(uint32_t));
+  run.latency = malloc(records * sizeof(uint32_t));
+  run.buffer = impl->init(size);
+  if (!run.enqueue || !run.latency || !run.buffer) {
+    fprintf(stderr, "Unable to allocate memory\n");
+    goto _error;
+  }
+
+  pthread_t producer, consumer;
+  uint64_t start = bb_now();
+  pthread_create(&consumer, NULL, bb_consumer, &run);
+  pthread_create(&producer, NULL, bb_producer, &run);
+  pthread_join(producer, NULL);
+  pthread_join(consumer, NULL);
+  uint64_t wall = bb_now() - start;
+
+  int consumed = run.consumed < records ? run.consumed : records;
+  qsort(run.enqueue, records, sizeof(uint32_t), bb_compare);
+  qsort(run.latency, consumed, sizeof(uint32_t), bb_compare);
+
+  printf("%-8s %8d %-6s %9.2f %9d %9d %8u %8u %10u %10u\n",
+         impl->name, size, record->name, records * 1e3 / wall,
+         impl->overruns(run.buffer), records - run.consumed,
+         bb_percentile(run.enqueue, records, 0.5),
+         bb_percentile(run.enqueue, records, 0.99),
+         bb_percentile(run.latency, consumed, 0.5),
+         bb_percentile(run.latency, consumed, 0.99));
+
+  impl->free(run.buffer);
+  free(run.enqueue);
+  free(run.latency);
+  return 0;
+
+_error:
+  if (run.buffer) {
+    impl->free(run.buffer);
+  }
+  free(run.enqueue);
+  free(run.latency);
+  return -1;
+}
+
+static int bb_dedupe(const bb_impl *impl, int size, arp_data *template) {
+  // Every insert misses, so the scan covers the whole occupancy.
+  // Taking one off the tail after each keeps the occupancy fixed.
+
+  const bb_record *record = &bb_records[0];
+  printf("%-8s %8d", impl->name, size);
+
+  for (int o = 0; o < BB_OCCUPANCIES; o++) {
+    void *buffer = impl->init(size);
+    if (!buffer) {
+      fprintf(stderr, "Unable to allocate memory\n");
+      return -1;
+    }
+
+    int fill = (int)((int64_t)(size - 1) * bb_occupancy[o] / 100);
+    uint32_t n = 0;
+    for (; (int)n < fill; n++) {
+      bb_fill(impl->get_head(buffer), template, record->bytes, n);
+      impl->advance_head(buffer, 0);
+    }
+
+    uint64_t total = 0;
+    for (int i = 0; i < BB_DEDUPE_INSERTS; i++, n++) {
+      bb_fill(impl->get_head(buffer), template, record->bytes, n);
+      uint64_t t0 = bb_now();
+      impl->advance_head(buffer, 1);
+      total += bb_now() - t0;
+      if (impl->get_tail(buffer)) {
+        impl->advance_tail(buffer);
+      }
+    }
+
+    printf(" %10.0f", (double)total / BB_DEDUPE_INSERTS);
+    impl->free(buffer);
+  }
+
+  printf("\n");
+  return 0;
+}
+
+static int bb_wrap(const bb_impl *impl, int size, arp_data *template) {
+  // Write past the end with nothing draining, then check the ring
+  // still holds the newest size - 1 records in order
+
+  const bb_record *record = &bb_records[0];
+  void *buffer = impl->init(size);
+  if (!buffer) {
+    fprintf(stderr, "Unable to allocate memory\n");
+    return -1;
+  }
+
+  int records = size * BB_WRAP_FACTOR;
+  uint64_t start = bb_now();
+  for (int i = 0; i < records; i++) {
+    bb_fill(impl->get_head(buffer), template, record->bytes, i);
+    impl->advance_head(buffer, 0);
+  }
+  uint64_t wall = bb_now() - start;
+
+  int expected = size - 1;
+  uint32_t next = records - expected;
+  int kept = 0;
+  int ordered = 1;
+  arp_data *d;
+  while ((d = impl->get_tail(buffer)) && (kept < records)) {
+    uint32_t n = ntohl(d->ip_addr.s_addr) & 0x00FFFFFF;
+    if (n != (next & 0x00FFFFFF)) {
+      ordered = 0;
+    }
+    next++;
+    kept++;
+    impl->advance_tail(buffer);
+  }
+
+  printf("%-8s %8d %10.1f %10d %10d %10d %8s\n",
+         impl->name, size, (double)wall / records,
+         impl->overruns(buffer), expected, kept,
+         (kept == expected && ordered) ? "yes" : "no");
+
+  impl->free(buffer);
+  return 0;
+}
+
+static int bb_parse_sizes(char *arg, int *sizes) {
+  int num = 0;
+  for (char *tok = strtok(arg, ","); tok && num < BB_MAX_SIZES;
+       tok = strtok(NULL, ",")) {
+    sizes[num] = atoi(tok);
+    if (sizes[num] < 2) {
+      return -1;
+    }
+    num++;
+  }
+  return num;
+}
+
+static void bb_usage(const char *name) {
+  fprintf(stderr,
+          "Usage: %s [options]\n"
+          "  -n records  Records per throughput run (default %d)\n"
+          "  -s sizes    Comma separated ring sizes (default 1024,16384,%d)\n"
+          "  -b name     Only run the named buffer implementation\n",
+          name, BB_RECORDS, ARPWATCH_BUFFER_SIZE);
+}
+
+int main(int argc, char *argv[]) {
+  int records = BB_RECORDS;
+  int sizes[BB_MAX_SIZES];
+  int num_sizes = sizeof(bb_default_sizes) / sizeof(int);
+  const char *only = NULL;
+  int opt;
+
+  memcpy(sizes, bb_default_sizes, sizeof(bb_default_sizes));
+
+  while ((opt = getopt(argc, argv, "n:s:b:h")) != -1) {
+    switch (opt) {
+      case 'n':
+        records = atoi(optarg);
+        break;
+      case 's':
+        num_sizes = bb_parse_sizes(optarg, sizes);
+        break;
+      case 'b':
+        only = optarg;
+        break;
+      default:
+        bb_usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+  }
+
+  if ((records <= 0) || (num_sizes <= 0)) {
+    bb_usage(argv[0]);
+    return EXIT_FAILURE;
+  }
+
+  arp_data *template = calloc(1, sizeof(arp_data));
+  if (!template) {
+    fprintf(stderr, "Unable to allocate memory\n");
+    return EXIT_FAILURE;
+  }
+  memset(template->dhcp_name, 'h', BUFFER_NAME_MAX - 1);
+  memset(template->pv_name, 'p', sizeof(template->pv_name));
+  template->type = BUFFER_TYPE_ARP_SRC;
+  template->pv_num = BUFFER_PV_MAX;
+  template->hw_addr[0] = 0x02;
+
+  int rtn = EXIT_SUCCESS;
+
+  printf("Throughput, one producer and one consumer, %d records\n\n",
+         records);
+  printf("%-8s %8s %-6s %9s %9s %9s %8s %8s %10s %10s\n",
+         "buffer", "size", "record", "Mrec/s", "overruns", "lost",
+         "enq p50", "enq p99", "e2e p50", "e2e p99");
+  for (int i = 0; i < BB_IMPLS; i++) {
+    if (only && strcmp(only, bb_impls[i].name)) {
+      continue;
+    }
+    for (int s = 0; s < num_sizes; s++) {
+      for (int r = 0; r < BB_RECORD_TYPES; r++) {
+        if (bb_throughput(&bb_impls[i], &bb_records[r], sizes[s],
+                          records, template)) {
+          rtn = EXIT_FAILURE;
+        }
+      }
+    }
+  }
+
+  printf("\nDedupe insert (ns) against occupancy\n\n");
+  printf("%-8s %8s", "buffer", "size");
+  for (int o = 0; o < BB_OCCUPANCIES; o++) {
+    printf(" %9d%%", bb_occupancy[o]);
+  }
+  printf("\n");
+  for (int i = 0; i < BB_IMPLS; i++) {
+    if (only && strcmp(only, bb_impls[i].name)) {
+      continue;
+    }
+    for (int s = 0; s < num_sizes; s++) {
+      if (bb_dedupe(&bb_impls[i], sizes[s], template)) {
+        rtn = EXIT_FAILURE;
+      }
+    }
+  }
+
+  printf("\nWrap-around, %d times the size with no consumer\n\n",
+         BB_WRAP_FACTOR);
+  printf("%-8s %8s %10s %10s %10s %10s %8s\n", "buffer", "size",
+         "ns/insert", "overruns", "expected", "kept", "intact");
+  for (int i = 0; i < BB_IMPLS; i++) {
+    if (only && strcmp(only, bb_impls[i].name)) {
+      continue;
+    }
+    for (int s = 0; s < num_sizes; s++) {
+      if (bb_wrap(&bb_impls[i], sizes[s], template)) {
+        rtn = EXIT_FAILURE;
+      }
+    }
+  }
+
+  free(template);
+  return rtn;
+}
@@ -0,0 +1,846 @@
+//
+//  arptools
+//
+//  Stuart B. Wilkins, Brookhaven National Laboratory
+//
+//
+//  BSD 3-Clause License
+//
+//  Copyright (c) 2021, Brookhaven Science Associates
+//  All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without
+//  modification, are permitted provided that the following conditions are met:
+//
+//  1. Redistributions of source code must retain the above copyright notice,
+//     this list of conditions and the following disclaimer.
+//
+//  2. Redistributions in binary form must reproduce the above copyright notice,
+//     this list of conditions and the following disclaimer in the documentation
+//     and/or other materials provided with the distribution.
+//
+//  3. Neither the name of the copyright holder nor the names of its
+//     contributors may be used to endorse or promote products derived from
+//     this software without specific prior written permission.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+//  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+//  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+//  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+//  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+//  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+//  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+//  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+//  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+//  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+//  THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+//
+// arpwatch-gen : write synthetic traffic from a profile to a pcap
+// file or inject it on an interface. The same profile and seed
+// always produce the same frames.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+#include <time.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <arpa/inet.h>
+#include <net/if_arp.h>
+#include <libconfig.h>
+#include <pcap.h>
+
+#include "arpwatch.h"
+#include "capture.h"
+
+#define GEN_ARP                  0
+#define GEN_PROBE                1
+#define GEN_GRATUITOUS           2
+#define GEN_DHCP                 3
+#define GEN_EPICS                4
+#define GEN_STORM                5
+#define GEN_STREAMS              6
+
+#define GEN_HOSTS                1000
+#define GEN_VLANS                1
+#define GEN_VLAN_BASE            0
+#define GEN_NETWORK              "10.0.0.0"
+#define GEN_DURATION             60.0     // Seconds
+#define GEN_START_TIME           1609459200
+#define GEN_SEED                 1
+#define GEN_ARP_RATE             1000.0   // Frames per second
+#define GEN_ARP_REPLY_RATIO      0.5
+#define GEN_PROBE_RATE           5.0
+#define GEN_GRATUITOUS_RATE      5.0
+#define GEN_DHCP_RATE            10.0
+#define GEN_EPICS_RATE           100.0
+#define GEN_EPICS_PVS            10       // PVs per search frame
+#define GEN_EPICS_PV_COUNT       100      // PVs per host
+#define GEN_STORM_RATE           0.0
+#define GEN_STORM_MACS           4
+#define GEN_STORM_START          10.0
+#define GEN_STORM_LENGTH         5.0
+#define GEN_DUPLICATE_RATIO      0.1
+
+#define GEN_MAX_VLANS            256
+#define GEN_MAX_HOSTS_PER_VLAN   0xFE00   // Above this the storm sources
+#define GEN_MAX_FRAME            1514
+#define GEN_MIN_FRAME            60
+#define GEN_DELAY                0.0001   // Reply and duplicate delay
+#define GEN_PENDING              256
+#define GEN_SEARCH_SIZE          (sizeof(struct ca_proto_search) + 24)
+#define GEN_CA_VERSION           13
+#define GEN_CA_DONT_REPLY        5
+#define GEN_CA_SEARCH            6
+#define GEN_DHCP_COOKIE          0x63825363
+#define GEN_DHCP_MIN             300      // Minimum BOOTP payload
+#define GEN_STORM_DPORT          NETBIOS_PORT
+
+static const char *gen_stream_name[GEN_STREAMS] = {
+  "arp", "probe", "gratuitous", "dhcp", "epics", "storm"
+};
+
+typedef struct {
+  int hosts;
+  int vlans;
+  int vlan_base;
+  struct in_addr network;
+  double duration;
+  long start_time;
+  uint64_t seed;
+  double rate[GEN_STREAMS];
+  double arp_reply_ratio;
+  int epics_pvs;
+  int epics_pv_count;
+  int storm_macs;
+  double storm_start;
+  double storm_length;
+  double duplicate_ratio;
+} gen_profile;
+
+typedef struct {
+  double t;
+  int len;
+  u_char data[GEN_MAX_FRAME];
+} gen_frame;
+
+typedef struct {
+  gen_profile *profile;
+  uint64_t state;
+  pcap_t *pcap;
+  pcap_dumper_t *dumper;
+  double scale;
+  struct timespec start;
+  gen_frame frame;
+  gen_frame pending[GEN_PENDING];
+  int pending_head;
+  int pending_num;
+  uint64_t frames[GEN_STREAMS];
+  uint64_t replies;
+  uint64_t duplicates;
+  uint64_t total;
+  uint64_t bytes;
+  int error;
+} gen_data;
+
+//
+// splitmix64, so the output does not depend on the C library
+//
+
+static uint64_t gen_rand(gen_data *gen) {
+  uint64_t z = (gen->state += 0x9E3779B97F4A7C15ULL);
+  z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+  z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+  return z ^ (z >> 31);
+}
+
+static double gen_uniform(gen_data *gen) {
+  return (gen_rand(gen) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+static int gen_below(gen_data *gen, int n) {
+  return (int)(gen_uniform(gen) * n);
+}
+
+static double gen_next(gen_data *gen, int stream, double t) {
+  // Poisson arrivals at the rate of the stream
+
+  gen_profile *p = gen->profile;
+  double rate = p->rate[stream];
+  if (rate <= 0) {
+    return INFINITY;
+  }
+
+  if ((stream == GEN_STORM) && (t < p->storm_start)) {
+    t = p->storm_start;
+  }
+
+  t -= log(1.0 - gen_uniform(gen)) / rate;
+
+  if ((stream == GEN_STORM) && (t > p->storm_start + p->storm_length)) {
+    return INFINITY;
+  }
+
+  return t;
+}
+
+//
+// Hosts are spread round robin over the VLANs. Host i has the MAC
+// 02:00:xx:xx:xx:xx with i in the last four bytes and the address
+// network + (vlan << 16) + (i / vlans) + 1
+//
+
+static int gen_host_vlan(gen_profile *p, int host) {
+  return host % p->vlans;
+}
+
+static uint16_t gen_vlan_id(gen_profile *p, int vlan) {
+  return p->vlan_base ? p->vlan_base + vlan : 0;
+}
+
+static void gen_host_mac(int host, uint8_t *mac) {
+  mac[0] = 0x02;
+  mac[1] = 0x00;
+  mac[2] = host >> 24;
+  mac[3] = host >> 16;
+  mac[4] = host >> 8;
+  mac[5] = host;
+}
+
+static struct in_addr gen_addr(gen_profile *p, int vlan, int n) {
+  struct in_addr addr;
+  addr.s_addr = htonl(ntohl(p->network.s_addr) + (vlan << 16) + n);
+  return addr;
+}
+
+static struct in_addr gen_host_addr(gen_profile *p, int host) {
+  return gen_addr(p, gen_host_vlan(p, host), host / p->vlans + 1);
+}
+
+static int gen_peer(gen_data *gen, int host) {
+  // Another host on the same VLAN
+
+  gen_profile *p = gen->profile;
+  int vlan = gen_host_vlan(p, host);
+  int num = (p->hosts - vlan + p->vlans - 1) / p->vlans;
+  return vlan + p->vlans * gen_below(gen, num);
+}
+
+static const uint8_t gen_broadcast[ETH_ALEN] = {
+  0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF
+};
+static const uint8_t gen_zeros[ETH_ALEN] = {0};
+
+static int gen_ether(gen_frame *f, const uint8_t *dst, const uint8_t *src,
+                     uint16_t vlan, uint16_t type) {
+  if (vlan) {
+    struct ethernet_header_8021q *hdr =
+      (struct ethernet_header_8021q *)f->data;
+    memcpy(hdr->ether_dhost, dst, ETH_ALEN);
+    memcpy(hdr->ether_shost, src, ETH_ALEN);
+    hdr->tpid = htons(ETHERTYPE_8021Q);
+    hdr->tci = htons(vlan & 0x0FFF);
+    hdr->ether_type = htons(type);
+    return sizeof(struct ethernet_header_8021q);
+  }
+
+  struct ethernet_header *hdr = (struct ethernet_header *)f->data;
+  memcpy(hdr->ether_dhost, dst, ETH_ALEN);
+  memcpy(hdr->ether_shost, src, ETH_ALEN);
+  hdr->ether_type = htons(type);
+  return sizeof(struct ethernet_header);
+}
+
+static int gen_arp(gen_frame *f, int pos, int op,
+                   const uint8_t *sha, struct in_addr sip,
+                   const uint8_t *tha, struct in_addr tip) {
+  struct arphdr *hdr = (struct arphdr *)(f->data + pos);
+  hdr->ar_hrd = htons(ARPHRD_ETHER);
+  hdr->ar_pro = htons(ETHERTYPE_IP);
+  hdr->ar_hln = ETH_ALEN;
+  hdr->ar_pln = sizeof(struct in_addr);
+  hdr->ar_op = htons(op);
+  pos += sizeof(struct arphdr);
+
+  struct arpbdy *bdy = (struct arpbdy *)(f->data + pos);
+  memcpy(bdy->ar_sha, sha, ETH_ALEN);
+  bdy->ar_sip = sip;
+  memcpy(bdy->ar_tha, tha, ETH_ALEN);
+  bdy->ar_tip = tip;
+
+  return pos + sizeof(struct arpbdy);
+}
+
+static int gen_udp(gen_frame *f, int pos, struct in_addr sip,
+                   struct in_addr dip, uint16_t sport, uint16_t dport,
+                   int len) {
+  struct ipbdy *ip = (struct ipbdy *)(f->data + pos);
+  memset(ip, 0, sizeof(struct ipbdy));
+  ip->ver_ihl = 0x45;
+  ip->tlen = htons(sizeof(struct ipbdy) + sizeof(struct udphdr) + len);
+  ip->ttl = 64;
+  ip->proto = IP_PROTO_UDP;
+  ip->ip_sip = sip;
+  ip->ip_dip = dip;
+
+  uint32_t sum = 0;
+  const uint8_t *byte = (const uint8_t *)ip;
+  for (size_t i = 0; i < sizeof(struct ipbdy); i += 2) {
+    sum += (byte[i] << 8) | byte[i + 1];
+  }
+  while (sum >> 16) {
+    sum = (sum & 0xFFFF) + (sum >> 16);
+  }
+  ip->crc = htons(~sum);
+  pos += sizeof(struct ipbdy);
+
+  // No UDP checksum, which IPv4 allows
+
+  struct udphdr *udp = (struct udphdr *)(f->data + pos);
+  udp->sport = htons(sport);
+  udp->dport = htons(dport);
+  udp->len = htons(sizeof(struct udphdr) + len);
+  udp->checksum = 0;
+
+  return pos + sizeof(struct udphdr);
+}
+
+static void gen_arp_frame(gen_data *gen, int stream, int host) {
+  gen_profile *p = gen->profile;
+  gen_frame *f = &gen->frame;
+  uint8_t mac[ETH_ALEN];
+  struct in_addr addr = gen_host_addr(p, host);
+  struct in_addr zero = {0};
+  gen_host_mac(host, mac);
+
+  int pos = gen_ether(f, gen_broadcast, mac,
+                      gen_vlan_id(p, gen_host_vlan(p, host)),
+                      ETHERTYPE_ARP);
+
+  if (stream == GEN_PROBE) {
+    f->len = gen_arp(f, pos, ARPOP_REQUEST, mac, zero, gen_zeros, addr);
+  } else if (stream == GEN_GRATUITOUS) {
+    f->len = gen_arp(f, pos, ARPOP_REQUEST, mac, addr, gen_zeros, addr);
+  } else {
+    int peer = gen_peer(gen, host);
+    f->len = gen_arp(f, pos, ARPOP_REQUEST, mac, addr, gen_zeros,
+                     gen_host_addr(p, peer));
+  }
+}
+
+static void gen_arp_reply(gen_data *gen, gen_frame *reply,
+                          const gen_frame *request) {
+  // The target of the request answers the sender
+
+  gen_profile *p = gen->profile;
+  struct ethernet_header *eth = (struct ethernet_header *)request->data;
+  int pos = (ntohs(eth->ether_type) == ETHERTYPE_8021Q) ?
+            sizeof(struct ethernet_header_8021q) :
+            sizeof(struct ethernet_header);
+  struct arpbdy *req = (struct arpbdy *)(request->data + pos +
+                                         sizeof(struct arphdr));
+
+  uint32_t n = ntohl(req->ar_tip.s_addr) - ntohl(p->network.s_addr);
+  int vlan = n >> 16;
+  int host = ((n & 0xFFFF) - 1) * p->vlans + vlan;
+  uint8_t mac[ETH_ALEN];
+  gen_host_mac(host, mac);
+
+  pos = gen_ether(reply, eth->ether_shost, mac, gen_vlan_id(p, vlan),
+                  ETHERTYPE_ARP);
+  reply->len = gen_arp(reply, pos, ARPOP_REPLY, mac, req->ar_tip,
+                       req->ar_sha, req->ar_sip);
+}
+
+static void gen_dhcp_frame(gen_data *gen, int host) {
+  gen_profile *p = gen->profile;
+  gen_frame *f = &gen->frame;
+  uint8_t mac[ETH_ALEN];
+  struct in_addr zero = {0};
+  struct in_addr bcast = {INADDR_BROADCAST};
+  gen_host_mac(host, mac);
+
+  char name[BUFFER_NAME_MAX];
+  int name_len = snprintf(name, sizeof(name), "host-%05d", host);
+
+  int pos = gen_ether(f, gen_broadcast, mac,
+                      gen_vlan_id(p, gen_host_vlan(p, host)),
+                      ETHERTYPE_IP);
+  pos = gen_udp(f, pos, zero, bcast, DHCP_DISCOVER_SPORT,
+                DHCP_DISCOVER_DPORT, GEN_DHCP_MIN);
+
+  struct dhcpbdy *dhcp = (struct dhcpbdy *)(f->data + pos);
+  memset(dhcp, 0, GEN_DHCP_MIN);
+  dhcp->op = 1;
+  dhcp->htype = ARPHRD_ETHER;
+  dhcp->hlen = ETH_ALEN;
+  dhcp->xid = htonl((uint32_t)gen_rand(gen));
+  dhcp->flags = htons(0x8000);
+  memcpy(dhcp->hwaddr, mac, ETH_ALEN);
+  dhcp->cookie = htonl(GEN_DHCP_COOKIE);
+
+  // DISCOVER or REQUEST with the hostname
+
+  u_char *opt = (u_char *)(dhcp + 1);
+  *opt++ = DHCP_OPCODE_MESSAGE_TYPE;
+  *opt++ = 1;
+  *opt++ = gen_below(gen, 2) ? 3 : 1;
+  *opt++ = DHCP_OPCODE_HOSTNAME;
+  *opt++ = name_len;
+  memcpy(opt, name, name_len);
+  opt += name_len;
+  *opt++ = DHCP_OPCODE_END;
+
+  f->len = pos + GEN_DHCP_MIN;
+}
+
+static void gen_epics_frame(gen_data *gen, int host) {
+  gen_profile *p = gen->profile;
+  gen_frame *f = &gen->frame;
+  uint8_t mac[ETH_ALEN];
+  struct in_addr bcast = {INADDR_BROADCAST};
+  gen_host_mac(host, mac);
+
+  int len = sizeof(struct ca_proto_msg) + p->epics_pvs * GEN_SEARCH_SIZE;
+  int pos = gen_ether(f, gen_broadcast, mac,
+                      gen_vlan_id(p, gen_host_vlan(p, host)),
+                      ETHERTYPE_IP);
+  pos = gen_udp(f, pos, gen_host_addr(p, host), bcast,
+                EPICS_DPORT + 1000 + (host % 1000), EPICS_DPORT, len);
+
+  struct ca_proto_msg *msg = (struct ca_proto_msg *)(f->data + pos);
+  memset(msg, 0, len);
+  msg->count = htons(GEN_CA_VERSION);
+  pos += sizeof(struct ca_proto_msg);
+
+  // A search for each PV, names padded to 8 bytes
+
+  for (int i = 0; i < p->epics_pvs; i++) {
+    struct ca_proto_search *search =
+      (struct ca_proto_search *)(f->data + pos);
+    uint32_t cid = (uint32_t)gen_rand(gen);
+    search->command = htons(GEN_CA_SEARCH);
+    search->payload_size = htons(GEN_SEARCH_SIZE -
+                                 sizeof(struct ca_proto_search));
+    search->reply = htons(GEN_CA_DONT_REPLY);
+    search->version = htons(GEN_CA_VERSION);
+    search->cid1 = htonl(cid);
+    search->cid2 = htonl(cid);
+    pos += sizeof(struct ca_proto_search);
+
+    snprintf((char *)(f->data + pos),
+             GEN_SEARCH_SIZE - sizeof(struct ca_proto_search),
+             "BENCH:%05d:PV%04d", host, gen_below(gen, p->epics_pv_count));
+    pos += GEN_SEARCH_SIZE - sizeof(struct ca_proto_search);
+  }
+
+  f->len = pos;
+}
+
+static void gen_storm_frame(gen_data *gen) {
+  // Broadcast name queries from a few sources above the hosts
+
+  gen_profile *p = gen->profile;
+  gen_frame *f = &gen->frame;
+  struct in_addr bcast = {INADDR_BROADCAST};
+  int source = gen_below(gen, p->storm_macs);
+  int vlan = source % p->vlans;
+  uint8_t mac[ETH_ALEN] = {0x02, 0xFF, 0x00, 0x00, 0x00, source};
+
+  int len = sizeof(struct netbioshdr) + sizeof(struct netbiosbdy);
+  int pos = gen_ether(f, gen_broadcast, mac, gen_vlan_id(p, vlan),
+                      ETHERTYPE_IP);
+  pos = gen_udp(f, pos, gen_addr(p, vlan, GEN_MAX_HOSTS_PER_VLAN + source),
+                bcast, GEN_STORM_DPORT, GEN_STORM_DPORT, len);
+
+  memset(f->data + pos, 0, len);
+  struct netbioshdr *hdr = (struct netbioshdr *)(f->data + pos);
+  hdr->trans_id = htons((uint16_t)gen_rand(gen));
+  hdr->flags = htons(0x0110);
+  hdr->n_queries = htons(1);
+  struct netbiosbdy *bdy = (struct netbiosbdy *)(hdr + 1);
+  bdy->len = NETBIOS_NAMELEN;
+  memset(bdy->name, 'A', NETBIOS_NAMELEN);
+  bdy->type = htons(0x20);
+  bdy->_class = htons(1);
+
+  f->len = pos + len;
+}
+
+static void gen_write(gen_data *gen, gen_frame *f) {
+  if (f->len < GEN_MIN_FRAME) {
+    memset(f->data + f->len, 0, GEN_MIN_FRAME - f->len);
+    f->len = GEN_MIN_FRAME;
+  }
+
+  gen->total++;
+  gen->bytes += f->len;
+
+  if (gen->dumper) {
+    struct pcap_pkthdr hdr;
+    double t = floor(f->t);
+    hdr.ts.tv_sec = gen->profile->start_time + (time_t)t;
+    hdr.ts.tv_usec = (suseconds_t)((f->t - t) * 1e6);
+    hdr.caplen = f->len;
+    hdr.len = f->len;
+    pcap_dump((u_char *)gen->dumper, &hdr, f->data);
+    return;
+  }
+
+  // Injecting, paced to scale times the profile rate
+
+  if (gen->scale > 0) {
+    double t = f->t / gen->scale;
+    struct timespec ts = gen->start;
+    ts.tv_sec += (time_t)t;
+    ts.tv_nsec += (long)((t - floor(t)) * 1e9);
+    if (ts.tv_nsec >= 1000000000) {
+      ts.tv_sec++;
+      ts.tv_nsec -= 1000000000;
+    }
+    clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL);
+  }
+
+  if (pcap_inject(gen->pcap, f->data, f->len) != f->len) {
+    fprintf(stderr, "Unable to inject frame : %s\n",
+            pcap_geterr(gen->pcap));
+    gen->error = 1;
+  }
+}
+
+static void gen_queue(gen_data *gen, gen_frame *f) {
+  // Replies and duplicates follow GEN_DELAY after their frame, so
+  // the queue stays in time order
+
+  if (gen->pending_num == GEN_PENDING) {
+    return;
+  }
+
+  int n = (gen->pending_head + gen->pending_num) % GEN_PENDING;
+  gen_frame *q = &gen->pending[n];
+  q->t = f->t + GEN_DELAY;
+  q->len = f->len;
+  memcpy(q->data, f->data, f->len);
+  gen->pending_num++;
+}
+
+static int gen_run(gen_data *gen) {
+  gen_profile *p = gen->profile;
+  double next[GEN_STREAMS];
+
+  gen->state = p->seed;
+  for (int s = 0; s < GEN_STREAMS; s++) {
+    next[s] = gen_next(gen, s, 0);
+  }
+
+  clock_gettime(CLOCK_MONOTONIC, &gen->start);
+
+  while (!gen->error) {
+    int stream = 0;
+    for (int s = 1; s < GEN_STREAMS; s++) {
+      if (next[s] < next[stream]) {
+        stream = s;
+      }
+    }
+    double t = next[stream];
+
+    if (gen->pending_num &&
+        (gen->pending[gen->pending_head].t <= t ||
+         t > p->duration)) {
+      gen_write(gen, &gen->pending[gen->pending_head]);
+      gen->pending_head = (gen->pending_head + 1) % GEN_PENDING;
+      gen->pending_num--;
+      continue;
+    }
+
+    if (t > p->duration) {
+      break;
+    }
+
+    gen_frame *f = &gen->frame;
+    int host = gen_below(gen, p->hosts);
+    switch (stream) {
+      case GEN_DHCP:
+        gen_dhcp_frame(gen, host);
+        break;
+      case GEN_EPICS:
+        gen_epics_frame(gen, host);
+        break;
+      case GEN_STORM:
+        gen_storm_frame(gen);
+        break;
+      default:
+        gen_arp_frame(gen, stream, host);
+    }
+    f->t = t;
+    gen->frames[stream]++;
+    gen_write(gen, f);
+
+    if ((stream == GEN_ARP) && (gen_uniform(gen) < p->arp_reply_ratio)) {
+      gen_frame reply;
+      reply.t = t;
+      gen_arp_reply(gen, &reply, f);
+      gen_queue(gen, &reply);
+      gen->replies++;
+    }
+
+    if (gen_uniform(gen) < p->duplicate_ratio) {
+      gen_queue(gen, f);
+      gen->duplicates++;
+    }
+
+    next[stream] = gen_next(gen, stream, t);
+  }
+
+  return gen->error ? -1 : 0;
+}
+
+static int gen_lookup_double(config_t *cfg, const char *path,
+                             double *value) {
+  // Accept both 10 and 10.0
+
+  int i;
+  if (config_lookup_float(cfg, path, value)) {
+    return 1;
+  }
+  if (config_lookup_int(cfg, path, &i)) {
+    *value = i;
+    return 1;
+  }
+  return 0;
+}
+
+static int gen_read_profile(gen_profile *p, const char *filename) {
+  config_t cfg;
+  const char *str;
+  double seed;
+  int rtn = -1;
+
+  config_init(&cfg);
+
+  if (!config_read_file(&cfg, filename)) {
+    fprintf(stderr, "%s:%d - %s\n", config_error_file(&cfg),
+            config_error_line(&cfg), config_error_text(&cfg));
+    goto _error;
+  }
+
+  config_lookup_int(&cfg, "hosts", &p->hosts);
+  config_lookup_int(&cfg, "vlans", &p->vlans);
+  config_lookup_int(&cfg, "vlan_base", &p->vlan_base);
+  if (config_lookup_string(&cfg, "network", &str) &&
+      !inet_aton(str, &p->network)) {
+    fprintf(stderr, "Invalid network %s\n", str);
+    goto _error;
+  }
+  gen_lookup_double(&cfg, "duration", &p->duration);
+  if (gen_lookup_double(&cfg, "seed", &seed)) {
+    p->seed = (uint64_t)seed;
+  }
+
+  gen_lookup_double(&cfg, "arp_rate", &p->rate[GEN_ARP]);
+  gen_lookup_double(&cfg, "arp_reply_ratio", &p->arp_reply_ratio);
+  gen_lookup_double(&cfg, "probe_rate", &p->rate[GEN_PROBE]);
+  gen_lookup_double(&cfg, "gratuitous_rate", &p->rate[GEN_GRATUITOUS]);
+  gen_lookup_double(&cfg, "dhcp_rate", &p->rate[GEN_DHCP]);
+  gen_lookup_double(&cfg, "epics_rate", &p->rate[GEN_EPICS]);
+  config_lookup_int(&cfg, "epics_pvs", &p->epics_pvs);
+  config_lookup_int(&cfg, "epics_pv_count", &p->epics_pv_count);
+  gen_lookup_double(&cfg, "storm_rate", &p->rate[GEN_STORM]);
+  config_lookup_int(&cfg, "storm_macs", &p->storm_macs);
+  gen_lookup_double(&cfg, "storm_start", &p->storm_start);
+  gen_lookup_double(&cfg, "storm_length", &p->storm_length);
+  gen_lookup_double(&cfg, "duplicate_ratio", &p->duplicate_ratio);
+
+  rtn = 0;
+
+_error:
+  config_destroy(&cfg);
+  return rtn;
+}
+
+static void gen_default_profile(gen_profile *p) {
+  memset(p, 0, sizeof(gen_profile));
+  p->hosts = GEN_HOSTS;
+  p->vlans = GEN_VLANS;
+  p->vlan_base = GEN_VLAN_BASE;
+  inet_aton(GEN_NETWORK, &p->network);
+  p->duration = GEN_DURATION;
+  p->start_time = GEN_START_TIME;
+  p->seed = GEN_SEED;
+  p->rate[GEN_ARP] = GEN_ARP_RATE;
+  p->rate[GEN_PROBE] = GEN_PROBE_RATE;
+  p->rate[GEN_GRATUITOUS] = GEN_GRATUITOUS_RATE;
+  p->rate[GEN_DHCP] = GEN_DHCP_RATE;
+  p->rate[GEN_EPICS] = GEN_EPICS_RATE;
+  p->rate[GEN_STORM] = GEN_STORM_RATE;
+  p->arp_reply_ratio = GEN_ARP_REPLY_RATIO;
+  p->epics_pvs = GEN_EPICS_PVS;
+  p->epics_pv_count = GEN_EPICS_PV_COUNT;
+  p->storm_macs = GEN_STORM_MACS;
+  p->storm_start = GEN_STORM_START;
+  p->storm_length = GEN_STORM_LENGTH;
+  p->duplicate_ratio = GEN_DUPLICATE_RATIO;
+}
+
+static int gen_check_profile(gen_profile *p) {
+  int max_pvs = (GEN_MAX_FRAME - sizeof(struct ethernet_header_8021q) -
+                 sizeof(struct ipbdy) - sizeof(struct udphdr) -
+                 sizeof(struct ca_proto_msg)) / GEN_SEARCH_SIZE;
+
+  if ((p->vlans < 1) || (p->vlans > GEN_MAX_VLANS) ||
+      (p->vlan_base < 0) || (p->vlan_base + p->vlans > 4095)) {
+    fprintf(stderr, "vlans must be 1 to %d and fit below 4095\n",
+            GEN_MAX_VLANS);
+    return -1;
+  }
+  if ((p->hosts < 1) ||
+      (p->hosts / p->vlans >= GEN_MAX_HOSTS_PER_VLAN)) {
+    fprintf(stderr, "hosts must be 1 to %d per VLAN\n",
+            GEN_MAX_HOSTS_PER_VLAN - 1);
+    return -1;
+  }
+  if ((p->epics_pvs < 1) || (p->epics_pvs > max_pvs) ||
+      (p->epics_pv_count < 1) || (p->epics_pv_count > 9999)) {
+    fprintf(stderr, "epics_pvs must be 1 to %d and epics_pv_count "
+            "1 to 9999\n", max_pvs);
+    return -1;
+  }
+  if ((p->storm_macs < 1) || (p->storm_macs > 255)) {
+    fprintf(stderr, "storm_macs must be 1 to 255\n");
+    return -1;
+  }
+  if (p->duration <= 0) {
+    fprintf(stderr, "duration must be positive\n");
+    return -1;
+  }
+
+  return 0;
+}
+
+static void gen_usage(const char *name) {
+  fprintf(stderr,
+          "Usage: %s [options] (-o file.pcap | -i interface)\n"
+          "  -c file    Profile to generate (default built in)\n"
+          "  -s seed    Override the seed of the profile\n"
+          "  -d sec     Override the duration of the profile\n"
+          "  -o file    Write the frames to a pcap file\n"
+          "  -i iface   Inject the frames on an interface\n"
+          "  -t scale   Inject at scale times the profile rate, 0 as "
+          "fast as possible (default 1)\n",
+          name);
+}
+
+int main(int argc, char *argv[]) {
+  const char *profile_file = NULL;
+  const char *output = NULL;
+  const char *device = NULL;
+  double scale = 1;
+  double duration = 0;
+  long long seed = -1;
+  int opt;
+
+  while ((opt = getopt(argc, argv, "c:s:d:o:i:t:h")) != -1) {
+    switch (opt) {
+      case 'c':
+        profile_file = optarg;
+        break;
+      case 's':
+        seed = strtoll(optarg, NULL, 0);
+        break;
+      case 'd':
+        duration = atof(optarg);
+        break;
+      case 'o':
+        output = optarg;
+        break;
+      case 'i':
+        device = optarg;
+        break;
+      case 't':
+        scale = atof(optarg);
+        break;
+      default:
+        gen_usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+  }
+
+  if (!output == !device) {
+    gen_usage(argv[0]);
+    return EXIT_FAILURE;
+  }
+
+  gen_profile profile;
+  gen_default_profile(&profile);
+  if (profile_file && gen_read_profile(&profile, profile_file)) {
+    return EXIT_FAILURE;
+  }
+  if (seed >= 0) {
+    profile.seed = seed;
+  }
+  if (duration > 0) {
+    profile.duration = duration;
+  }
+  if (gen_check_profile(&profile)) {
+    return EXIT_FAILURE;
+  }
+
+  gen_data *gen = calloc(1, sizeof(gen_data));
+  if (!gen) {
+    fprintf(stderr, "Unable to allocate memory\n");
+    return EXIT_FAILURE;
+  }
+  gen->profile = &profile;
+  gen->scale = scale;
+
+  char errbuf[PCAP_ERRBUF_SIZE];
+  if (output) {
+    gen->pcap = pcap_open_dead(DLT_EN10MB, CAPTURE_SNAPLEN);
+    if (gen->pcap) {
+      gen->dumper = pcap_dump_open(gen->pcap, output);
+    }
+    if (!gen->dumper) {
+      fprintf(stderr, "Unable to open %s : %s\n", output,
+              gen->pcap ? pcap_geterr(gen->pcap) : "pcap_open_dead()");
+      goto _error;
+    }
+  } else {
+    gen->pcap = pcap_open_live(device, CAPTURE_SNAPLEN, 0, 0, errbuf);
+    if (!gen->pcap) {
+      fprintf(stderr, "Unable to open %s : %s\n", device, errbuf);
+      goto _error;
+    }
+  }
+
+  int rtn = gen_run(gen);
+
+  fprintf(stderr, "Wrote %lu frames (%lu bytes) in %g seconds :",
+          (unsigned long)gen->total, (unsigned long)gen->bytes,
+          profile.duration);
+  for (int s = 0; s < GEN_STREAMS; s++) {
+    fprintf(stderr, " %s %lu", gen_stream_name[s],
+            (unsigned long)gen->frames[s]);
+  }
+  fprintf(stderr, " replies %lu duplicates %lu\n",
+          (unsigned long)gen->replies, (unsigned long)gen->duplicates);
+
+  if (gen->dumper) {
+    pcap_dump_close(gen->dumper);
+  }
+  pcap_close(gen->pcap);
+  free(gen);
+
+  return rtn ? EXIT_FAILURE : EXIT_SUCCESS;
+
+_error:
+  if (gen->pcap) {
+    pcap_close(gen->pcap);
+  }
+  free(gen);
+  return EXIT_FAILURE;
+}
@@ -0,0 +1,319 @@
+#!/bin/bash
+#
+#  arptools
+#
+#  Stuart B. Wilkins, Brookhaven National Laboratory
+#
+#
+#  BSD 3-Clause License
+#
+#  Copyright (c) 2021, Brookhaven Science Associates
+#  All rights reserved.
+#
+#  Redistribution and use in source and binary forms, with or without
+#  modification, are permitted provided that the following conditions are met:
+#
+#  1. Redistributions of source code must retain the above copyright notice,
+#     this list of conditions and the following disclaimer.
+#
+#  2. Redistributions in binary form must reproduce the above copyright notice,
+#     this list of conditions and the following disclaimer in the documentation
+#     and/or other materials provided with the distribution.
+#
+#  3. Neither the name of the copyright holder nor the names of its
+#     contributors may be used to endorse or promote products derived from
+#     this software without specific prior written permission.
+#
+#  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+#  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+#  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+#  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+#  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+#  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+#  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+#  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+#  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+#  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+#  THE POSSIBILITY OF SUCH DAMAGE.
+#
+# Saturation ramp on a veth pair between two network namespaces. The
+# daemon captures on one end while arpwatch-gen injects traffic on the
+# other at rising rates, until the kernel drops packets, the buffer
+# overruns or the sink falls behind. Then the ARP scan is timed in the
+# other direction. Needs root and a build with -DBENCHMARKS=ON.
+#
+
+set -eu
+
+BUILD=build
+PROFILE=""
+SINK=sqlite
+START=1000              # pps of the first step
+FACTOR=1.5              # Increase per step
+MAX=1000000             # pps to stop at
+STEP=10                 # Seconds per step
+SETTLE=3                # Seconds after a step before reading metrics
+LAG=10                  # Percent of the buffer left unflushed that is lag
+SCAN_PPS=50000          # arp_max_pps for the scan
+SCAN_HOSTS=65534        # Addresses in the scanned /16
+SCAN_LIMIT=120          # Seconds to wait for the sweep
+PORT=9187
+
+NS_DAEMON=awb-daemon
+NS_GEN=awb-gen
+DEV_DAEMON=awb0
+DEV_GEN=awb1
+
+usage() {
+  cat >&2 <<USAGE
+Usage: $0 [options]
+  -b dir      Build directory with arpwatch and bench/ (default $BUILD)
+  -p file     arpwatch-gen profile (default built in)
+  -s sink     Sink for the daemon, sqlite or null (default $SINK)
+  -r pps      Rate of the first step (default $START)
+  -f factor   Rate increase per step (default $FACTOR)
+  -m pps      Highest rate to try (default $MAX)
+  -t sec      Seconds per step (default $STEP)
+  -a pps      ARP scan rate limit (default $SCAN_PPS)
+USAGE
+  exit 1
+}
+
+while getopts "b:p:s:r:f:m:t:a:h" opt; do
+  case $opt in
+    b) BUILD=$OPTARG ;;
+    p) PROFILE=$OPTARG ;;
+    s) SINK=$OPTARG ;;
+    r) START=$OPTARG ;;
+    f) FACTOR=$OPTARG ;;
+    m) MAX=$OPTARG ;;
+    t) STEP=$OPTARG ;;
+    a) SCAN_PPS=$OPTARG ;;
+    *) usage ;;
+  esac
+done
+
+ARPWATCH=$(realpath "$BUILD/arpwatch")
+GEN=$(realpath "$BUILD/bench/arpwatch-gen")
+[ -x "$ARPWATCH" ] && [ -x "$GEN" ] || {
+  echo "arpwatch and bench/arpwatch-gen not found in $BUILD" >&2
+  exit 1
+}
+[ "$(id -u)" -eq 0 ] || { echo "Must be run as root" >&2; exit 1; }
+
+WORK=$(mktemp -d /tmp/arpwatch-saturation.XXXXXX)
+DAEMON_PID=""
+GEN_ARGS=()
+[ -n "$PROFILE" ] && GEN_ARGS=(-c "$(realpath "$PROFILE")")
+
+cleanup() {
+  stop_daemon
+  ip netns del $NS_DAEMON 2>/dev/null || true
+  ip netns del $NS_GEN 2>/dev/null || true
+  rm -rf "$WORK"
+}
+trap cleanup EXIT
+
+setup_rig() {
+  # Left over from a run that was killed
+  ip netns del $NS_DAEMON 2>/dev/null || true
+  ip netns del $NS_GEN 2>/dev/null || true
+
+  ip netns add $NS_DAEMON
+  ip netns add $NS_GEN
+  ip link add $DEV_DAEMON netns $NS_DAEMON type veth \
+    peer name $DEV_GEN netns $NS_GEN
+  ip -n $NS_DAEMON link set lo up
+  ip -n $NS_DAEMON addr add 10.0.255.254/16 dev $DEV_DAEMON
+  ip -n $NS_DAEMON link set $DEV_DAEMON up
+  ip -n $NS_GEN link set $DEV_GEN up
+}
+
+write_config() {
+  # $1 is arp_requests
+  cat > "$WORK/arpwatch.conf" <<CONF
+sink = "$SINK";
+sqlite_database = "$WORK/arpwatch.db";
+journal_dir = "$WORK";
+location = "saturation";
+mysql_loop_delay = 1;
+metrics_port = $PORT;
+metrics_address = "127.0.0.1";
+
+interfaces = (
+  {
+    device = "$DEV_DAEMON";
+    label = "saturation";
+    arp_requests = $1;
+    arp_max_pps = $SCAN_PPS;
+    arp_loop_delay = 1;
+    arp_fresh_time = 0;
+    arp_backoff = 0;
+    networks = (
+      {
+        ipaddress = "10.0.0.0";
+        subnet = "255.255.0.0";
+        ipaddress_source = "10.0.255.254";
+      }
+    )
+  }
+);
+CONF
+}
+
+start_daemon() {
+  write_config "$1"
+  ip netns exec $NS_DAEMON "$ARPWATCH" -c "$WORK/arpwatch.conf" \
+    >> "$WORK/arpwatch.log" 2>&1 &
+  DAEMON_PID=$!
+  for _ in $(seq 50); do
+    metrics > /dev/null 2>&1 && return
+    sleep 0.2
+  done
+  echo "arpwatch did not start, see the log:" >&2
+  cat "$WORK/arpwatch.log" >&2
+  exit 1
+}
+
+stop_daemon() {
+  if [ -n "$DAEMON_PID" ]; then
+    kill -TERM "$DAEMON_PID" 2>/dev/null || true
+    wait "$DAEMON_PID" 2>/dev/null || true
+    DAEMON_PID=""
+  fi
+}
+
+metrics() {
+  ip netns exec $NS_DAEMON \
+    curl -sf "http://127.0.0.1:$PORT/metrics" > "$WORK/metrics"
+}
+
+metric() {
+  # Sum of a metric over all its labels
+  awk -v name="arpwatch_$1" '$1 == name || index($1, name "{") == 1 \
+    { sum += $2 } END { printf "%d\n", sum }' "$WORK/metrics"
+}
+
+ns_counter() {
+  ip netns exec "$1" cat "/sys/class/net/$2/statistics/$3"
+}
+
+base_rate() {
+  # Frames per second of the profile at a scale of 1
+  local out
+  out=$("$GEN" ${GEN_ARGS[@]+"${GEN_ARGS[@]}"} -d 10 \
+        -o "$WORK/base.pcap" 2>&1)
+  echo "$out" | awk '/^Wrote/ { printf "%.0f\n", $2 / 10 }'
+}
+
+ramp() {
+  local base rate scale
+  local tx0 tx1 cap0 cap1 drop0 drop1 over0 over1 rx_drop0 rx_drop1
+  local offered captured drops overruns used size used_pct verdict
+
+  base=$(base_rate)
+  echo "Profile rate at scale 1 is $base pps"
+  echo
+  printf "%10s %10s %10s %10s %10s %10s %8s  %s\n" "target" "offered" \
+    "captured" "k_drops" "if_drops" "overruns" "unflushed" "result"
+
+  rate=$START
+  SUSTAINED=0
+  REASON="reached the maximum rate of $MAX pps"
+  while awk -v r="$rate" -v m="$MAX" 'BEGIN { exit !(r <= m) }'; do
+    scale=$(awk -v r="$rate" -v b="$base" 'BEGIN { printf "%.6f", r / b }')
+
+    metrics
+    cap0=$(metric packets_total)
+    drop0=$(metric kernel_drops_total)
+    over0=$(metric ring_overruns_total)
+    tx0=$(ns_counter $NS_GEN $DEV_GEN tx_packets)
+    rx_drop0=$(ns_counter $NS_DAEMON $DEV_DAEMON rx_dropped)
+
+    ip netns exec $NS_GEN "$GEN" ${GEN_ARGS[@]+"${GEN_ARGS[@]}"} -s "$rate" \
+      -d "$(awk -v s="$STEP" -v k="$scale" 'BEGIN { print s * k }')" \
+      -i $DEV_GEN -t "$scale" 2> /dev/null || true
+    sleep "$SETTLE"
+
+    metrics
+    cap1=$(metric packets_total)
+    drop1=$(metric kernel_drops_total)
+    over1=$(metric ring_overruns_total)
+    used=$(metric ring_used)
+    size=$(metric ring_size)
+    tx1=$(ns_counter $NS_GEN $DEV_GEN tx_packets)
+    rx_drop1=$(ns_counter $NS_DAEMON $DEV_DAEMON rx_dropped)
+
+    offered=$(( (tx1 - tx0) / STEP ))
+    captured=$(( (cap1 - cap0) / STEP ))
+    drops=$(( drop1 - drop0 ))
+    overruns=$(( over1 - over0 ))
+    used_pct=$(( size ? used * 100 / size : 0 ))
+
+    verdict=ok
+    if [ "$drops" -gt 0 ] || [ $(( rx_drop1 - rx_drop0 )) -gt 0 ]; then
+      verdict="kernel drops"
+    elif [ "$overruns" -gt 0 ]; then
+      verdict="ring overruns"
+    elif [ "$used_pct" -ge "$LAG" ]; then
+      verdict="flush lag"
+    elif [ $(( offered * 10 )) -lt $(( ${rate%.*} * 9 )) ]; then
+      verdict="generator limited"
+    fi
+
+    printf "%10.0f %10d %10d %10d %10d %10d %7d%%  %s\n" "$rate" \
+      "$offered" "$captured" "$drops" $(( rx_drop1 - rx_drop0 )) \
+      "$overruns" "$used_pct" "$verdict"
+
+    if [ "$verdict" != ok ]; then
+      REASON="$verdict at $offered pps"
+      break
+    fi
+    SUSTAINED=$offered
+    rate=$(awk -v r="$rate" -v f="$FACTOR" 'BEGIN { printf "%.0f", r * f }')
+  done
+}
+
+scan() {
+  # Nobody answers, so without the back-off every address is probed
+  # each sweep. Time the first full sweep from when metrics are up.
+  local rx0 rx1 sent0 sent1 t0 t1 start
+
+  metrics
+  sent0=$(metric probes_sent_total)
+  rx0=$(ns_counter $NS_GEN $DEV_GEN rx_packets)
+  t0=$(date +%s.%N)
+  sent1=$sent0
+  start=$SECONDS
+  while [ "$sent1" -lt "$SCAN_HOSTS" ]; do
+    if [ $(( SECONDS - start )) -ge "$SCAN_LIMIT" ]; then
+      echo "ARP sweep not finished after $SCAN_LIMIT s" >&2
+      break
+    fi
+    sleep 0.1
+    metrics
+    sent1=$(metric probes_sent_total)
+  done
+  t1=$(date +%s.%N)
+  rx1=$(ns_counter $NS_GEN $DEV_GEN rx_packets)
+
+  SCAN_SENT=$(awk -v n=$(( sent1 - sent0 )) -v t0="$t0" -v t1="$t1" \
+              'BEGIN { printf "%.0f\n", n / (t1 - t0) }')
+  SCAN_SEEN=$(awk -v n=$(( rx1 - rx0 )) -v t0="$t0" -v t1="$t1" \
+              'BEGIN { printf "%.0f\n", n / (t1 - t0) }')
+}
+
+setup_rig
+
+start_daemon false
+ramp
+stop_daemon
+
+start_daemon true
+scan
+stop_daemon
+
+echo
+echo "Maximum sustained rate : $SUSTAINED pps ($REASON)"
+echo "ARP scan               : $SCAN_SENT requests/s sent, $SCAN_SEEN pps" \
+  "received (limit $SCAN_PPS)"
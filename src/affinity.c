@@ -0,0 +1,189 @@
+//
+//  arptools
+//
+//  Stuart B. Wilkins, Brookhaven National Laboratory
+//
+//
+//  BSD 3-Clause License
+//
+//  Copyright (c) 2021, Brookhaven Science Associates
+//  All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without
+//  modification, are permitted provided that the following conditions are met:
+//
+//  1. Redistributions of source code must retain the above copyright notice,
+//     this list of conditions and the following disclaimer.
+//
+//  2. Redistributions in binary form must reproduce the above copyright notice,
+//     this list of conditions and the following disclaimer in the documentation
+//     and/or other materials provided with the distribution.
+//
+//  3. Neither the name of the copyright holder nor the names of its
+//     contributors may be used to endorse or promote products derived from
+//     this software without specific prior written permission.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+//  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+//  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+//  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+//  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+//  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+//  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+//  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+//  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+//  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+//  THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+#define _GNU_SOURCE  // For CPU_SET() and pthread_setaffinity_np()
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <errno.h>
+#include <sched.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include "affinity.h"
+#include "debug.h"
+
+static cpu_set_t affinity_saved;
+
+int affinity_numa_node(const char *device) {
+  char path[PATH_MAX];
+  int node = -1;
+
+  snprintf(path, sizeof(path), "%s/%s/device/numa_node",
+           AFFINITY_SYSFS_NET, device);
+
+  FILE *fp = fopen(path, "r");
+  if (!fp) {
+    return -1;
+  }
+
+  if (fscanf(fp, "%d", &node) != 1) {
+    node = -1;
+  }
+  fclose(fp);
+
+  return node;
+}
+
+static int affinity_node_cpus(int node, cpu_set_t *set) {
+  // Parse a cpulist such as "0-7,16-23"
+
+  char path[PATH_MAX];
+  snprintf(path, sizeof(path), "%s/node%d/cpulist",
+           AFFINITY_SYSFS_NODE, node);
+
+  FILE *fp = fopen(path, "r");
+  if (!fp) {
+    return -1;
+  }
+
+  CPU_ZERO(set);
+  int first, last;
+  char sep;
+  int n;
+  while ((n = fscanf(fp, "%d%c", &first, &sep)) >= 1) {
+    last = first;
+    if ((n == 2) && (sep == '-')) {
+      if (fscanf(fp, "%d%c", &last, &sep) < 1) {
+        break;
+      }
+    }
+    for (int cpu = first; (cpu <= last) && (cpu < CPU_SETSIZE); cpu++) {
+      CPU_SET(cpu, set);
+    }
+    if ((n < 2) || (sep != ',')) {
+      break;
+    }
+  }
+  fclose(fp);
+
+  return CPU_COUNT(set) ? 0 : -1;
+}
+
+int affinity_set(const char *device, const char *name, int cpu,
+                 int numa) {
+  cpu_set_t set;
+
+  if (cpu != AFFINITY_CPU_NONE) {
+    if ((cpu < 0) || (cpu >= CPU_SETSIZE)) {
+      ERROR_PRINT("%s : Invalid CPU %d for %s thread\n",
+                  device, cpu, name);
+      return -1;
+    }
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+  } else if (numa) {
+    int node = affinity_numa_node(device);
+    if (node < 0) {
+      DEBUG_PRINT("%s : No NUMA node for device\n", device);
+      return 0;
+    }
+    if (affinity_node_cpus(node, &set)) {
+      ERROR_PRINT("%s : Unable to read CPUs of NUMA node %d\n",
+                  device, node);
+      return -1;
+    }
+  } else {
+    return 0;
+  }
+
+  int err = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+  if (err) {
+    ERROR_PRINT("%s : Unable to set CPU affinity of %s thread : %s\n",
+                device, name, strerror(err));
+    return -1;
+  }
+
+  DEBUG_PRINT("%s : %s thread on %d CPUs\n", device, name,
+              CPU_COUNT(&set));
+  return 0;
+}
+
+int affinity_priority(const char *device, const char *name,
+                      int priority) {
+  if (!priority) {
+    return 0;
+  }
+
+  struct sched_param param;
+  memset(&param, 0, sizeof(param));
+  param.sched_priority = priority;
+
+  int err = pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
+  if (err) {
+    ERROR_PRINT("%s : Unable to run %s thread at SCHED_FIFO "
+                "priority %d : %s\n", device, name, priority,
+                strerror(err));
+    return -1;
+  }
+
+  return 0;
+}
+
+int affinity_save(void) {
+  return pthread_getaffinity_np(pthread_self(), sizeof(cpu_set_t),
+                                &affinity_saved) ? -1 : 0;
+}
+
+int affinity_restore(void) {
+  return pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t),
+                                &affinity_saved) ? -1 : 0;
+}
+
+void affinity_touch(void *addr, size_t len) {
+  long page = sysconf(_SC_PAGESIZE);
+  if (page <= 0) {
+    page = 4096;
+  }
+
+  volatile char *p = addr;
+  for (size_t i = 0; i < len; i += page) {
+    p[i] = 0;
+  }
+}
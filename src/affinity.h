@@ -0,0 +1,83 @@
+//
+//  arptools
+//
+//  Stuart B. Wilkins, Brookhaven National Laboratory
+//
+//
+//  BSD 3-Clause License
+//
+//  Copyright (c) 2021, Brookhaven Science Associates
+//  All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without
+//  modification, are permitted provided that the following conditions are met:
+//
+//  1. Redistributions of source code must retain the above copyright notice,
+//     this list of conditions and the following disclaimer.
+//
+//  2. Redistributions in binary form must reproduce the above copyright notice,
+//     this list of conditions and the following disclaimer in the documentation
+//     and/or other materials provided with the distribution.
+//
+//  3. Neither the name of the copyright holder nor the names of its
+//     contributors may be used to endorse or promote products derived from
+//     this software without specific prior written permission.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+//  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+//  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+//  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+//  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+//  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+//  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+//  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+//  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+//  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+//  THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+#ifndef SRC_AFFINITY_H_
+#define SRC_AFFINITY_H_
+
+#include <stddef.h>
+
+/* Macro Definitions */
+
+#define AFFINITY_CPU_NONE        -1
+#define AFFINITY_SYSFS_NET       "/sys/class/net"
+#define AFFINITY_SYSFS_NODE      "/sys/devices/system/node"
+
+/* AFFINITY Functions */
+
+int affinity_numa_node(const char *device);
+/*
+ * Return the NUMA node of the NIC behind device, or -1 if it is not
+ * known (virtual devices, single node systems).
+ */
+int affinity_set(const char *device, const char *name, int cpu,
+                 int numa);
+/*
+ * Restrict the calling thread to cpu, or if cpu is AFFINITY_CPU_NONE
+ * and numa is set, to the CPUs of the NUMA node of device. name is
+ * the thread used in log messages. Does nothing if neither is set.
+ * Returns 0 on success or -1 on error.
+ */
+int affinity_priority(const char *device, const char *name,
+                      int priority);
+/*
+ * Run the calling thread under SCHED_FIFO at priority. Does nothing
+ * if priority is 0. Returns 0 on success or -1 on error.
+ */
+int affinity_save(void);
+int affinity_restore(void);
+/*
+ * Save and restore the CPU mask of the calling thread, so that
+ * threads created after pinning do not inherit the pinning.
+ */
+void affinity_touch(void *addr, size_t len);
+/*
+ * Write to every page of addr so it is backed by memory on the
+ * NUMA node of the calling thread (first touch placement).
+ */
+
+#endif  // SRC_AFFINITY_H_
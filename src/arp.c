@@ -36,169 +36,737 @@
 //  THE POSSIBILITY OF SUCH DAMAGE.
 //
 
-#include <libnet.h>
+#define _GNU_SOURCE  // For sendmmsg()
+#include <stdio.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <errno.h>
+#include <time.h>
+#include <sys/socket.h>
+#include <sys/ioctl.h>
+#include <net/if.h>
+#include <net/if_arp.h>
+#include <netinet/in.h>
+#include <netinet/if_ether.h>
+#include <netpacket/packet.h>
 #include "debug.h"
 #include "utils.h"
+#include "affinity.h"
 #include "arp.h"
 #include "arpwatch.h"
 
 uint8_t hw_bcast[] = {0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF};
 
-int arp_send(arpwatch_params *params) {
-  struct libnet_ether_addr* hw_addr = NULL;
-  libnet_t *l;
-  char errbuf[LIBNET_ERRBUF_SIZE];
+static pthread_mutex_t arp_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t arp_cond = PTHREAD_COND_INITIALIZER;
+static int arp_running = 1;
 
-  int rtn = -1;
+int arp_wait(int64_t usec) {
+  struct timespec ts;
+  clock_gettime(CLOCK_REALTIME, &ts);
+  ts.tv_sec += usec / 1000000;
+  ts.tv_nsec += (usec % 1000000) * 1000;
+  if (ts.tv_nsec >= 1000000000) {
+    ts.tv_sec++;
+    ts.tv_nsec -= 1000000000;
+  }
+
+  pthread_mutex_lock(&arp_mutex);
+  while (arp_running && usec) {
+    if (pthread_cond_timedwait(&arp_cond, &arp_mutex, &ts) == ETIMEDOUT) {
+      break;
+    }
+  }
+  int stopped = !arp_running;
+  pthread_mutex_unlock(&arp_mutex);
+
+  return stopped;
+}
+
+int arp_open(arpwatch_params *params, uint32_t *ip_addr) {
+  struct ifreq ifr;
+  struct sockaddr_ll sll;
 
-  if ((l = libnet_init(LIBNET_LINK_ADV,
-                       params->device,
-                       errbuf)) == NULL) {
-    ERROR_COMMENT("Unable to initialize libnet\n");
+  // Protocol 0, this socket is only used to send
+
+  int fd = socket(AF_PACKET, SOCK_RAW, 0);
+  if (fd < 0) {
+    ERROR_PRINT("%s : Unable to open packet socket (%s)\n",
+                params->device, strerror(errno));
     return -1;
   }
 
-  // Get hardware (MAC) address
+  memset(&ifr, 0, sizeof(ifr));
+  strncpy(ifr.ifr_name, params->device, IFNAMSIZ - 1);
 
-  if ((hw_addr = libnet_get_hwaddr(l)) == NULL) {
-    ERROR_COMMENT("Unable to read HW address.\n");
+  // Get link type
+
+  if (ioctl(fd, SIOCGIFHWADDR, &ifr) < 0) {
+    ERROR_PRINT("%s : Unable to read HW address (%s)\n",
+                params->device, strerror(errno));
     goto _error;
   }
 
-  DEBUG_PRINT("Interface HW Address %s\n",
-              int_to_mac((unsigned char*)hw_addr));
+  if (ifr.ifr_hwaddr.sa_family != ARPHRD_ETHER) {
+    ERROR_PRINT("%s : Unsupported link type %d\n", params->device,
+                ifr.ifr_hwaddr.sa_family);
+    goto _error;
+  }
 
-  // Get link type
+  // Get the interface IP address, networks without an
+  // ipaddress_source need this
 
-  u_short hrd;
-  switch (l->link_type) {
-    case 1: /* DLT_EN10MB */
-      hrd = ARPHRD_ETHER;
-      DEBUG_COMMENT("Link type ETHER\n");
-      break;
-    case 6: /* DLT_IEEE802 */
-      DEBUG_COMMENT("Link type IEEE802\n");
-      hrd = ARPHRD_IEEE802;
-      break;
-    default:
-      DEBUG_COMMENT("Unsupported link type\n");
-      goto _error;
+  *ip_addr = 0;
+  if (ioctl(fd, SIOCGIFADDR, &ifr) == 0) {
+    *ip_addr = ((struct sockaddr_in *)&ifr.ifr_addr)->sin_addr.s_addr;
+  } else {
+    DEBUG_PRINT("%s : No interface IP address\n", params->device);
+  }
+
+  if (ioctl(fd, SIOCGIFINDEX, &ifr) < 0) {
+    ERROR_PRINT("%s : Unable to read interface index (%s)\n",
+                params->device, strerror(errno));
+    goto _error;
+  }
+
+  memset(&sll, 0, sizeof(sll));
+  sll.sll_family = AF_PACKET;
+  sll.sll_ifindex = ifr.ifr_ifindex;
+  sll.sll_protocol = 0;
+
+  if (bind(fd, (struct sockaddr *)&sll, sizeof(sll)) < 0) {
+    ERROR_PRINT("%s : Unable to bind packet socket (%s)\n",
+                params->device, strerror(errno));
+    goto _error;
+  }
+
+  char hw_addr[UTILS_MAC_STRLEN];
+  DEBUG_PRINT("%s : Opened packet socket, HW Address %s\n",
+              params->device, int_to_mac(hw_addr, params->hwaddress));
+
+  return fd;
+
+_error:
+  close(fd);
+  return -1;
+}
+
+void arp_build_template(arp_template *t, unsigned char *hw_addr,
+                        arpwatch_network *network, uint32_t ip_addr) {
+  unsigned char *p = t->frame;
+
+  memset(t, 0, sizeof(arp_template));
+
+  // Ethernet (or 802.1Q) header
+
+  memcpy(p, hw_bcast, ETH_ALEN);
+  p += ETH_ALEN;
+  memcpy(p, hw_addr, ETH_ALEN);
+  p += ETH_ALEN;
+
+  if (network->vlan) {
+    uint16_t tpid = htons(ETHERTYPE_VLAN);
+    uint16_t tci = htons(((network->vlan_pri & 0x7) << 13) |
+                         ((network->vlan_dei & 0x1) << 12) |
+                         (network->vlan & 0xFFF));
+    memcpy(p, &tpid, sizeof(tpid));
+    p += sizeof(tpid);
+    memcpy(p, &tci, sizeof(tci));
+    p += sizeof(tci);
   }
 
-  // Now loop over possible networks
+  uint16_t type = htons(ETHERTYPE_ARP);
+  memcpy(p, &type, sizeof(type));
+  p += sizeof(type);
 
-  for (int net = 0; net < params->num_network; net++) {
-    uint32_t ip_addr;
-    libnet_ptag_t arpt = 0;
-    libnet_ptag_t ethert = 0;
+  // ARP request, the target IP is filled in per probe
 
-    // Clear the packet info (just incase we change from
-    // Tagged to Untagged
+  struct ether_arp arp;
+  arp.arp_hrd = htons(ARPHRD_ETHER);
+  arp.arp_pro = htons(ETHERTYPE_IP);
+  arp.arp_hln = ETH_ALEN;
+  arp.arp_pln = sizeof(ip_addr);
+  arp.arp_op = htons(ARPOP_REQUEST);
+  memcpy(arp.arp_sha, hw_addr, ETH_ALEN);
+  memcpy(arp.arp_spa, &ip_addr, sizeof(ip_addr));
+  memcpy(arp.arp_tha, hw_bcast, ETH_ALEN);
+  memset(arp.arp_tpa, 0, sizeof(arp.arp_tpa));
 
-    libnet_clear_packet(l);
+  memcpy(p, &arp, sizeof(arp));
+  t->tip = (p - t->frame) + offsetof(struct ether_arp, arp_tpa);
+  p += sizeof(arp);
 
-    // Set the IP Address from either
-    // interface or config file
+  // Pad to the minimum ethernet frame size
 
-    if (!params->network[net].ipaddress_source) {
-      ip_addr = libnet_get_ipaddr4(l);
-      DEBUG_COMMENT("Using interface IP address\n");
-    } else {
-      ip_addr = params->network[net].ipaddress_source;
-      DEBUG_COMMENT("Using ipaddress_source for IP address\n");
+  t->len = p - t->frame;
+  if (t->len < ARP_FRAME_MIN) {
+    t->len = ARP_FRAME_MIN;
+  }
+}
+
+int arp_send_batch(int fd, struct mmsghdr *msg, int num) {
+  int sent = 0;
+
+  while (sent < num) {
+    int rtn = sendmmsg(fd, msg + sent, num - sent, 0);
+    if (rtn < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      ERROR_PRINT("Write error: %s\n", strerror(errno));
+      return -1;
     }
-    // Now calculate subnet mask
-    uint32_t _subnet = ntohl(params->network[net].subnet);
-    uint32_t _ip_probe = ntohl(params->network[net].ipaddress);
+    sent += rtn;
+  }
+
+  return 0;
+}
 
-#ifdef DEBUG
-    if (params->network[net].vlan) {
-      DEBUG_PRINT("VLAN : %d PRI : %d DEI : %d\n",
-                  params->network[net].vlan,
-                  params->network[net].vlan_pri,
-                  params->network[net].vlan_dei);
+static int64_t arp_now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static uint64_t arp_mix(uint64_t x) {
+  // splitmix64 finalizer
+  x ^= x >> 30;
+  x *= 0xbf58476d1ce4e5b9ULL;
+  x ^= x >> 27;
+  x *= 0x94d049bb133111ebULL;
+  x ^= x >> 31;
+  return x;
+}
+
+uint32_t arp_permute(arp_scan_network *sn, uint32_t idx) {
+  //
+  // Balanced Feistel network over the smallest even number of bits
+  // covering num_hosts. It is a bijection on [0, 2^bits), so cycle
+  // walking until the result falls inside [0, num_hosts) gives a
+  // permutation of the hosts. The domain is less than 4 * num_hosts
+  // so this takes a few rounds at most on average.
+  //
+
+  uint32_t mask = (1U << sn->half_bits) - 1;
+
+  do {
+    uint32_t l = idx >> sn->half_bits;
+    uint32_t r = idx & mask;
+    for (int round = 0; round < ARP_FEISTEL_ROUNDS; round++) {
+      uint32_t f = arp_mix(sn->key ^ ((uint64_t)round << 32) ^ r) & mask;
+      uint32_t t = l ^ f;
+      l = r;
+      r = t;
     }
-#endif
+    idx = (l << sn->half_bits) | r;
+  } while (idx >= sn->num_hosts);
+
+  return idx;
+}
+
+static int arp_scan_filename(arpwatch_params *params, char *filename,
+                             size_t len, const char *ext) {
+  int n = snprintf(filename, len, "%s/arpwatch-%s.scan%s",
+                   params->journal_dir, params->device, ext);
+  return ((n < 0) || ((size_t)n >= len)) ? -1 : 0;
+}
+
+// Checkpoints are written every ARP_CHECKPOINT_INTERVAL, only log
+// the first of a run of failures
+
+static __thread int arp_save_failed = 0;
+
+int arp_scan_save(arp_scan *scan, arpwatch_params *params) {
+  char filename[ARPWATCH_MAX_FILENAME];
+  char tmpname[ARPWATCH_MAX_FILENAME];
+
+  if (!*params->journal_dir) {
+    return 0;
+  }
+
+  if (arp_scan_filename(params, filename, sizeof(filename), "") ||
+      arp_scan_filename(params, tmpname, sizeof(tmpname), ".tmp")) {
+    if (!arp_save_failed) {
+      ERROR_PRINT("%s : Checkpoint filename too long\n", params->device);
+    }
+    arp_save_failed = 1;
+    return -1;
+  }
+
+  FILE *fp = fopen(tmpname, "w");
+  if (!fp) {
+    if (!arp_save_failed) {
+      ERROR_PRINT("%s : Unable to open %s (%s)\n", params->device,
+                  tmpname, strerror(errno));
+    }
+    arp_save_failed = 1;
+    return -1;
+  }
+
+  // One line per network : base num_hosts key cursor
+
+  fprintf(fp, "%s %d\n", ARP_SCAN_MAGIC, scan->num_net);
+  for (int i = 0; i < scan->num_net; i++) {
+    fprintf(fp, "%u %u %llu %u\n", scan->net[i].base,
+            scan->net[i].num_hosts,
+            (unsigned long long)scan->net[i].key, scan->net[i].next);
+  }
+
+  if (fclose(fp) || rename(tmpname, filename)) {
+    if (!arp_save_failed) {
+      ERROR_PRINT("%s : Unable to write %s (%s)\n", params->device,
+                  filename, strerror(errno));
+    }
+    arp_save_failed = 1;
+    unlink(tmpname);
+    return -1;
+  }
+
+  arp_save_failed = 0;
+  return 0;
+}
+
+int arp_scan_load(arp_scan *scan, arpwatch_params *params) {
+  char filename[ARPWATCH_MAX_FILENAME];
+  char magic[64];
+  int num_net;
+  int resumed = 0;
+
+  if (!*params->journal_dir ||
+      arp_scan_filename(params, filename, sizeof(filename), "")) {
+    return 0;
+  }
+
+  FILE *fp = fopen(filename, "r");
+  if (!fp) {
+    return 0;
+  }
+
+  if ((fscanf(fp, "%63s %d", magic, &num_net) != 2) ||
+      strcmp(magic, ARP_SCAN_MAGIC)) {
+    ERROR_PRINT("%s : Invalid scan checkpoint %s\n", params->device,
+                filename);
+    fclose(fp);
+    return -1;
+  }
+
+  //
+  // Resume any network which has not changed since the
+  // checkpoint was written
+  //
+
+  for (int i = 0; i < num_net; i++) {
+    unsigned int base, num_hosts, next;
+    unsigned long long key;
+    if (fscanf(fp, "%u %u %llu %u", &base, &num_hosts, &key, &next) != 4) {
+      break;
+    }
+
+    for (int j = 0; j < scan->num_net; j++) {
+      arp_scan_network *sn = &scan->net[j];
+      if ((sn->base == base) && (sn->num_hosts == num_hosts) &&
+          (!key == !sn->key) && (next <= num_hosts) && !sn->next) {
+        sn->key = key;
+        sn->next = next;
+        scan->remaining -= next;
+        resumed++;
+        break;
+      }
+    }
+  }
+
+  fclose(fp);
+
+  NOTICE_PRINT("%s : Resumed ARP sweep of %d networks from %s\n",
+               params->device, resumed, filename);
+
+  return resumed;
+}
+
+void arp_scan_done(arpwatch_params *params) {
+  char filename[ARPWATCH_MAX_FILENAME];
+
+  if (*params->journal_dir &&
+      !arp_scan_filename(params, filename, sizeof(filename), "")) {
+    unlink(filename);
+  }
+}
+
+int arp_scan_init(arp_scan *scan, arpwatch_params *params,
+                  uint32_t if_addr, int refresh) {
+  memset(scan, 0, sizeof(arp_scan));
+
+  // Take a copy of the networks as they can be replaced
+  // by a config reload
+
+  pthread_mutex_lock(&params->config_mutex);
+  int num_network = params->num_network;
+  int arp_delay = params->arp_delay;
+  int arp_max_pps = params->arp_max_pps;
+  int arp_loop_delay = params->arp_loop_delay;
+  int order = params->arp_scan_order;
+  scan->fresh_time = params->arp_fresh_time;
+  scan->backoff = params->arp_backoff;
+  scan->net = (arp_scan_network *)
+    calloc(num_network ? num_network : 1, sizeof(arp_scan_network));
+  if (scan->net) {
+    for (int net = 0; net < num_network; net++) {
+      arpwatch_network *network = &params->network[net];
+      arp_scan_network *sn = &scan->net[net];
+
+      // Set the IP Address from either
+      // interface or config file
+
+      uint32_t ip_addr = network->ipaddress_source;
+      if (!ip_addr) {
+        ip_addr = if_addr;
+      }
+
+      arp_build_template(&sn->t, params->hwaddress, network, ip_addr);
+      sn->hosts = network->hosts;
+      sn->vlan = network->vlan ? network->vlan : params->native_vlan;
 
-    // Loop over all addresses in subnet
-    for (uint32_t hostid=1; hostid < (~_subnet); hostid++) {
-      uint32_t ip = htonl(_ip_probe + hostid);
+      // Every address in the subnet except the network
+      // and broadcast address
 
-#ifdef DEBUG
-      struct in_addr _ip;
-      _ip.s_addr = ip;
-      DEBUG_PRINT("Probing : %s\n", inet_ntoa(_ip));
-#endif
+      uint32_t _subnet = ntohl(network->subnet);
+      sn->base = (ntohl(network->ipaddress) & _subnet) + 1;
+      sn->num_hosts = (~_subnet) > 1 ? (~_subnet) - 1 : 0;
+      scan->total += sn->num_hosts;
 
-      if ((arpt = libnet_build_arp(hrd, ETHERTYPE_IP, 6, 4,
-                                  ARPOP_REQUEST,
-                                  (uint8_t*)hw_addr,
-                                  (uint8_t*)&ip_addr,
-                                  hw_bcast, (uint8_t*)(&ip),
-                                  NULL, 0, l, arpt)) == -1) {
-        ERROR_PRINT("Can't build ARP header: %s\n", libnet_geterror(l));
-        goto _error;
+      // A new permutation for every sweep
+
+      if (order == ARPWATCH_SCAN_RANDOM) {
+        int bits = 2;
+        while ((bits < 32) && ((1ULL << bits) < sn->num_hosts)) {
+          bits += 2;
+        }
+        sn->half_bits = bits / 2;
+        sn->key = arp_mix(arp_now() ^ ((uint64_t)getpid() << 32) ^ net);
+        sn->key |= 1;
       }
+    }
+  }
+  pthread_mutex_unlock(&params->config_mutex);
+
+  if (!scan->net) {
+    ERROR_COMMENT("Unable to allocate memory for networks\n");
+    return -1;
+  }
+
+  scan->num_net = num_network;
+  scan->remaining = scan->total;
+  scan->now = time(NULL);
+  scan->probes = &params->probes;
+  scan->refresh = refresh;
+
+  // Pick up a discovery sweep interrupted by a restart
+
+  if (!refresh) {
+    arp_scan_load(scan, params);
+  }
+
+  //
+  // Spread the sweep over arp_loop_delay, limited to arp_max_pps
+  // (or one request per arp_delay if not set). A rate of 0 sends
+  // as fast as possible.
+  //
+
+  double max_pps = arp_max_pps;
+  if (!arp_max_pps && arp_delay) {
+    max_pps = 1e6 / arp_delay;
+  }
+
+  scan->rate = max_pps;
+  if (arp_loop_delay) {
+    double rate = (double)scan->total / arp_loop_delay;
+    if (!max_pps || (rate < max_pps)) {
+      scan->rate = rate;
+    }
+  }
+
+  scan->burst = ARP_BATCH_SIZE;
+  if (scan->rate > 0) {
+    scan->burst = scan->rate * ARP_BATCH_TIME / 1e6;
+    scan->burst = scan->burst < 1 ? 1 : scan->burst;
+    scan->burst = scan->burst > ARP_BATCH_SIZE ? ARP_BATCH_SIZE : scan->burst;
+  }
+
+  scan->tokens = scan->burst;
+  scan->last = arp_now();
+
+  DEBUG_PRINT("%s : Sweep of %lu addresses on %d networks at %.1f pps\n",
+              params->device, (unsigned long)scan->total, scan->num_net,
+              scan->rate);
+
+  return 0;
+}
+
+void arp_scan_free(arp_scan *scan) {
+  free(scan->net);
+  scan->net = NULL;
+}
+
+int arp_scan_next(arp_scan *scan, unsigned char *frame, size_t *len) {
+  // Round robin over the networks (and so VLANs) so
+  // they are probed in parallel
+
+  for (int i = 0; i < scan->num_net; i++) {
+    arp_scan_network *sn = &scan->net[scan->current];
+    scan->current = (scan->current + 1) % scan->num_net;
+
+    // Skip hosts which do not need probing this sweep
 
-      if (ethert == 0) {
-        if (params->network[net].vlan) {
-          if ((ethert = libnet_build_802_1q(hw_bcast, (uint8_t*)hw_addr,
-                                            ETHERTYPE_VLAN,    /* TPI */
-                                            params->network[net].vlan_pri,
-                                            params->network[net].vlan_dei,
-                                            params->network[net].vlan,
-                                            ETHERTYPE_ARP, NULL, 0, l,
-                                            ethert)) == -1) {
-            ERROR_PRINT("Can't build 802.1q header: %s\n", libnet_geterror(l));
-            goto _error;
-          }
-        } else {
-          if ((ethert = libnet_build_ethernet(hw_bcast, (uint8_t*)hw_addr,
-                                              ETHERTYPE_ARP, NULL, 0, l,
-                                              ethert)) == -1) {
-            ERROR_PRINT("Can't build ethernet header: %s\n",
-                        libnet_geterror(l));
-            goto _error;
-          }
+    uint32_t idx = sn->num_hosts;
+    uint64_t hw = 0;
+    while (sn->next < sn->num_hosts) {
+      idx = sn->key ? arp_permute(sn, sn->next) : sn->next;
+      sn->next++;
+      scan->remaining--;
+
+      // Refresh sweeps only probe hosts with a known hw address
+
+      if (scan->refresh) {
+        hw = sn->hosts ? hosts_hw_addr(sn->hosts, idx) : 0;
+        if (hw && hosts_should_probe(sn->hosts, idx, scan->now,
+                                     scan->fresh_time, scan->backoff)) {
+          break;
         }
+      } else if (!sn->hosts ||
+                 hosts_should_probe(sn->hosts, idx, scan->now,
+                                    scan->fresh_time, scan->backoff)) {
+        break;
       }
 
-      if (libnet_write(l) == -1) {
-        ERROR_PRINT("Write error: %s\n", libnet_geterror(l));
-        goto _error;
+      scan->skipped++;
+      idx = sn->num_hosts;
+    }
+
+    if (idx >= sn->num_hosts) {
+      continue;
+    }
+
+    uint32_t ip = htonl(sn->base + idx);
+
+    if (scan->probes) {
+      probe_add(scan->probes, ip, sn->vlan, sn->hosts, idx, probe_now());
+    }
+
+    memcpy(frame, sn->t.frame, sn->t.len);
+    memcpy(frame + sn->t.tip, &ip, sizeof(ip));
+    *len = sn->t.len;
+
+    // Unicast to the last known hw address
+
+    if (hw) {
+      for (int i = 0; i < ETH_ALEN; i++) {
+        frame[i] = hw >> (8 * (ETH_ALEN - 1 - i));
       }
+    }
+
+    return 0;
+  }
+
+  return -1;
+}
+
+int arp_send(arpwatch_params *params, int fd, uint32_t if_addr,
+             int refresh) {
+  unsigned char frame[ARP_BATCH_SIZE][ARP_FRAME_MAX];
+  struct iovec iov[ARP_BATCH_SIZE];
+  struct mmsghdr msg[ARP_BATCH_SIZE];
+  arp_scan scan;
 
-      // Now sleep
-      if (params->arp_delay != 0) {
-        usleep(params->arp_delay);
+  int rtn = -1;
+
+  if (arp_scan_init(&scan, params, if_addr, refresh)) {
+    return -1;
+  }
+
+  memset(msg, 0, sizeof(msg));
+  for (int i = 0; i < ARP_BATCH_SIZE; i++) {
+    iov[i].iov_base = frame[i];
+    msg[i].msg_hdr.msg_iov = &iov[i];
+    msg[i].msg_hdr.msg_iovlen = 1;
+  }
+
+  int64_t saved = arp_now();
+
+  while (scan.remaining) {
+    // Checkpoint the position so a restart resumes the sweep
+
+    if (!refresh && ((arp_now() - saved) > ARP_CHECKPOINT_INTERVAL)) {
+      arp_scan_save(&scan, params);
+      saved = arp_now();
+    }
+
+    int expired = probe_expire(&params->probes, probe_now(),
+                               params->arp_absent_sweeps, params->device);
+    METRICS_ADD(params->metrics, arp, probes_expired, expired);
+
+    // Refill the token bucket
+
+    int num = ARP_BATCH_SIZE;
+    if (scan.rate > 0) {
+      int64_t now = arp_now();
+      scan.tokens += (now - scan.last) * scan.rate / 1e6;
+      scan.tokens = scan.tokens > scan.burst ? scan.burst : scan.tokens;
+      scan.last = now;
+
+      if (scan.tokens < 1) {
+        if (arp_wait((int64_t)((1 - scan.tokens) * 1e6 / scan.rate) + 1)) {
+          goto _stopped;
+        }
+        continue;
       }
-    }  // Single subnet
-  }  // All subnets
 
+      num = (int)scan.tokens;
+    } else if (arp_wait(0)) {
+      goto _stopped;
+    }
+
+    int n;
+    for (n = 0; n < num; n++) {
+      if (arp_scan_next(&scan, frame[n], &iov[n].iov_len)) {
+        break;
+      }
+    }
+
+    if (arp_send_batch(fd, msg, n)) {
+      goto _error;
+    }
+    scan.tokens -= n;
+    METRICS_ADD(params->metrics, arp, probes_sent, n);
+  }
+
+  DEBUG_PRINT("%s : %s sweep of %lu addresses skipped %lu\n",
+              params->device, refresh ? "Refresh" : "Discovery",
+              (unsigned long)scan.total, (unsigned long)scan.skipped);
+
+  if (!refresh) {
+    arp_scan_done(params);
+  }
+  METRICS_ADD(params->metrics, arp, sweeps, 1);
   rtn = 0;
+  goto _error;
+
+_stopped:
+  DEBUG_COMMENT("Stopping ARP requests\n");
+  if (!refresh) {
+    arp_scan_save(&scan, params);
+  }
+  rtn = 1;
 
 _error:
-    libnet_destroy(l);
-    return rtn;
+  arp_scan_free(&scan);
+  return rtn;
 }
 
 void* arp_thread(void *ctx) {
   arpwatch_params *params = (arpwatch_params*)ctx;
+  uint32_t if_addr = 0;
+  int64_t discovery = 0;
+  int fd = -1;
+
+  affinity_set(params->device, "arp", params->arp_cpu,
+               params->numa_affinity);
 
   for (;;) {
-    for (int i = 0; i < params->num_network; i++) {
-      arp_send(params);
+    int64_t start = arp_now();
+
+    // Free the address state of networks removed by a config
+    // reload, the last sweep and its probes are done with it
+
+    pthread_mutex_lock(&params->config_mutex);
+    int freed = hosts_collect(&params->hosts);
+    pthread_mutex_unlock(&params->config_mutex);
+    if (freed) {
+      DEBUG_PRINT("%s : Freed state of %d removed networks\n",
+                  params->device, freed);
     }
 
-    DEBUG_PRINT("Waiting for %ds\n", params->arp_loop_delay);
-    sleep(params->arp_loop_delay);
+    // With arp_discovery_delay set, broadcast sweeps to find new
+    // hosts are only made every arp_discovery_delay. In between
+    // known hosts are refreshed with unicast requests.
+
+    int64_t discovery_period = (int64_t)params->arp_discovery_delay * 1000000;
+    int refresh = 0;
+    if (discovery_period && discovery &&
+        ((start - discovery) < discovery_period)) {
+      refresh = 1;
+    }
+
+    if (params->arp_requests) {
+      // Open the socket the first time it is needed
+      // and keep it for the life of the thread
+
+      if (fd < 0) {
+        fd = arp_open(params, &if_addr);
+      }
+
+      if (fd >= 0) {
+        int rtn = arp_send(params, fd, if_addr, refresh);
+        if (!refresh && !rtn) {
+          discovery = start;
+        }
+
+        if (rtn > 0) {
+          break;
+        } else if (rtn < 0) {
+          // Reopen in case the interface changed
+          close(fd);
+          fd = -1;
+        }
+
+        // Give the last probes time to be answered, waking when the
+        // next batch of them times out
+
+        int stopped = 0;
+        int64_t next;
+        while (!stopped && ((next = probe_next(&params->probes)) >= 0)) {
+          int64_t now = probe_now();
+          stopped = arp_wait(next > now ? next - now : 0);
+          int expired = probe_expire(&params->probes, probe_now(),
+                                     params->arp_absent_sweeps,
+                                     params->device);
+          METRICS_ADD(params->metrics, arp, probes_expired, expired);
+        }
+        if (stopped) {
+          break;
+        }
+        probe_report(&params->probes, params->device);
+      }
+    }
+
+    // The sweep is paced over arp_loop_delay, wait
+    // for whatever is left of the period
+
+    int64_t period = (int64_t)params->arp_loop_delay * 1000000;
+    int64_t elapsed = arp_now() - start;
+    if (params->arp_requests && (elapsed > period + 1000000)) {
+      NOTICE_PRINT("%s : ARP sweep took %lds, longer than arp_loop_delay "
+                   "(raise arp_max_pps)\n", params->device,
+                   (long)(elapsed / 1000000));
+    }
+
+    DEBUG_PRINT("Waiting for %lds\n", (long)((period - elapsed) / 1000000));
+    if (arp_wait(elapsed < period ? period - elapsed : 0)) {
+      break;
+    }
   }
+
+  if (fd >= 0) {
+    close(fd);
+  }
+
   return NULL;
 }
 
 int arp_setup(arpwatch_params *params) {
-  pthread_t threadId;
-  int err = pthread_create(&threadId, NULL,
+  int err = pthread_create(&params->arp_thread, NULL,
                            &arp_thread, (void *)params);
   if (err) {
     ERROR_COMMENT("Unable to create thread.");
@@ -206,3 +774,14 @@ int arp_setup(arpwatch_params *params) {
   }
   return 0;
 }
+
+void arp_stop(arpwatch_params *params, int num_params) {
+  pthread_mutex_lock(&arp_mutex);
+  arp_running = 0;
+  pthread_cond_broadcast(&arp_cond);
+  pthread_mutex_unlock(&arp_mutex);
+
+  for (int i = 0; i < num_params; i++) {
+    pthread_join(params[i].arp_thread, NULL);
+  }
+}
@@ -38,8 +38,125 @@
 #ifndef SRC_ARP_H_
 #define SRC_ARP_H_
 
+#include <stdint.h>
+
 #include "arpwatch.h"
+#include "hosts.h"
+#include "probe.h"
+
+/* Macro Definitions */
+
+#define ARP_FRAME_MIN            60      // Minimum ethernet frame, no FCS
+#define ARP_FRAME_MAX            64
+#define ARP_BATCH_SIZE           64      // Frames per sendmmsg()
+#define ARP_BATCH_TIME           10000   // Microseconds per batch
+#define ARP_FEISTEL_ROUNDS       4
+#define ARP_CHECKPOINT_INTERVAL  10000000  // Microseconds
+#define ARP_SCAN_MAGIC           "arpwatch-scan-1"
+
+typedef struct {
+  unsigned char frame[ARP_FRAME_MAX];
+  int len;
+  int tip;
+} arp_template;
+
+typedef struct {
+  arp_template t;
+  uint32_t base;                 // First host address (host order)
+  uint32_t num_hosts;
+  uint32_t next;                 // Index of the next host to probe
+  uint64_t key;                  // Permutation key, 0 for sequential
+  int half_bits;
+  hosts_network *hosts;          // Address state, NULL if not tracked
+  int vlan;
+} arp_scan_network;
+
+typedef struct {
+  arp_scan_network *net;
+  int num_net;
+  int current;                   // Round robin position
+  uint64_t total;
+  uint64_t remaining;
+  uint64_t skipped;
+  uint32_t now;                  // Start of the sweep
+  int fresh_time;
+  int backoff;
+  probe_table *probes;
+  int refresh;
+  double rate;                   // Requests per second, 0 for no limit
+  double burst;
+  double tokens;
+  int64_t last;                  // Time of last token refill (us)
+} arp_scan;
 
+int arp_open(arpwatch_params *params, uint32_t *ip_addr);
+/*
+ * Open a packet socket bound to params->device for sending ARP
+ * requests. The interface IPv4 address is returned in ip_addr (0 if
+ * it has none). Returns the socket or -1 on error.
+ */
+void arp_build_template(arp_template *t, unsigned char *hw_addr,
+                        arpwatch_network *network, uint32_t ip_addr);
+/*
+ * Build the ethernet (or 802.1Q) frame for an ARP request on network
+ * from hw_addr and ip_addr. Only the target IP at offset tip differs
+ * between requests.
+ */
+int arp_scan_init(arp_scan *scan, arpwatch_params *params,
+                  uint32_t if_addr, int refresh);
+/*
+ * Build the probe set for one sweep of all networks of params and
+ * set the token bucket rate so the sweep is spread over
+ * arp_loop_delay without exceeding arp_max_pps. A refresh sweep only
+ * probes hosts with a known hw address, using unicast requests.
+ */
+void arp_scan_free(arp_scan *scan);
+uint32_t arp_permute(arp_scan_network *sn, uint32_t idx);
+/*
+ * Map sweep position idx to a host index of sn using a keyed
+ * Feistel permutation with cycle walking, so each host is visited
+ * once per sweep in a pseudo-random order.
+ */
+int arp_scan_save(arp_scan *scan, arpwatch_params *params);
+/*
+ * Write the key and position of each network of the sweep to a
+ * checkpoint file in journal_dir.
+ */
+int arp_scan_load(arp_scan *scan, arpwatch_params *params);
+/*
+ * Restore the key and position of each network which matches the
+ * checkpoint file. Returns the number of networks resumed.
+ */
+void arp_scan_done(arpwatch_params *params);
+/*
+ * Remove the checkpoint file at the end of a complete sweep.
+ */
+int arp_scan_next(arp_scan *scan, unsigned char *frame, size_t *len);
+/*
+ * Fill frame with the next request of the sweep, taking networks in
+ * turn. Returns -1 when the sweep is complete.
+ */
+int arp_send(arpwatch_params *params, int fd, uint32_t if_addr,
+             int refresh);
+/*
+ * Send one paced sweep of ARP requests on the socket fd, in batches
+ * using sendmmsg(). if_addr is the source IP for networks without an
+ * ipaddress_source. Returns 1 if interrupted by arp_stop().
+ */
 int arp_setup(arpwatch_params *params);
+/*
+ * Start the thread sending ARP requests for params. The thread
+ * id is stored in params->arp_thread.
+ */
+void arp_stop(arpwatch_params *params, int num_params);
+/*
+ * Stop the ARP threads of num_params interfaces, interrupting any
+ * sweep in progress, and wait for them to exit.
+ */
+int arp_wait(int64_t usec);
+/*
+ * Sleep for usec microseconds or until arp_stop() is called.
+ * Returns non-zero if the ARP threads are stopping.
+ */
 
 #endif  // SRC_ARP_H_
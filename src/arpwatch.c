@@ -42,11 +42,19 @@
 #include <string.h>
 #include <unistd.h>
 #include <getopt.h>
+#include <signal.h>
+#include <pthread.h>
 #include <libconfig.h>
 #include <sys/wait.h>
+#include <sys/stat.h>
 
 #include "buffer.h"
-#include "mysql.h"
+#include "sink.h"
+#include "journal.h"
+#include "affinity.h"
+#include "log.h"
+#include "profile.h"
+#include "notify.h"
 #include "debug.h"
 #include "arp.h"
 #include "capture.h"
@@ -58,6 +66,14 @@ extern const char* ARPTOOLS_GIT_BRANCH;
 extern const char* ARPTOOLS_GIT_VERSION;
 
 int debug_flag = 0;
+volatile sig_atomic_t reload_flag = 0;
+volatile sig_atomic_t terminate_flag = 0;
+
+// Counters shared by all processes, exported by the parent
+static metrics_data arpwatch_metrics = {NULL, -1};
+
+// Readiness and watchdog, from the shared counters
+static notify_data arpwatch_notify;
 
 int read_global_config(arpwatch_params *params, const char *filename) {
   config_t cfg;
@@ -72,34 +88,58 @@ int read_global_config(arpwatch_params *params, const char *filename) {
     goto _error;
   }
 
+  if (config_lookup_string(&cfg, "sink", &str)) {
+    strncpy(params->sink, str, ARPWATCH_CONFIG_MAX_STRING);
+  } else {
+    strncpy(params->sink, ARPWATCH_SINK, ARPWATCH_CONFIG_MAX_STRING);
+  }
+
+  if (!sink_find(params->sink)) {
+    ERROR_PRINT("Sink %s is not available\n", params->sink);
+    goto _error;
+  }
+
+  //
+  // Server settings are only required by the mysql sink
+  //
+
+  int need_server = !strcmp(params->sink, "mysql");
+
   if (config_lookup_string(&cfg, "hostname", &str)) {
     strncpy(params->hostname, str, ARPWATCH_CONFIG_MAX_STRING);
-  } else {
+  } else if (need_server) {
     ERROR_COMMENT("No hostname defined in config file\n");
     goto _error;
   }
 
   if (config_lookup_string(&cfg, "username", &str)) {
     strncpy(params->username, str, ARPWATCH_CONFIG_MAX_STRING);
-  } else {
+  } else if (need_server) {
     ERROR_COMMENT("No username defined in config file\n");
     goto _error;
   }
 
   if (config_lookup_string(&cfg, "password", &str)) {
     strncpy(params->password, str, ARPWATCH_CONFIG_MAX_STRING);
-  } else {
+  } else if (need_server) {
     ERROR_COMMENT("No password defined in config file\n");
     goto _error;
   }
 
   if (config_lookup_string(&cfg, "database", &str)) {
     strncpy(params->database, str, ARPWATCH_CONFIG_MAX_STRING);
-  } else {
+  } else if (need_server) {
     ERROR_COMMENT("No database defined in config file\n");
     goto _error;
   }
 
+  if (config_lookup_string(&cfg, "sqlite_database", &str)) {
+    strncpy(params->sqlite_database, str, ARPWATCH_CONFIG_MAX_STRING);
+  } else {
+    strncpy(params->sqlite_database, ARPWATCH_SQLITE_DATABASE,
+            ARPWATCH_CONFIG_MAX_STRING);
+  }
+
   if (config_lookup_string(&cfg, "location", &str)) {
     strncpy(params->location, str, ARPWATCH_CONFIG_MAX_STRING);
   } else {
@@ -111,6 +151,28 @@ int read_global_config(arpwatch_params *params, const char *filename) {
     params->mysql_loop_delay = ARPWATCH_MYSQL_LOOP_DELAY;
   }
 
+  if (!config_lookup_int(&cfg, "last_seen_granularity",
+                         &params->last_seen_granularity)) {
+    params->last_seen_granularity = ARPWATCH_LAST_SEEN_GRANULARITY;
+  }
+
+  if (!config_lookup_int(&cfg, "registration_delay",
+                         &params->registration_delay)) {
+    params->registration_delay = ARPWATCH_REGISTRATION_DELAY;
+  }
+
+  if (!config_lookup_int(&cfg, "shutdown_timeout",
+                         &params->shutdown_timeout)) {
+    params->shutdown_timeout = ARPWATCH_SHUTDOWN_TIMEOUT;
+  }
+
+  if (config_lookup_string(&cfg, "journal_dir", &str)) {
+    strncpy(params->journal_dir, str, ARPWATCH_CONFIG_MAX_STRING);
+  } else {
+    strncpy(params->journal_dir, ARPWATCH_JOURNAL_DIR,
+            ARPWATCH_CONFIG_MAX_STRING);
+  }
+
   if (!config_lookup_int(&cfg, "pcap_timeout", &params->pcap_timeout)) {
     params->pcap_timeout = ARPWATCH_PCAP_TIMEOUT;
   }
@@ -119,6 +181,25 @@ int read_global_config(arpwatch_params *params, const char *filename) {
     params->buffer_size = ARPWATCH_BUFFER_SIZE;
   }
 
+  if (!config_lookup_bool(&cfg, "single_process", &params->single_process)) {
+    params->single_process = 0;
+  }
+
+  if (!config_lookup_int(&cfg, "metrics_port", &params->metrics_port)) {
+    params->metrics_port = ARPWATCH_METRICS_PORT;
+  }
+
+  if (config_lookup_string(&cfg, "metrics_address", &str)) {
+    strncpy(params->metrics_address, str, ARPWATCH_CONFIG_MAX_STRING);
+  } else {
+    strncpy(params->metrics_address, ARPWATCH_METRICS_ADDRESS,
+            ARPWATCH_CONFIG_MAX_STRING);
+  }
+
+  if (!config_lookup_int(&cfg, "stall_timeout", &params->stall_timeout)) {
+    params->stall_timeout = ARPWATCH_STALL_TIMEOUT;
+  }
+
   config_setting_t *setting = config_lookup(&cfg, "interfaces");
   if (setting == NULL) {
     ERROR_COMMENT("No interfaces in config file.\n");
@@ -159,6 +240,10 @@ int read_interface_config(arpwatch_params *params,
     goto _error;
   }
   config_setting_t *interface = config_setting_get_elem(setting, interface_num);
+  if (interface == NULL) {
+    ERROR_PRINT("No interface %d in config file.\n", interface_num);
+    goto _error;
+  }
   DEBUG_PRINT("Instance number = %d\n", interface_num);
 
   if (config_setting_lookup_string(interface, "device", &str)) {
@@ -175,6 +260,44 @@ int read_interface_config(arpwatch_params *params,
     goto _error;
   }
 
+  if (config_setting_lookup_string(interface, "pcap_program", &str)) {
+    strncpy(params->program, str, ARPWATCH_CONFIG_MAX_STRING);
+  } else {
+    strncpy(params->program, ARPWATCH_PCAP_PROGRAM,
+            ARPWATCH_CONFIG_MAX_STRING);
+  }
+
+  if (!config_setting_lookup_int(interface, "pcap_buffer_size",
+                                 &params->pcap_buffer_size)) {
+    params->pcap_buffer_size = ARPWATCH_PCAP_BUFFER_SIZE;
+  }
+
+  if (!config_setting_lookup_int(interface, "pcap_buffer_max",
+                                 &params->pcap_buffer_max)) {
+    params->pcap_buffer_max = ARPWATCH_PCAP_BUFFER_MAX;
+  }
+
+  if (!config_setting_lookup_bool(interface, "pcap_immediate",
+                                  &params->pcap_immediate)) {
+    params->pcap_immediate = 0;
+  }
+
+  if (config_setting_lookup_string(interface, "pcap_tstamp_type", &str)) {
+    strncpy(params->pcap_tstamp_type, str, ARPWATCH_CONFIG_MAX_STRING);
+  } else {
+    params->pcap_tstamp_type[0] = '\0';
+  }
+
+  if (!config_setting_lookup_int(interface, "recorder_frames",
+                                 &params->recorder_frames)) {
+    params->recorder_frames = ARPWATCH_RECORDER_FRAMES;
+  }
+
+  if (!config_setting_lookup_int(interface, "recorder_anomalies",
+                                 &params->recorder_anomalies)) {
+    params->recorder_anomalies = ARPWATCH_RECORDER_ANOMALIES;
+  }
+
   if (!config_setting_lookup_bool(interface, "ignore_tagged",
                                   &params->ignore_tagged)) {
     params->ignore_tagged = 0;
@@ -195,6 +318,72 @@ int read_interface_config(arpwatch_params *params,
     params->arp_delay = ARPWATCH_ARP_DELAY;
   }
 
+  if (!config_setting_lookup_int(interface, "arp_max_pps",
+                                 &params->arp_max_pps)) {
+    params->arp_max_pps = ARPWATCH_ARP_MAX_PPS;
+  }
+
+  if (!config_setting_lookup_int(interface, "arp_fresh_time",
+                                 &params->arp_fresh_time)) {
+    params->arp_fresh_time = ARPWATCH_ARP_FRESH_TIME;
+  }
+
+  if (!config_setting_lookup_int(interface, "arp_backoff",
+                                 &params->arp_backoff)) {
+    params->arp_backoff = ARPWATCH_ARP_BACKOFF;
+  }
+  if ((params->arp_backoff < 0) ||
+      (params->arp_backoff > HOSTS_BACKOFF_MAX)) {
+    ERROR_PRINT("Invalid arp_backoff %d, must be 0 to %d\n",
+                params->arp_backoff, HOSTS_BACKOFF_MAX);
+    goto _error;
+  }
+
+  if (!config_setting_lookup_int(interface, "arp_absent_sweeps",
+                                 &params->arp_absent_sweeps)) {
+    params->arp_absent_sweeps = ARPWATCH_ARP_ABSENT_SWEEPS;
+  }
+
+  if (!config_setting_lookup_int(interface, "arp_discovery_delay",
+                                 &params->arp_discovery_delay)) {
+    params->arp_discovery_delay = ARPWATCH_ARP_DISCOVERY_DELAY;
+  }
+
+  params->arp_scan_order = ARPWATCH_SCAN_RANDOM;
+  if (config_setting_lookup_string(interface, "arp_scan_order", &str)) {
+    if (!strcmp(str, "sequential")) {
+      params->arp_scan_order = ARPWATCH_SCAN_SEQUENTIAL;
+    } else if (strcmp(str, "random")) {
+      ERROR_PRINT("Invalid arp_scan_order \"%s\"\n", str);
+      goto _error;
+    }
+  }
+
+  if (!config_setting_lookup_int(interface, "capture_cpu",
+                                 &params->capture_cpu)) {
+    params->capture_cpu = ARPWATCH_CPU_NONE;
+  }
+
+  if (!config_setting_lookup_int(interface, "sink_cpu",
+                                 &params->sink_cpu)) {
+    params->sink_cpu = ARPWATCH_CPU_NONE;
+  }
+
+  if (!config_setting_lookup_int(interface, "arp_cpu",
+                                 &params->arp_cpu)) {
+    params->arp_cpu = ARPWATCH_CPU_NONE;
+  }
+
+  if (!config_setting_lookup_int(interface, "capture_priority",
+                                 &params->capture_priority)) {
+    params->capture_priority = ARPWATCH_CAPTURE_PRIORITY;
+  }
+
+  if (!config_setting_lookup_bool(interface, "numa_affinity",
+                                  &params->numa_affinity)) {
+    params->numa_affinity = 0;
+  }
+
   if (!config_setting_lookup_int(interface, "native_vlan",
                                  &params->native_vlan)) {
     params->native_vlan = 0;
@@ -346,6 +535,8 @@ int read_interface_config(arpwatch_params *params,
     } else {
       params->network[i].ipaddress_source = 0;
     }
+
+    params->network[i].hosts = NULL;
   }
 
   rtn = 0;
@@ -357,6 +548,549 @@ _error:
   return rtn;
 }
 
+int read_interface_device(const char *filename, int interface_num,
+                          char *device) {
+  config_t cfg;
+  const char *str;
+  int rtn = -1;
+
+  config_init(&cfg);
+
+  if (!config_read_file(&cfg, filename)) {
+    goto _error;
+  }
+
+  config_setting_t *setting = config_lookup(&cfg, "interfaces");
+  if (setting == NULL) {
+    goto _error;
+  }
+
+  config_setting_t *interface = config_setting_get_elem(setting, interface_num);
+  if (interface == NULL) {
+    goto _error;
+  }
+
+  if (config_setting_lookup_string(interface, "device", &str)) {
+    strncpy(device, str, ARPWATCH_CONFIG_MAX_STRING);
+    rtn = 0;
+  }
+
+_error:
+  config_destroy(&cfg);
+  return rtn;
+}
+
+int find_interface_config(const char *filename, const char *device,
+                          int num_interface) {
+  char _device[ARPWATCH_CONFIG_MAX_STRING];
+
+  for (int i = 0; i < num_interface; i++) {
+    if (!read_interface_device(filename, i, _device) &&
+        !strcmp(_device, device)) {
+      return i;
+    }
+  }
+
+  return -1;
+}
+
+void arpwatch_signal(int sig) {
+  if (sig == SIGHUP) {
+    reload_flag = 1;
+  } else {
+    terminate_flag = 1;
+  }
+  capture_stop();
+}
+
+int arpwatch_signal_setup(void) {
+  struct sigaction sa;
+
+  memset(&sa, 0, sizeof(sa));
+  sa.sa_handler = arpwatch_signal;
+  sigemptyset(&sa.sa_mask);
+
+  // No SA_RESTART, we want wait() and epoll_wait() to return
+
+  if (sigaction(SIGHUP, &sa, NULL) ||
+      sigaction(SIGTERM, &sa, NULL) ||
+      sigaction(SIGINT, &sa, NULL)) {
+    ERROR_COMMENT("Unable to install signal handler\n");
+    return -1;
+  }
+
+  sa.sa_handler = recorder_signal;
+  if (sigaction(SIGUSR1, &sa, NULL)) {
+    ERROR_COMMENT("Unable to install recorder signal handler\n");
+    return -1;
+  }
+
+#ifdef PROFILE
+  sa.sa_handler = profile_signal;
+  if (sigaction(SIGUSR2, &sa, NULL)) {
+    ERROR_COMMENT("Unable to install profile signal handler\n");
+    return -1;
+  }
+#endif
+
+  return 0;
+}
+
+void arpwatch_block_signals(sigset_t *oldset) {
+  // Threads are created with signals blocked so they are only
+  // delivered to the capture loop
+  sigset_t set;
+  sigemptyset(&set);
+  sigaddset(&set, SIGHUP);
+  sigaddset(&set, SIGTERM);
+  sigaddset(&set, SIGINT);
+  sigaddset(&set, SIGUSR1);
+  sigaddset(&set, SIGUSR2);
+  pthread_sigmask(SIG_BLOCK, &set, oldset);
+}
+
+void arpwatch_attach_hosts(hosts_data *hosts, arpwatch_network *network,
+                           int num_network) {
+  // Link each network to its per address state
+
+  for (int i = 0; i < num_network; i++) {
+    uint32_t subnet = ntohl(network[i].subnet);
+    uint32_t base = (ntohl(network[i].ipaddress) & subnet) + 1;
+    uint32_t num_hosts = (~subnet) > 1 ? (~subnet) - 1 : 0;
+    network[i].hosts = hosts_add(hosts, base, num_hosts, network[i].vlan);
+  }
+}
+
+int arpwatch_reload(arpwatch_params *params, const char *filename) {
+  int rtn = -1;
+
+  arpwatch_params *tmp = malloc(sizeof(arpwatch_params));
+  if (!tmp) {
+    ERROR_COMMENT("Unable to allocate memory for reload\n");
+    return -1;
+  }
+
+  *tmp = *params;
+  tmp->network = NULL;
+  tmp->vlan_ignore = NULL;
+  tmp->epics_pv_vlan = NULL;
+
+  if (read_global_config(tmp, filename)) {
+    goto _error;
+  }
+
+  int idx = find_interface_config(filename, params->device,
+                                  tmp->num_interface);
+  if (idx < 0) {
+    NOTICE_PRINT("%s : Interface removed from config file, it is "
+                 "captured with its old settings until a restart\n",
+                 params->device);
+    goto _error;
+  }
+
+  if (read_interface_config(tmp, filename, idx)) {
+    goto _error;
+  }
+
+  if (strcmp(tmp->program, params->program)) {
+    if (capture_set_filter(params, tmp->program)) {
+      goto _error;
+    }
+    NOTICE_PRINT("%s : Installed filter \"%s\"\n",
+                 params->device, tmp->program);
+  }
+
+  if ((tmp->buffer_size != params->buffer_size) ||
+      (tmp->recorder_frames != params->recorder_frames) ||
+      (tmp->recorder_anomalies != params->recorder_anomalies) ||
+      strcmp(tmp->sink, params->sink)) {
+    NOTICE_PRINT("%s : Changes to buffer_size, recorder and sink "
+                 "settings require a restart\n", params->device);
+  }
+
+  //
+  // Swap the new settings in. The old arrays end up in tmp
+  // and are freed below.
+  //
+
+  pthread_mutex_lock(&params->config_mutex);
+
+  arpwatch_attach_hosts(&params->hosts, tmp->network, tmp->num_network);
+
+  arpwatch_network *network = params->network;
+  int num_network = params->num_network;
+  params->network = tmp->network;
+  params->num_network = tmp->num_network;
+  tmp->network = network;
+  tmp->num_network = num_network;
+
+  // The address state of networks no longer configured is freed
+  // by the ARP thread once its current sweep is done with it
+
+  for (int i = 0; i < tmp->num_network; i++) {
+    int used = !tmp->network[i].hosts;
+    for (int j = 0; !used && (j < params->num_network); j++) {
+      used = (params->network[j].hosts == tmp->network[i].hosts);
+    }
+    if (!used) {
+      hosts_retire(tmp->network[i].hosts);
+    }
+  }
+
+  int *vlan_ignore = params->vlan_ignore;
+  params->vlan_ignore = tmp->vlan_ignore;
+  params->num_vlan_ignore = tmp->num_vlan_ignore;
+  tmp->vlan_ignore = vlan_ignore;
+
+  int *epics_pv_vlan = params->epics_pv_vlan;
+  params->epics_pv_vlan = tmp->epics_pv_vlan;
+  params->num_epics_pv_vlan = tmp->num_epics_pv_vlan;
+  tmp->epics_pv_vlan = epics_pv_vlan;
+
+  params->ignore_tagged = tmp->ignore_tagged;
+  params->arp_requests = tmp->arp_requests;
+  params->native_vlan = tmp->native_vlan;
+  params->arp_delay = tmp->arp_delay;
+  params->arp_loop_delay = tmp->arp_loop_delay;
+  params->arp_max_pps = tmp->arp_max_pps;
+  params->arp_scan_order = tmp->arp_scan_order;
+  params->arp_fresh_time = tmp->arp_fresh_time;
+  params->arp_backoff = tmp->arp_backoff;
+  params->arp_absent_sweeps = tmp->arp_absent_sweeps;
+  params->arp_discovery_delay = tmp->arp_discovery_delay;
+  params->mysql_loop_delay = tmp->mysql_loop_delay;
+  params->last_seen_granularity = tmp->last_seen_granularity;
+  params->registration_delay = tmp->registration_delay;
+  params->num_interface = tmp->num_interface;
+  strncpy(params->program, tmp->program, ARPWATCH_CONFIG_MAX_STRING);
+
+  pthread_mutex_unlock(&params->config_mutex);
+
+  NOTICE_PRINT("%s : Reloaded config from %s\n", params->device, filename);
+  rtn = 0;
+
+_error:
+  free(tmp->network);
+  free(tmp->vlan_ignore);
+  free(tmp->epics_pv_vlan);
+  free(tmp);
+
+  return rtn;
+}
+
+void arpwatch_free(arpwatch_params *params) {
+  buffer_free(&(params->data_buffer));
+  hosts_free(&(params->hosts));
+  probe_free(&(params->probes));
+  recorder_free(&(params->recorder));
+  free(params->network);
+  free(params->vlan_ignore);
+  free(params->epics_pv_vlan);
+}
+
+static void arpwatch_check_interfaces(arpwatch_params *iface, int num_iface,
+                                      const char *filename) {
+  //
+  // In single_process mode the capture loop, sink and ARP threads
+  // are set up for the interfaces configured at start. Interfaces
+  // added to the config file are not captured until a restart.
+  //
+
+  for (int i = 0; i < iface[0].num_interface; i++) {
+    char device[ARPWATCH_CONFIG_MAX_STRING];
+    if (read_interface_device(filename, i, device)) {
+      continue;
+    }
+
+    int found = 0;
+    for (int j = 0; j < num_iface; j++) {
+      if (!strcmp(iface[j].device, device)) {
+        found = 1;
+        break;
+      }
+    }
+
+    if (!found) {
+      NOTICE_PRINT("%s : Interface added to config file, it is not "
+                   "captured until a restart\n", device);
+    }
+  }
+}
+
+int arpwatch_run(arpwatch_params *iface, int num_iface,
+                 const char *filename, int first) {
+  registry_data registry;
+  int num_ready = 0;
+  int rtn = -1;
+
+  //
+  // Setup num_iface interfaces, starting with interface
+  // number first in the config file. All interfaces share one
+  // registry, one sink thread and one capture loop.
+  //
+
+  if (registry_init(&registry) != REGISTRY_NOERR) {
+    ERROR_COMMENT("ERROR initializing registry\n");
+    return -1;
+  }
+
+  affinity_save();
+
+  for (int i = 0; i < num_iface; i++) {
+    iface[i].network = NULL;
+    iface[i].vlan_ignore = NULL;
+    iface[i].epics_pv_vlan = NULL;
+    iface[i].data_buffer.data = NULL;
+    iface[i].recorder.slab = NULL;
+    iface[i].recorder.recent.frame = NULL;
+    iface[i].recorder.anomaly.frame = NULL;
+    iface[i].registry = &registry;
+    iface[i].pcap = NULL;
+    pthread_mutex_init(&iface[i].config_mutex, NULL);
+    hosts_init(&iface[i].hosts);
+    iface[i].probes.entry = NULL;
+    iface[i].probes.hash = NULL;
+    num_ready++;
+
+    if (read_interface_config(&iface[i], filename, first + i)) {
+      ERROR_COMMENT("Error reading config file\n");
+      goto _error;
+    }
+
+    // Forked processes are given their slot by the parent
+
+    if (!iface[i].metrics) {
+      iface[i].metrics = metrics_slot(&arpwatch_metrics, iface[i].device);
+    }
+
+    // Run where this interface is captured while allocating,
+    // so the ring is placed on the NUMA node of the NIC
+
+    affinity_restore();
+    affinity_set(iface[i].device, "capture", iface[i].capture_cpu,
+                 iface[i].numa_affinity);
+
+    arpwatch_attach_hosts(&iface[i].hosts, iface[i].network,
+                          iface[i].num_network);
+
+    if (probe_init(&iface[i].probes) != PROBE_NOERR) {
+      goto _error;
+    }
+
+    // Setup Buffer
+
+    if (buffer_init(&(iface[i].data_buffer),
+                    iface[i].buffer_size, 1) != BUFFER_NOERR) {
+      ERROR_COMMENT("ERROR initializing buffer\n");
+      goto _error;
+    }
+    affinity_touch(iface[i].data_buffer.data,
+                   iface[i].buffer_size * sizeof(arp_data));
+
+    if (recorder_init(&iface[i].recorder, iface[i].recorder_frames,
+                      iface[i].recorder_anomalies,
+                      CAPTURE_SNAPLEN) != RECORDER_NOERR) {
+      goto _error;
+    }
+
+    // Pick up anything spilled by the last shutdown
+
+    journal_replay(&iface[i]);
+
+    if (capture_open(&iface[i])) {
+      ERROR_PRINT("ERROR opening capture on %s\n", iface[i].device);
+      goto _error;
+    }
+  }
+
+  // Threads set their own affinity, do not let them inherit ours
+
+  affinity_restore();
+
+  sigset_t oldset;
+  arpwatch_block_signals(&oldset);
+
+  // Messages are written by their own thread from here on, if it
+  // can not be started they are written directly
+
+  log_start();
+
+  if (sink_setup(iface, num_iface)) {
+    ERROR_COMMENT("ERROR starting sink\n");
+    pthread_sigmask(SIG_SETMASK, &oldset, NULL);
+    goto _error;
+  }
+
+  // The ARP thread idles while arp_requests is false so that
+  // it can be enabled by a reload
+
+  int num_arp;
+  for (num_arp = 0; num_arp < num_iface; num_arp++) {
+    if (arp_setup(&iface[num_arp])) {
+      break;
+    }
+  }
+
+  pthread_sigmask(SIG_SETMASK, &oldset, NULL);
+
+  // Let the parent (or the notify thread) tell systemd we are up
+
+  for (int i = 0; (num_arp == num_iface) && (i < num_iface); i++) {
+    if (iface[i].metrics) {
+      __atomic_store_n(&iface[i].metrics->ready, 1, __ATOMIC_RELEASE);
+    }
+  }
+
+  // This thread captures for all interfaces
+
+  affinity_set(iface[0].device, "capture", iface[0].capture_cpu,
+               iface[0].numa_affinity);
+  affinity_priority(iface[0].device, "capture",
+                    iface[0].capture_priority);
+
+  for (;;) {
+    if (num_arp != num_iface) {
+      rtn = -1;
+      break;
+    }
+
+    rtn = capture_loop(iface, num_iface);
+    if (rtn || terminate_flag || !reload_flag) {
+      break;
+    }
+
+    // Reload the config, the pcap handles stay open
+    // so no packets are lost
+
+    reload_flag = 0;
+    capture_resume();
+
+    for (int i = 0; i < num_iface; i++) {
+      arpwatch_reload(&iface[i], filename);
+    }
+
+    if (iface[0].single_process) {
+      arpwatch_check_interfaces(iface, num_iface, filename);
+    }
+  }
+
+  //
+  // Orderly shutdown. Capture has stopped so nothing more is added
+  // to the buffers, stop the ARP threads and let the sink flush.
+  //
+
+  NOTICE_COMMENT("Shutting down\n");
+  PROFILE_DUMP(iface[0].device);
+  arp_stop(iface, num_arp);
+  sink_stop(iface[0].shutdown_timeout);
+
+_error:
+  // Ok if we get here, cleanup memory
+
+  for (int i = 0; i < num_ready; i++) {
+    capture_close(&iface[i]);
+    arpwatch_free(&iface[i]);
+  }
+  registry_free(&registry);
+  log_stop();
+
+  return rtn;
+}
+
+int arpwatch_fork(arpwatch_params *params, const char *filename,
+                  int interface_num, arpwatch_child *child) {
+  if (read_interface_device(filename, interface_num, child->device)) {
+    ERROR_PRINT("No device for interface %d\n", interface_num);
+    return -1;
+  }
+
+  params->metrics = metrics_slot(&arpwatch_metrics, child->device);
+
+  pid_t pid = fork();
+  if (pid < 0) {
+    ERROR_COMMENT("Error in fork()\n");
+    return -1;
+  } else if (pid == 0) {
+    DEBUG_PRINT("Child (%d): %d from %d\n",
+                interface_num, getpid(), getppid());
+
+    if (arpwatch_metrics.fd >= 0) {
+      close(arpwatch_metrics.fd);
+    }
+
+    if (arpwatch_run(params, 1, filename, interface_num)) {
+      exit(EXIT_FAILURE);
+    }
+
+    exit(EXIT_SUCCESS);
+  }
+
+  child->pid = pid;
+  return 0;
+}
+
+arpwatch_child* arpwatch_reload_children(arpwatch_params *params,
+                                         const char *filename,
+                                         arpwatch_child *child,
+                                         int *num_child) {
+  //
+  // Diff the interfaces in the config file against the running
+  // children. Removed interfaces are stopped, new ones are started
+  // and the rest reload their own settings on SIGHUP.
+  //
+
+  if (read_global_config(params, filename)) {
+    ERROR_COMMENT("Error reading config file, keeping current config\n");
+    return child;
+  }
+
+  for (int i = 0; i < *num_child; i++) {
+    if (find_interface_config(filename, child[i].device,
+                              params->num_interface) < 0) {
+      NOTICE_PRINT("%s : Removed from config, stopping process %d\n",
+                   child[i].device, child[i].pid);
+      kill(child[i].pid, SIGTERM);
+    } else {
+      kill(child[i].pid, SIGHUP);
+    }
+  }
+
+  for (int i = 0; i < params->num_interface; i++) {
+    char device[ARPWATCH_CONFIG_MAX_STRING];
+    if (read_interface_device(filename, i, device)) {
+      continue;
+    }
+
+    int found = 0;
+    for (int j = 0; j < *num_child; j++) {
+      if (!strcmp(child[j].device, device)) {
+        found = 1;
+        break;
+      }
+    }
+
+    if (found) {
+      continue;
+    }
+
+    arpwatch_child *_child = (arpwatch_child *)
+      realloc(child, sizeof(arpwatch_child) * (*num_child + 1));
+    if (!_child) {
+      ERROR_COMMENT("Unable to allocate memory for interfaces\n");
+      free(child);
+      return NULL;
+    }
+    child = _child;
+
+    NOTICE_PRINT("%s : Added to config, starting process\n", device);
+    if (!arpwatch_fork(params, filename, i, &child[*num_child])) {
+      (*num_child)++;
+    }
+  }
+
+  return child;
+}
+
 int main(int argc, char *argv[]) {
   arpwatch_params params;
   char *config_filename = ARPWATCH_CONFIG_FILE;
@@ -423,10 +1157,6 @@ int main(int argc, char *argv[]) {
     }
   }
 
-  strncpy(params.program,
-          ARPWATCH_PCAP_PROGRAM,
-          ARPWATCH_CONFIG_MAX_STRING);
-
   DEBUG_PRINT("git rev     = %s\n", ARPTOOLS_GIT_REV);
   DEBUG_PRINT("git branch  = %s\n", ARPTOOLS_GIT_BRANCH);
   DEBUG_PRINT("git version = %s\n", ARPTOOLS_GIT_VERSION);
@@ -446,48 +1176,140 @@ int main(int argc, char *argv[]) {
     return EXIT_FAILURE;
   }
 
-  int pid;
-  for (int i = 0; i < params.num_interface; i++) {
-    pid = fork();
-    if (pid < 0) {
-      ERROR_COMMENT("Error in fork()\n");
-      exit(EXIT_FAILURE);
-    } else if (pid == 0) {
-      DEBUG_PRINT("Child (%d): %d from %d\n", i, getpid(), getppid());
+  // journal_dir also holds the ARP checkpoints and recorder
+  // dumps, create it if the install did not
 
-      if (read_interface_config(&params, config_filename, i)) {
-        ERROR_COMMENT("Error reading config file\n");
-        exit(EXIT_FAILURE);
-      }
+  if (*params.journal_dir && mkdir(params.journal_dir, 0750) &&
+      (errno != EEXIST)) {
+    ERROR_PRINT("Unable to create journal_dir %s (%s)\n",
+                params.journal_dir, strerror(errno));
+  }
 
-      // Setup Buffer
+  if (arpwatch_signal_setup()) {
+    return EXIT_FAILURE;
+  }
 
-      if (buffer_init(&(params.data_buffer),
-                      params.buffer_size, 1) != BUFFER_NOERR) {
-        ERROR_COMMENT("ERROR initializing buffer\n");
-        exit(EXIT_FAILURE);
-      }
+  // Counters are always kept, serving them is optional
 
-      mysql_setup(&params);
-      if (params.arp_requests) {
-        arp_setup(&params);
-      }
-      capture_start(&params);
+  params.metrics = NULL;
+  if (metrics_init(&arpwatch_metrics) == METRICS_NOERR &&
+      params.metrics_port) {
+    metrics_listen(&arpwatch_metrics, params.metrics_address,
+                   params.metrics_port);
+  }
+  notify_init(&arpwatch_notify, &arpwatch_metrics, params.stall_timeout);
 
-      // Ok if we get here, cleanup memory
+  if (params.single_process) {
+    // Run all interfaces from this process
 
-      buffer_free(&(params.data_buffer));
-      free(params.network);
+    arpwatch_params *iface = (arpwatch_params *)
+      calloc(params.num_interface, sizeof(arpwatch_params));
+    if (!iface) {
+      ERROR_COMMENT("Unable to allocate memory for interfaces\n");
+      return EXIT_FAILURE;
+    }
+
+    for (int i = 0; i < params.num_interface; i++) {
+      iface[i] = params;
+    }
+
+    sigset_t oldset;
+    arpwatch_block_signals(&oldset);
+    if (arpwatch_metrics.fd >= 0) {
+      metrics_start(&arpwatch_metrics);
+    }
+    notify_start(&arpwatch_notify);
+    pthread_sigmask(SIG_SETMASK, &oldset, NULL);
+
+    int rtn = arpwatch_run(iface, params.num_interface, config_filename, 0);
+    notify_stop();
+    notify_stopping(&arpwatch_notify);
+    metrics_stop();
+    metrics_free(&arpwatch_metrics);
+    free(iface);
+
+    return rtn ? EXIT_FAILURE : EXIT_SUCCESS;
+  }
+
+  arpwatch_child *child = (arpwatch_child *)
+    calloc(params.num_interface, sizeof(arpwatch_child));
+  if (!child) {
+    ERROR_COMMENT("Unable to allocate memory for interfaces\n");
+    return EXIT_FAILURE;
+  }
 
-      exit(EXIT_SUCCESS);
+  int num_child = 0;
+  int stopping = 0;
+  for (int i = 0; i < params.num_interface; i++) {
+    if (arpwatch_fork(&params, config_filename, i, &child[num_child])) {
+      exit(EXIT_FAILURE);
     }
+    num_child++;
   }
 
   // Now wait for all child processes to exit
 
-  while (wait(NULL) > 0) {
-    continue;
+  while (num_child) {
+    pid_t pid;
+
+    // Answer scrapes and tell systemd how we are doing while
+    // waiting. The wait is always timed, a signal arriving after
+    // the flags were checked would otherwise go unseen until a
+    // child exits. poll() ignores the socket if metrics are off.
+
+    metrics_poll(&arpwatch_metrics, ARPWATCH_WAIT_TIMEOUT);
+    notify_check(&arpwatch_notify);
+    pid = waitpid(-1, NULL, WNOHANG);
+
+    if (pid > 0) {
+      for (int i = 0; i < num_child; i++) {
+        if (child[i].pid == pid) {
+          NOTICE_PRINT("%s : Process %d exited\n", child[i].device, pid);
+          metrics_release(&arpwatch_metrics, child[i].device);
+          child[i] = child[--num_child];
+          break;
+        }
+      }
+    } else if ((pid == 0) || (errno == EINTR)) {
+      if (recorder_dump_flag) {
+        recorder_dump_flag = 0;
+        for (int i = 0; i < num_child; i++) {
+          kill(child[i].pid, SIGUSR1);
+        }
+      }
+#ifdef PROFILE
+      if (profile_dump_flag) {
+        profile_dump_flag = 0;
+        for (int i = 0; i < num_child; i++) {
+          kill(child[i].pid, SIGUSR2);
+        }
+      }
+#endif
+      if (terminate_flag) {
+        // Forward to the children and wait for them to drain
+
+        for (int i = 0; i < num_child; i++) {
+          kill(child[i].pid, SIGTERM);
+        }
+        notify_stopping(&arpwatch_notify);
+        terminate_flag = 0;
+        reload_flag = 0;
+        stopping = 1;
+      } else if (reload_flag && !stopping) {
+        reload_flag = 0;
+        child = arpwatch_reload_children(&params, config_filename,
+                                         child, &num_child);
+        if (!child) {
+          return EXIT_FAILURE;
+        }
+      }
+    } else {
+      break;
+    }
   }
 
+  free(child);
+  metrics_free(&arpwatch_metrics);
+
   return EXIT_SUCCESS;
 }
@@ -38,18 +38,49 @@
 #ifndef SRC_ARPWATCH_H_
 #define SRC_ARPWATCH_H_
 
+#include <pcap.h>
+
 #include "buffer.h"
+#include "registry.h"
+#include "hosts.h"
+#include "probe.h"
+#include "metrics.h"
+#include "recorder.h"
 
 #define ARPWATCH_CONFIG_FILE             "/etc/arpwatch.conf"
 #define ARPWATCH_CONFIG_MAX_STRING       2048
+#define ARPWATCH_MAX_FILENAME            (2 * ARPWATCH_CONFIG_MAX_STRING + 64)
 // #define ARPWATCH_PCAP_PROGRAM            "(arp[6:2] = 2)"
 // #define ARPWATCH_PCAP_PROGRAM            "arp"
 #define ARPWATCH_PCAP_PROGRAM            "(ether broadcast) || arp"
 #define ARPWATCH_PCAP_TIMEOUT            5
 #define ARPWATCH_ARP_DELAY               50000
 #define ARPWATCH_ARP_LOOP_DELAY          300
+#define ARPWATCH_ARP_MAX_PPS             0
+#define ARPWATCH_SCAN_SEQUENTIAL         0
+#define ARPWATCH_SCAN_RANDOM             1
+#define ARPWATCH_ARP_FRESH_TIME          300
+#define ARPWATCH_ARP_ABSENT_SWEEPS       3
+#define ARPWATCH_ARP_BACKOFF             HOSTS_BACKOFF_MAX
+#define ARPWATCH_ARP_DISCOVERY_DELAY     0
 #define ARPWATCH_MYSQL_LOOP_DELAY        120
+#define ARPWATCH_LAST_SEEN_GRANULARITY   900
+#define ARPWATCH_REGISTRATION_DELAY      600
 #define ARPWATCH_BUFFER_SIZE             100000
+#define ARPWATCH_SINK                    "mysql"
+#define ARPWATCH_SQLITE_DATABASE         "/var/lib/arpwatch/arpwatch.db"
+#define ARPWATCH_SHUTDOWN_TIMEOUT        30
+#define ARPWATCH_JOURNAL_DIR             "/var/lib/arpwatch"
+#define ARPWATCH_PCAP_BUFFER_SIZE        (4 * 1024 * 1024)
+#define ARPWATCH_PCAP_BUFFER_MAX         (64 * 1024 * 1024)
+#define ARPWATCH_METRICS_PORT            0
+#define ARPWATCH_METRICS_ADDRESS         "127.0.0.1"
+#define ARPWATCH_WAIT_TIMEOUT            1000       // Milliseconds
+#define ARPWATCH_STALL_TIMEOUT           60
+#define ARPWATCH_RECORDER_FRAMES         1024
+#define ARPWATCH_RECORDER_ANOMALIES      256
+#define ARPWATCH_CPU_NONE                -1
+#define ARPWATCH_CAPTURE_PRIORITY        0
 
 typedef struct {
   uint32_t ipaddress;
@@ -58,17 +89,60 @@ typedef struct {
   int vlan;
   int vlan_pri;
   int vlan_dei;
+  hosts_network *hosts;
 } arpwatch_network;
 
+typedef struct {
+  struct timeval ts;
+  uint32_t caplen;               // 0 once matched
+  uint32_t hash;
+} arpwatch_frame_id;
+
 typedef struct {
   int num_interface;
   int num_network;
   int mysql_loop_delay;
+  int last_seen_granularity;
+  int registration_delay;
+  int shutdown_timeout;
   int arp_delay;
   int arp_loop_delay;
+  int arp_max_pps;
+  int arp_scan_order;
+  int arp_fresh_time;
+  int arp_backoff;
+  int arp_absent_sweeps;
+  int arp_discovery_delay;
   int pcap_timeout;
+  int pcap_buffer_size;
+  int pcap_buffer_max;
+  int pcap_immediate;
+  unsigned int pcap_drop;
+  unsigned int pcap_ifdrop;
+  arpwatch_frame_id *pcap_seen;  // Frames drained from a replaced handle
+  int pcap_seen_num;
+  int pcap_seen_pos;
+  int pcap_draining;
+  int recorder_frames;
+  int recorder_anomalies;
   int buffer_size;
+  int single_process;
+  int metrics_port;
+  int stall_timeout;
+  int capture_cpu;
+  int sink_cpu;
+  int arp_cpu;
+  int capture_priority;
+  int numa_affinity;
   buffer_data data_buffer;
+  registry_data *registry;
+  hosts_data hosts;
+  probe_table probes;
+  recorder_data recorder;
+  metrics_interface *metrics;
+  pcap_t *pcap;
+  pthread_mutex_t config_mutex;
+  pthread_t arp_thread;
   int ignore_tagged;
   int arp_requests;
   int native_vlan;
@@ -77,11 +151,16 @@ typedef struct {
   int *epics_pv_vlan;
   int num_epics_pv_vlan;
   char program[ARPWATCH_CONFIG_MAX_STRING];
+  char pcap_tstamp_type[ARPWATCH_CONFIG_MAX_STRING];
   char device[ARPWATCH_CONFIG_MAX_STRING];
   char hostname[ARPWATCH_CONFIG_MAX_STRING];
   char username[ARPWATCH_CONFIG_MAX_STRING];
   char password[ARPWATCH_CONFIG_MAX_STRING];
   char database[ARPWATCH_CONFIG_MAX_STRING];
+  char sink[ARPWATCH_CONFIG_MAX_STRING];
+  char sqlite_database[ARPWATCH_CONFIG_MAX_STRING];
+  char journal_dir[ARPWATCH_CONFIG_MAX_STRING];
+  char metrics_address[ARPWATCH_CONFIG_MAX_STRING];
   char location[ARPWATCH_CONFIG_MAX_STRING];
   char label[ARPWATCH_CONFIG_MAX_STRING];
   char daemon_hostname[ARPWATCH_CONFIG_MAX_STRING];
@@ -89,5 +168,10 @@ typedef struct {
   arpwatch_network *network;
 } arpwatch_params;
 
+typedef struct {
+  pid_t pid;
+  char device[ARPWATCH_CONFIG_MAX_STRING];
+} arpwatch_child;
+
 
 #endif  // SRC_ARPWATCH_H_
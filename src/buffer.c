@@ -148,7 +148,9 @@ int buffer_compare_data(arp_data *d1, arp_data *d2) {
   }
 }
 
-void buffer_advance_head(buffer_data *buffer, int unique) {
+int buffer_advance_head(buffer_data *buffer, int unique) {
+  int rtn = 0;
+
   /* Increment the head pointet */
   pthread_mutex_lock(&buffer->mutex);
 
@@ -159,6 +161,7 @@ void buffer_advance_head(buffer_data *buffer, int unique) {
     buffer->full = 1;
     buffer->overruns++;
     if (!buffer->ring) {
+      rtn = -1;
       goto cleanup;
     }
   }
@@ -168,6 +171,7 @@ void buffer_advance_head(buffer_data *buffer, int unique) {
     buffer->full = 1;
     buffer->overruns++;
     if (!buffer->ring) {
+      rtn = -1;
       goto cleanup;
     }
   }
@@ -182,8 +186,9 @@ void buffer_advance_head(buffer_data *buffer, int unique) {
     do {
       if (!buffer_compare_data(tmp, buffer->head)) {
           // Data matches
-          DEBUG_PRINT("Skipping, data exists %p\n", tmp);
+          DEBUG_PRINT("Skipping, data exists %p\n", (void *)tmp);
           match = -1;
+          rtn = 1;
           break;
       }
 
@@ -216,6 +221,7 @@ void buffer_advance_head(buffer_data *buffer, int unique) {
 cleanup:
   pthread_cond_broadcast(&buffer->signal);
   pthread_mutex_unlock(&buffer->mutex);
+  return rtn;
 }
 
 arp_data* buffer_get_tail(buffer_data *buffer, int wait) {
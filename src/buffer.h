@@ -88,7 +88,9 @@ typedef struct {
   unsigned char hw_addr[ETH_ALEN];
   struct in_addr ip_addr;
   struct timeval ts;
+  int64_t queued;                // Microseconds, when put on the buffer
   int type;
+  int registration;
   uint16_t vlan;
   char dhcp_name[BUFFER_NAME_MAX];
   char pv_name[BUFFER_PV_MAX][BUFFER_PV_NAME_MAX];
@@ -124,10 +126,12 @@ arp_data* buffer_get_tail(buffer_data *buffer, int wait);
  * on the signal sent by "buffer_get_head". If data is on the
  * buffer then it will immediately return
  */
-void buffer_advance_head(buffer_data *buffer, int unique);
+int buffer_advance_head(buffer_data *buffer, int unique);
 /*
  * Advance the head pointer, signalling we are done filling
- * the buffer with an element.
+ * the buffer with an element. Returns 1 if unique is set and the
+ * element was dropped as a copy of one already on the buffer,
+ * -1 if it was dropped because the buffer is full and 0 otherwise.
  */
 void buffer_advance_tail(buffer_data *buffer);
 /*
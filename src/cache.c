@@ -0,0 +1,238 @@
+//
+//  arptools
+//
+//  Stuart B. Wilkins, Brookhaven National Laboratory
+//
+//
+//  BSD 3-Clause License
+//
+//  Copyright (c) 2021, Brookhaven Science Associates
+//  All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without
+//  modification, are permitted provided that the following conditions are met:
+//
+//  1. Redistributions of source code must retain the above copyright notice,
+//     this list of conditions and the following disclaimer.
+//
+//  2. Redistributions in binary form must reproduce the above copyright notice,
+//     this list of conditions and the following disclaimer in the documentation
+//     and/or other materials provided with the distribution.
+//
+//  3. Neither the name of the copyright holder nor the names of its
+//     contributors may be used to endorse or promote products derived from
+//     this software without specific prior written permission.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+//  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+//  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+//  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+//  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+//  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+//  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+//  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+//  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+//  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+//  THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "cache.h"
+#include "buffer.h"
+#include "debug.h"
+
+static uint64_t cache_key(arp_data *arp) {
+  uint64_t key = 0;
+  for (int i = 0; i < ETH_ALEN; i++) {
+    key = (key << 8) | arp->hw_addr[i];
+  }
+
+  // Key 0 marks an empty slot, so offset the vlan by one
+
+  return (key << 16) | ((uint64_t)arp->vlan + 1);
+}
+
+static uint64_t cache_hash(uint64_t key) {
+  // splitmix64 finalizer
+  key ^= key >> 30;
+  key *= 0xBF58476D1CE4E5B9ULL;
+  key ^= key >> 27;
+  key *= 0x94D049BB133111EBULL;
+  key ^= key >> 31;
+  return key;
+}
+
+uint64_t cache_hash_string(const char *str) {
+  // FNV-1a
+  uint64_t hash = 0xCBF29CE484222325ULL;
+  if (!str) {
+    return 0;
+  }
+  while (*str) {
+    hash ^= (unsigned char)*str++;
+    hash *= 0x100000001B3ULL;
+  }
+  return hash;
+}
+
+static int cache_alloc(cache_data *cache, int size) {
+  cache->data = calloc(size, sizeof(cache_entry));
+  if (cache->data == NULL) {
+    ERROR_COMMENT("Unable to allocate memory for cache\n");
+    return CACHE_ERR_MEMORY;
+  }
+
+  cache->size = size;
+  cache->used = 0;
+
+  return CACHE_NOERR;
+}
+
+static cache_entry* cache_slot(cache_data *cache, uint64_t key) {
+  int mask = cache->size - 1;
+  int i = (int)(cache_hash(key) & mask);
+
+  while (cache->data[i].key && (cache->data[i].key != key)) {
+    i = (i + 1) & mask;
+  }
+
+  return &cache->data[i];
+}
+
+static int cache_grow(cache_data *cache) {
+  cache_entry *old = cache->data;
+  int old_size = cache->size;
+
+  if (cache_alloc(cache, old_size * 2) != CACHE_NOERR) {
+    cache->data = old;
+    cache->size = old_size;
+    return CACHE_ERR_MEMORY;
+  }
+
+  for (int i = 0; i < old_size; i++) {
+    if (old[i].key) {
+      *cache_slot(cache, old[i].key) = old[i];
+      cache->used++;
+    }
+  }
+
+  DEBUG_PRINT("Grew write cache to %d entries\n", cache->size);
+
+  free(old);
+  return CACHE_NOERR;
+}
+
+int cache_init(cache_data *cache) {
+  return cache_alloc(cache, CACHE_INITIAL_SIZE);
+}
+
+void cache_free(cache_data *cache) {
+  if (cache->data) {
+    free(cache->data);
+    cache->data = NULL;
+  }
+}
+
+static cache_entry* cache_get_key(cache_data *cache, uint64_t key) {
+  cache_entry *entry = cache_slot(cache, key);
+
+  if (entry->key) {
+    return entry;
+  }
+
+  // Keep the load factor below 3/4
+
+  if ((cache->used + 1) * 4 > cache->size * 3) {
+    if ((cache->size >= CACHE_MAX_SIZE) ||
+        (cache_grow(cache) != CACHE_NOERR)) {
+      return NULL;
+    }
+    entry = cache_slot(cache, key);
+  }
+
+  memset(entry, 0, sizeof(cache_entry));
+  entry->key = key;
+  cache->used++;
+
+  return entry;
+}
+
+cache_entry* cache_get(cache_data *cache, arp_data *arp) {
+  return cache_get_key(cache, cache_key(arp));
+}
+
+int cache_is_current(cache_entry *entry, arp_data *arp,
+                     const char *hostname, int granularity) {
+  if (!entry->last_seen) {
+    // Never written
+    return 0;
+  }
+
+  if (entry->ip_addr.s_addr != arp->ip_addr.s_addr) {
+    return 0;
+  }
+
+  // The database ORs type bits, so only new bits are a change
+
+  if ((entry->type | arp->type) != entry->type) {
+    return 0;
+  }
+
+  if (entry->hostname_hash != cache_hash_string(hostname)) {
+    return 0;
+  }
+
+  if ((arp->type & BUFFER_TYPE_DHCP) && (*arp->dhcp_name) &&
+      (entry->dhcp_name_hash != cache_hash_string(arp->dhcp_name))) {
+    return 0;
+  }
+
+  if ((arp->ts.tv_sec - entry->last_seen) >= granularity) {
+    return 0;
+  }
+
+  return -1;
+}
+
+void cache_set(cache_entry *entry, arp_data *arp, const char *hostname) {
+  entry->ip_addr = arp->ip_addr;
+  entry->type |= arp->type;
+  entry->hostname_hash = cache_hash_string(hostname);
+
+  if ((arp->type & BUFFER_TYPE_DHCP) && (*arp->dhcp_name)) {
+    entry->dhcp_name_hash = cache_hash_string(arp->dhcp_name);
+  }
+
+  if (arp->ts.tv_sec > entry->last_seen) {
+    entry->last_seen = arp->ts.tv_sec;
+  }
+}
+
+void cache_stage(cache_entry *update, arp_data *arp, const char *hostname) {
+  memset(update, 0, sizeof(cache_entry));
+  update->key = cache_key(arp);
+  cache_set(update, arp, hostname);
+}
+
+void cache_apply(cache_data *cache, cache_entry *update) {
+  cache_entry *entry = cache_get_key(cache, update->key);
+  if (!entry) {
+    return;
+  }
+
+  entry->ip_addr = update->ip_addr;
+  entry->type |= update->type;
+  entry->hostname_hash = update->hostname_hash;
+
+  if (update->dhcp_name_hash) {
+    entry->dhcp_name_hash = update->dhcp_name_hash;
+  }
+
+  if (update->last_seen > entry->last_seen) {
+    entry->last_seen = update->last_seen;
+  }
+}
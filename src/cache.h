@@ -0,0 +1,108 @@
+//
+//  arptools
+//
+//  Stuart B. Wilkins, Brookhaven National Laboratory
+//
+//
+//  BSD 3-Clause License
+//
+//  Copyright (c) 2021, Brookhaven Science Associates
+//  All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without
+//  modification, are permitted provided that the following conditions are met:
+//
+//  1. Redistributions of source code must retain the above copyright notice,
+//     this list of conditions and the following disclaimer.
+//
+//  2. Redistributions in binary form must reproduce the above copyright notice,
+//     this list of conditions and the following disclaimer in the documentation
+//     and/or other materials provided with the distribution.
+//
+//  3. Neither the name of the copyright holder nor the names of its
+//     contributors may be used to endorse or promote products derived from
+//     this software without specific prior written permission.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+//  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+//  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+//  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+//  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+//  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+//  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+//  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+//  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+//  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+//  THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+#ifndef SRC_CACHE_H_
+#define SRC_CACHE_H_
+
+#include <stdint.h>
+#include <time.h>
+#include <arpa/inet.h>
+#include <net/ethernet.h>
+
+#include "buffer.h"
+
+/* Macro Definitions */
+
+#define CACHE_NOERR              0
+#define CACHE_ERR_MEMORY         1
+#define CACHE_INITIAL_SIZE       1024
+#define CACHE_MAX_SIZE           (1 << 20)
+
+typedef struct {
+  uint64_t key;
+  struct in_addr ip_addr;
+  int type;
+  uint64_t hostname_hash;
+  uint64_t dhcp_name_hash;
+  time_t last_seen;
+} cache_entry;
+
+typedef struct {
+  cache_entry *data;
+  int size;
+  int used;
+} cache_data;
+
+/* CACHE Functions */
+
+int cache_init(cache_data *cache);
+/*
+ * Initialize the write cache. The cache holds the last values
+ * written to the database for each (hw_address, vlan) key.
+ */
+void cache_free(cache_data *cache);
+cache_entry* cache_get(cache_data *cache, arp_data *arp);
+/*
+ * Return the cache entry for the key of arp, inserting an empty
+ * entry if none exists. Returns NULL if the cache is full and
+ * the entry could not be added.
+ */
+int cache_is_current(cache_entry *entry, arp_data *arp,
+                     const char *hostname, int granularity);
+/*
+ * Returns non-zero if writing arp would only move last_seen forward
+ * by less than granularity seconds.
+ */
+void cache_set(cache_entry *entry, arp_data *arp, const char *hostname);
+/*
+ * Record that arp (with hostname) was written to the database.
+ * hostname may be NULL if the address did not resolve.
+ */
+void cache_stage(cache_entry *update, arp_data *arp, const char *hostname);
+/*
+ * Fill update with what cache_set() would record for arp, so it
+ * can be applied by cache_apply() once the write is committed.
+ */
+void cache_apply(cache_data *cache, cache_entry *update);
+/*
+ * Apply an update made by cache_stage() to the entry of its key,
+ * adding the entry if needed. Dropped if the cache is full.
+ */
+uint64_t cache_hash_string(const char *str);
+
+#endif  // SRC_CACHE_H_
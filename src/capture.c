@@ -37,9 +37,15 @@
 //
 
 #include <pcap.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <signal.h>
 #include <string.h>
 #include <unistd.h>
+#include <time.h>
+#include <sys/time.h>
 #include <sys/ioctl.h>
+#include <sys/epoll.h>
 #include <sys/socket.h>
 #include <netinet/in.h>
 #include <arpa/inet.h>
@@ -51,12 +57,14 @@
 #include <netinet/if_ether.h>
 
 #include "buffer.h"
+#include "registry.h"
+#include "profile.h"
 #include "debug.h"
 #include "arpwatch.h"
 #include "capture.h"
 #include "utils.h"
 
-pcap_t *pcap_description = NULL;
+volatile sig_atomic_t capture_running = 1;
 
 unsigned char mac_zeros[] = {0, 0, 0, 0, 0, 0};
 unsigned char mac_bcast[] = {255, 255, 255, 255, 255, 255};
@@ -70,6 +78,88 @@ int dhcp_message_type[] = {0,  // Padding, no zero msg type
                            BUFFER_TYPE_DHCP_NACK,
                            BUFFER_TYPE_DHCP_RELEASE };
 
+void capture_tag_registration(arpwatch_params *params, arp_data *d) {
+  d->registration = REGISTRY_UNKNOWN;
+
+  if (!params->registration_delay ||
+      !memcmp(d->hw_addr, mac_zeros, ETH_ALEN) ||
+      !memcmp(d->hw_addr, mac_bcast, ETH_ALEN)) {
+    return;
+  }
+
+  d->registration = registry_lookup(params->registry, d->hw_addr);
+
+  if (((d->registration == REGISTRY_UNREGISTERED) ||
+       (d->registration == REGISTRY_NOT_REGISTERED)) &&
+      registry_first_sight(params->registry, d->hw_addr)) {
+    char hw_addr[UTILS_MAC_STRLEN];
+    char ip_addr[INET_ADDRSTRLEN];
+    ALERT_PRINT("%s : %s device %s (%s) on vlan %d\n",
+                params->device,
+                d->registration == REGISTRY_UNREGISTERED ?
+                "Unregistered" : "Not registered",
+                int_to_mac(hw_addr, d->hw_addr),
+                int_to_ip(ip_addr, d->ip_addr),
+                d->vlan);
+  }
+}
+
+void capture_mark_seen(arpwatch_params *params, arp_data *d) {
+  // ARP probes carry the address asked for, not the sender
+
+  if (!d->ip_addr.s_addr || (d->type & BUFFER_TYPE_ARP_PROBE)) {
+    return;
+  }
+
+  for (int i = 0; i < params->num_network; i++) {
+    arpwatch_network *net = &params->network[i];
+    int vlan = net->vlan ? net->vlan : params->native_vlan;
+    if (!net->hosts || (vlan != d->vlan)) {
+      continue;
+    }
+
+    int seen = hosts_seen(net->hosts, d->ip_addr, d->hw_addr,
+                          d->ts.tv_sec);
+    if (seen == HOSTS_RETURNED) {
+      char ip_addr[INET_ADDRSTRLEN];
+      NOTICE_PRINT("%s : Host %s on vlan %d is present again\n",
+                   params->device, int_to_ip(ip_addr, d->ip_addr), d->vlan);
+    }
+
+    if (seen) {
+      break;
+    }
+  }
+}
+
+void capture_advance_head(arpwatch_params *params, arp_data *d,
+                          int unique) {
+  PROFILE_PUSH(PROFILE_REGISTRY);
+  capture_tag_registration(params, d);
+  capture_mark_seen(params, d);
+
+  d->queued = latency_now();
+  if (params->metrics) {
+    latency_record(&params->metrics->latency[LATENCY_CAPTURE],
+                   d->queued - ((int64_t)d->ts.tv_sec * 1000000 +
+                                d->ts.tv_usec));
+  }
+
+  // Types are single bits, index 0 counts BUFFER_TYPE_UNKNOWN
+
+  int type = __builtin_ffs(d->type);
+  if (type < METRICS_PACKET_TYPES) {
+    METRICS_ADD(params->metrics, capture, packets[type], 1);
+  }
+
+  PROFILE_PUSH(PROFILE_BUFFER);
+  if (buffer_advance_head(&params->data_buffer, unique) > 0) {
+    METRICS_ADD(params->metrics, capture, duplicates, 1);
+  }
+  PROFILE_POP();
+  PROFILE_POP();
+}
+
 int ether_header_size(const u_char *packet) {
   struct ethernet_header *hdr = (struct ethernet_header *)packet;
   if (ntohs(hdr->ether_type) == ETHERTYPE_8021Q) {
@@ -83,6 +173,7 @@ int ether_header_size(const u_char *packet) {
 uint16_t ether_get_vlan(arpwatch_params *params, const u_char *packet) {
   struct ethernet_header *hdr = (struct ethernet_header *)packet;
 
+  PROFILE_PUSH(PROFILE_VLAN);
   uint16_t vlan = params->native_vlan;
   if (ntohs(hdr->ether_type) == ETHERTYPE_8021Q) {
     struct ethernet_header_8021q *vlan_hdr =
@@ -91,6 +182,7 @@ uint16_t ether_get_vlan(arpwatch_params *params, const u_char *packet) {
   }
 
   DEBUG_PRINT("VLAN Tag = %d\n", vlan);
+  PROFILE_POP();
   return vlan;
 }
 
@@ -125,7 +217,7 @@ int capture_ethernet_packet(arpwatch_params *params,
   d->ip_addr = zero;
   d->vlan = ether_get_vlan(params, packet);
 
-  buffer_advance_head(data, 1);
+  capture_advance_head(params, d, 1);
 
   return 0;
 }
@@ -158,8 +250,16 @@ int capture_arp_packet(arpwatch_params *params,
                          ether_header_size(packet));
   struct arpbdy *bptr;
 
+  if (pkthdr->caplen < (ether_header_size(packet) + sizeof(struct arphdr) +
+                        sizeof(struct arpbdy))) {
+    DEBUG_PRINT("%s : Short ARP packet\n", params->device);
+    recorder_tag(&params->recorder, RECORDER_ANOMALY_SHORT);
+    return 0;
+  }
+
   if (!ether_arp_is_ipv4(aptr)) {
     ERROR_PRINT("%s : Non IPV4 ARP Packet\n", params->device);
+    recorder_tag(&params->recorder, RECORDER_ANOMALY_ARP);
 
     buffer_data *data = &params->data_buffer;
     arp_data *d = buffer_get_head(data);
@@ -168,7 +268,7 @@ int capture_arp_packet(arpwatch_params *params,
     d->ts = pkthdr->ts;
     *(d->dhcp_name) = '\0';
     d->vlan = ether_get_vlan(params, packet);
-    buffer_advance_head(data, 1);
+    capture_advance_head(params, d, 1);
 
     return 0;
   }
@@ -186,6 +286,7 @@ int capture_arp_packet(arpwatch_params *params,
   bptr = (struct arpbdy *) (packet +
                             ether_header_size(packet) +
                             sizeof(struct arphdr));
+  char ip_addr[INET_ADDRSTRLEN];
 
   //
   // Check for ARP Probes
@@ -198,7 +299,7 @@ int capture_arp_packet(arpwatch_params *params,
                 params->device,
                 pkthdr->ts.tv_sec,
                 ether_ntoa((const struct ether_addr *)&bptr->ar_sha),
-                inet_ntoa(bptr->ar_sip));
+                int_to_ip(ip_addr, bptr->ar_sip));
 
     arp_data *d = buffer_get_head(data);
     d->type = BUFFER_TYPE_ARP_PROBE;
@@ -207,7 +308,7 @@ int capture_arp_packet(arpwatch_params *params,
     d->ts = pkthdr->ts;
     *(d->dhcp_name) = '\0';
     d->vlan = ether_get_vlan(params, packet);
-    buffer_advance_head(data, 1);
+    capture_advance_head(params, d, 1);
 
     return 0;
   }
@@ -227,7 +328,7 @@ int capture_arp_packet(arpwatch_params *params,
                 params->device,
                 pkthdr->ts.tv_sec,
                 ether_ntoa((const struct ether_addr *)&bptr->ar_sha),
-                inet_ntoa(bptr->ar_sip));
+                int_to_ip(ip_addr, bptr->ar_sip));
 
     arp_data *d = buffer_get_head(data);
     d->type = BUFFER_TYPE_ARP_GRAT;
@@ -237,7 +338,7 @@ int capture_arp_packet(arpwatch_params *params,
     *(d->dhcp_name) = '\0';
     d->vlan = ether_get_vlan(params, packet);
 
-    buffer_advance_head(data, 1);
+    capture_advance_head(params, d, 1);
 
     return 0;
   }
@@ -251,7 +352,7 @@ int capture_arp_packet(arpwatch_params *params,
               params->device,
               pkthdr->ts.tv_sec,
               ether_ntoa((const struct ether_addr *)&bptr->ar_sha),
-              inet_ntoa(bptr->ar_sip));
+              int_to_ip(ip_addr, bptr->ar_sip));
 
   arp_data *d = buffer_get_head(data);
   d->type = BUFFER_TYPE_ARP_SRC;
@@ -261,7 +362,7 @@ int capture_arp_packet(arpwatch_params *params,
   *(d->dhcp_name) = '\0';
   d->vlan = ether_get_vlan(params, packet);
 
-  buffer_advance_head(data, 1);
+  capture_advance_head(params, d, 1);
 
   //
   // If we have a ARP Reply we can capture both
@@ -269,12 +370,26 @@ int capture_arp_packet(arpwatch_params *params,
   //
 
   if (htons(aptr->ar_op) == ARPOP_REPLY) {
+    // Match replies to our own probes
+
+    if (!memcmp(bptr->ar_tha, params->hwaddress, ETH_ALEN)) {
+      int64_t rtt = probe_match(&params->probes, bptr->ar_sip.s_addr,
+                                ether_get_vlan(params, packet),
+                                (int64_t)pkthdr->ts.tv_sec * 1000000 +
+                                pkthdr->ts.tv_usec);
+      if (rtt >= 0) {
+        METRICS_ADD(params->metrics, capture, probes_answered, 1);
+        DEBUG_PRINT("Probe reply from %s RTT %ldus\n",
+                    int_to_ip(ip_addr, bptr->ar_sip), (long)rtt);
+      }
+    }
+
     DEBUG_PRINT("Iface : %s Packet time : %ld "
                 "ARP Dest  :  %-20s %-16s\n",
                 params->device,
                 pkthdr->ts.tv_sec,
                 ether_ntoa((const struct ether_addr *)&bptr->ar_tha),
-                inet_ntoa(bptr->ar_tip));
+                int_to_ip(ip_addr, bptr->ar_tip));
 
     arp_data *d = buffer_get_head(data);
     d->type = BUFFER_TYPE_ARP_DST;
@@ -283,7 +398,7 @@ int capture_arp_packet(arpwatch_params *params,
     d->ts = pkthdr->ts;
     *(d->dhcp_name) = '\0';
     d->vlan = ether_get_vlan(params, packet);
-    buffer_advance_head(data, 1);
+    capture_advance_head(params, d, 1);
   }
 
   return 0;
@@ -298,10 +413,11 @@ int capture_epics_pva_packet(arpwatch_params *params,
 
   unsigned int pos = ether_header_size(packet);
   struct ipbdy *iptr = (struct ipbdy *) (packet + pos);
+  char ip_addr[INET_ADDRSTRLEN];
 
   DEBUG_PRINT("EPICS PVA UDP Packet :  %-20s %-16s\n",
               ether_ntoa((const struct ether_addr *)&eptr->ether_shost),
-              inet_ntoa(iptr->ip_sip));
+              int_to_ip(ip_addr, iptr->ip_sip));
 #else
   (void)pkthdr;
   (void)packet;
@@ -327,11 +443,12 @@ int capture_epics_packet(arpwatch_params *params,
 
   pos += sizeof(struct ipbdy);
   pos += sizeof(struct udphdr);
-  if (pos > pkthdr->len ) return -1;
+  if (pos > pkthdr->caplen) return -1;
 
+  char ip_addr[INET_ADDRSTRLEN];
   DEBUG_PRINT("EPICS UDP Packet :  %-20s %-16s\n",
               ether_ntoa((const struct ether_addr *)&eptr->ether_shost),
-              inet_ntoa(iptr->ip_sip));
+              int_to_ip(ip_addr, iptr->ip_sip));
 
   // Set to EPICS TYPE
   buffer_data *data = &params->data_buffer;
@@ -340,7 +457,7 @@ int capture_epics_packet(arpwatch_params *params,
 
   int pv_counter = 0;
 
-  while (pos < pkthdr->len) {
+  while ((pos + sizeof(struct ca_proto_msg)) <= pkthdr->caplen) {
     // Process messages
     struct ca_proto_msg *msg = (struct ca_proto_msg *)
                                (packet + pos);
@@ -352,19 +469,25 @@ int capture_epics_packet(arpwatch_params *params,
       pos += sizeof(struct ca_proto_msg);
 
       if (pv_counter < BUFFER_PV_MAX) {
+        // Only copy what was captured
+        unsigned int size = msg->payload_size;
+        if (size > (pkthdr->caplen - pos)) {
+          size = pkthdr->caplen - pos;
+          recorder_tag(&params->recorder, RECORDER_ANOMALY_EPICS);
+        }
         memset(d->pv_name[pv_counter], 0, BUFFER_PV_NAME_MAX);
         memcpy(d->pv_name[pv_counter], packet + pos,
-               msg->payload_size > BUFFER_PV_NAME_MAX ?
-               BUFFER_PV_NAME_MAX : msg->payload_size);
+               size > BUFFER_PV_NAME_MAX ? BUFFER_PV_NAME_MAX : size);
         pos += msg->payload_size;
-        const char *hw_addr = int_to_mac(d->hw_addr);
+        char hw_addr[UTILS_MAC_STRLEN];
         DEBUG_PRINT("EPICS PV on %s : %s\n",
-                    hw_addr,
+                    int_to_mac(hw_addr, d->hw_addr),
                     d->pv_name[pv_counter]);
         pv_counter++;
       } else {
         ERROR_PRINT("Number of PVs exceeded limit of %d\n",
                     BUFFER_PV_MAX);
+        recorder_tag(&params->recorder, RECORDER_ANOMALY_EPICS);
       }
     } else {
       break;
@@ -394,11 +517,12 @@ int capture_epics_beacon_packet(arpwatch_params *params,
 
   pos += sizeof(struct ipbdy);
   pos += sizeof(struct udphdr);
-  if (pos > pkthdr->len ) return -1;
+  if (pos > pkthdr->caplen) return -1;
 
+  char ip_addr[INET_ADDRSTRLEN];
   DEBUG_PRINT("EPICS BEACON Packet :  %-20s %-16s\n",
               ether_ntoa((const struct ether_addr *)&eptr->ether_shost),
-              inet_ntoa(iptr->ip_sip));
+              int_to_ip(ip_addr, iptr->ip_sip));
 
 #ifndef DEBUG
   (void)iptr;
@@ -419,6 +543,13 @@ int capture_dhcp_packet(arpwatch_params *params,
   buffer_data *data = &params->data_buffer;
   arp_data *d = buffer_get_head(data);
 
+  if (pkthdr->caplen < (ether_header_size(packet) + sizeof(struct ipbdy) +
+                        sizeof(struct udphdr) + sizeof(struct dhcpbdy))) {
+    DEBUG_COMMENT("Short DHCP packet\n");
+    recorder_tag(&params->recorder, RECORDER_ANOMALY_SHORT);
+    return -1;
+  }
+
 #ifdef DEBUG
   struct dhcpbdy *dptr = (struct dhcpbdy *)(packet
                           + ether_header_size(packet)
@@ -449,17 +580,28 @@ int capture_dhcp_packet(arpwatch_params *params,
             + sizeof(struct udphdr)
             + sizeof(struct dhcpbdy);
 
-  while ((int)pkthdr->len > pos) {
+  while ((int)pkthdr->caplen > pos) {
     uint8_t code = *optr;
     optr++;
-    uint8_t len = *optr;
-    optr++;
 
     DEBUG_PRINT("DHCP OPTION %d\n", code);
 
     if (code == DHCP_OPCODE_END) {
       break;
-    } else if (code == DHCP_OPCODE_HOSTNAME) {
+    }
+
+    // Stop at options truncated by the snaplen
+
+    if ((pos + 2) > (int)pkthdr->caplen) {
+      break;
+    }
+    uint8_t len = *optr;
+    optr++;
+    if ((pos + 2 + len) > (int)pkthdr->caplen) {
+      break;
+    }
+
+    if (code == DHCP_OPCODE_HOSTNAME) {
       char _name[BUFFER_NAME_MAX];
       if (len < (sizeof(_name)- 1)) {
         memcpy(_name, optr, len);
@@ -468,6 +610,7 @@ int capture_dhcp_packet(arpwatch_params *params,
         DEBUG_PRINT("DHCP Hostname : %s\n", _name);
       } else {
         ERROR_COMMENT("DHCP Name too long\n");
+        recorder_tag(&params->recorder, RECORDER_ANOMALY_DHCP);
       }
     } else if (code == DHCP_OPCODE_MESSAGE_TYPE) {
       if (len == 1) {
@@ -486,6 +629,12 @@ int capture_dhcp_packet(arpwatch_params *params,
     pos += 2 + len;
   }
 
+  // No valid message type
+
+  if (d->type == BUFFER_TYPE_DHCP_ERR) {
+    recorder_tag(&params->recorder, RECORDER_ANOMALY_DHCP);
+  }
+
   return 0;
 }
 
@@ -496,13 +645,20 @@ int capture_ip_packet(arpwatch_params *params,
   struct ipbdy *iptr = (struct ipbdy *) (packet +
                                          ether_header_size(packet));
 
+  if (pkthdr->caplen < (ether_header_size(packet) + sizeof(struct ipbdy))) {
+    DEBUG_PRINT("%s : Short IP packet\n", params->device);
+    recorder_tag(&params->recorder, RECORDER_ANOMALY_SHORT);
+    return 0;
+  }
+
   // Process any IP Packets that are broadcast
 
+  char ip_addr[INET_ADDRSTRLEN];
   DEBUG_PRINT("Iface : %s Packet time : %ld Broadcast Source:  %-20s %-16s\n",
               params->device,
               pkthdr->ts.tv_sec,
               ether_ntoa((const struct ether_addr *)&eptr->ether_shost),
-              inet_ntoa(iptr->ip_sip));
+              int_to_ip(ip_addr, iptr->ip_sip));
 
   buffer_data *data = &params->data_buffer;
   arp_data *d = buffer_get_head(data);
@@ -525,43 +681,67 @@ int capture_ip_packet(arpwatch_params *params,
 
   // Further process to determine type
 
-  if (iptr->proto == IP_PROTO_UDP) {
+  if ((iptr->proto == IP_PROTO_UDP) &&
+      (pkthdr->caplen >= (ether_header_size(packet) + sizeof(struct ipbdy) +
+                          sizeof(struct udphdr)))) {
     // We have a UDP Packet
     struct udphdr *uptr = (struct udphdr *)(packet
                           + ether_header_size(packet)
                           + sizeof(struct ipbdy));
 
     d->type = BUFFER_TYPE_UDP;
+    PROFILE_CLASS(PROFILE_CLASS_UDP);
 
     DEBUG_PRINT("Iface : %s %d UDP %d -> %d\n", params->device,
-                sizeof(struct ipbdy),
+                (int)sizeof(struct ipbdy),
                 htons(uptr->sport), htons(uptr->dport));
 
     if ((htons(uptr->sport) == DHCP_DISCOVER_SPORT) &&
         (htons(uptr->dport) == DHCP_DISCOVER_DPORT)) {
+      PROFILE_CLASS(PROFILE_CLASS_DHCP);
+      PROFILE_PUSH(PROFILE_DHCP);
       capture_dhcp_packet(params, pkthdr, packet);
+      PROFILE_POP();
     } else if (htons(uptr->dport) == EPICS_DPORT) {
+      PROFILE_CLASS(PROFILE_CLASS_EPICS);
+      PROFILE_PUSH(PROFILE_EPICS);
       capture_epics_packet(params, pkthdr, packet);
+      PROFILE_POP();
     } else if (htons(uptr->dport) == EPICS_PVA_DPORT) {
+      PROFILE_CLASS(PROFILE_CLASS_EPICS);
+      PROFILE_PUSH(PROFILE_EPICS);
       capture_epics_pva_packet(params, pkthdr, packet);
+      PROFILE_POP();
     } else if (htons(uptr->dport) == EPICS_BEACON_DPORT) {
+      PROFILE_CLASS(PROFILE_CLASS_EPICS);
+      PROFILE_PUSH(PROFILE_EPICS);
       capture_epics_beacon_packet(params, pkthdr, packet);
+      PROFILE_POP();
     }
   }
 
-  buffer_advance_head(data, 0);  // We capture all packets!
+  capture_advance_head(params, d, 0);  // We capture all packets!
 
   return 0;
 }
 
-void capture_callback(u_char *args, const struct pcap_pkthdr* pkthdr,
-                     const u_char* packet) {
-  arpwatch_params *params = (arpwatch_params*)args;
-
+static void capture_packet(arpwatch_params *params,
+                           const struct pcap_pkthdr* pkthdr,
+                           const u_char* packet) {
   struct ethernet_header *eptr = (struct ethernet_header *) packet;
 
+  // Decoders only look at the captured part of the packet
+
+  if (pkthdr->caplen < sizeof(struct ethernet_header)) {
+    return;
+  }
+
   uint16_t type = ntohs(eptr->ether_type);
   if (type == ETHERTYPE_8021Q) {
+    if (pkthdr->caplen < sizeof(struct ethernet_header_8021q)) {
+      return;
+    }
+
     // If we ignore tagged packets, just return
     if (params->ignore_tagged) {
       return;
@@ -586,9 +766,15 @@ void capture_callback(u_char *args, const struct pcap_pkthdr* pkthdr,
   }
 
   if (type == ETHERTYPE_IP) {
+    PROFILE_CLASS(PROFILE_CLASS_IP);
+    PROFILE_PUSH(PROFILE_IP);
     capture_ip_packet(params, pkthdr, packet);
+    PROFILE_POP();
   } else if (type == ETHERTYPE_ARP) {
+    PROFILE_CLASS(PROFILE_CLASS_ARP);
+    PROFILE_PUSH(PROFILE_ARP);
     capture_arp_packet(params, pkthdr, packet);
+    PROFILE_POP();
   } else {
     // Fallback to just log MAC address
     DEBUG_PRINT("Unknown packet type 0x%0X\n", type);
@@ -596,12 +782,179 @@ void capture_callback(u_char *args, const struct pcap_pkthdr* pkthdr,
   }
 }
 
-int capture_start(arpwatch_params *params) {
+static uint32_t capture_frame_hash(const u_char *packet, uint32_t len) {
+  // FNV-1a over the start of the frame
+
+  uint32_t hash = 2166136261U;
+  len = len < CAPTURE_HASH_LEN ? len : CAPTURE_HASH_LEN;
+  for (uint32_t i = 0; i < len; i++) {
+    hash = (hash ^ packet[i]) * 16777619U;
+  }
+
+  return hash;
+}
+
+static int capture_seen(arpwatch_params *params,
+                        const struct pcap_pkthdr *pkthdr,
+                        const u_char *packet) {
+  arpwatch_frame_id *seen = params->pcap_seen;
+
+  // While the old handle is drained remember what it delivered
+
+  if (params->pcap_draining) {
+    if (params->pcap_seen_num < CAPTURE_DRAIN_MAX) {
+      arpwatch_frame_id *f = &seen[params->pcap_seen_num++];
+      f->ts = pkthdr->ts;
+      f->caplen = pkthdr->caplen;
+      f->hash = capture_frame_hash(packet, pkthdr->caplen);
+    }
+    return 0;
+  }
+
+  //
+  // Both handles deliver in time order, so walk the drained frames
+  // alongside the new handle. Once it is past the last of them the
+  // overlap is over.
+  //
+
+  int pos = params->pcap_seen_pos;
+  while ((pos < params->pcap_seen_num) &&
+         timercmp(&seen[pos].ts, &pkthdr->ts, <)) {
+    pos++;
+  }
+  params->pcap_seen_pos = pos;
+
+  if (pos == params->pcap_seen_num) {
+    params->pcap_seen_num = 0;
+    return 0;
+  }
+
+  uint32_t hash = capture_frame_hash(packet, pkthdr->caplen);
+  for (int i = pos; (i < params->pcap_seen_num) &&
+       timercmp(&seen[i].ts, &pkthdr->ts, ==); i++) {
+    if ((seen[i].caplen == pkthdr->caplen) && (seen[i].hash == hash)) {
+      seen[i].caplen = 0;
+      return 1;
+    }
+  }
+
+  return 0;
+}
+
+void capture_callback(u_char *args, const struct pcap_pkthdr* pkthdr,
+                     const u_char* packet) {
+  arpwatch_params *params = (arpwatch_params*)args;
+
+  // After the handle is replaced the new one delivers the frames
+  // both saw again
+
+  if ((params->pcap_seen_num || params->pcap_draining) &&
+      capture_seen(params, pkthdr, packet)) {
+    return;
+  }
+
+  PROFILE_BEGIN();
+  recorder_add(&params->recorder, pkthdr, packet);
+  capture_packet(params, pkthdr, packet);
+  PROFILE_END();
+}
+
+static int capture_filter(pcap_t *pcap, const char *device,
+                          const char *program) {
   char errbuf[PCAP_ERRBUF_SIZE];
   struct bpf_program fp;
   bpf_u_int32 maskp;
   bpf_u_int32 netp;
 
+  // Get the IP address and netmask of the interface
+  pcap_lookupnet(device, &netp, &maskp, errbuf);
+
+  // Compile the pcap program
+  if (pcap_compile(pcap, &fp, program, 0, netp) == -1) {
+    ERROR_PRINT("pcap_compile() : ERROR : %s\n", pcap_geterr(pcap));
+    return -1;
+  }
+
+  // Filter based on compiled program, the kernel swaps
+  // the filter atomically
+  if (pcap_setfilter(pcap, &fp) == -1) {
+    ERROR_PRINT("pcap_setfilter() : ERROR : %s\n", pcap_geterr(pcap));
+    pcap_freecode(&fp);
+    return -1;
+  }
+
+  pcap_freecode(&fp);
+  return 0;
+}
+
+int capture_set_filter(arpwatch_params *params, const char *program) {
+  return capture_filter(params->pcap, params->device, program);
+}
+
+static pcap_t* capture_create(arpwatch_params *params) {
+  char errbuf[PCAP_ERRBUF_SIZE];
+  pcap_t *pcap = NULL;
+  pcap_t *rtn = NULL;
+
+  pcap = pcap_create(params->device, errbuf);
+  if (pcap == NULL) {
+    ERROR_PRINT("pcap_create(): ERROR : %s\n", errbuf);
+    goto _error;
+  }
+
+  // Only the headers are decoded, no need to copy jumbo frames
+
+  pcap_set_snaplen(pcap, CAPTURE_SNAPLEN);
+  pcap_set_promisc(pcap, 1);
+  pcap_set_timeout(pcap, params->pcap_timeout);
+  pcap_set_buffer_size(pcap, params->pcap_buffer_size);
+  pcap_set_immediate_mode(pcap, params->pcap_immediate);
+
+  if (params->pcap_tstamp_type[0]) {
+    int type = pcap_tstamp_type_name_to_val(params->pcap_tstamp_type);
+    if ((type == PCAP_ERROR) || pcap_set_tstamp_type(pcap, type)) {
+      ERROR_PRINT("%s : Timestamp type %s not supported\n",
+                  params->device, params->pcap_tstamp_type);
+    }
+  }
+
+  int err = pcap_activate(pcap);
+  if (err < 0) {
+    ERROR_PRINT("pcap_activate(): ERROR : %s : %s\n", params->device,
+                pcap_geterr(pcap));
+    goto _error;
+  } else if (err > 0) {
+    NOTICE_PRINT("%s : pcap_activate() : %s\n", params->device,
+                 pcap_geterr(pcap));
+  }
+
+  DEBUG_PRINT("Opened interface : %s with %d byte buffer\n",
+              params->device, params->pcap_buffer_size);
+
+  if (capture_filter(pcap, params->device, params->program)) {
+    goto _error;
+  }
+
+  // We poll the selectable fd, so read without blocking
+  if (pcap_setnonblock(pcap, 1, errbuf) == -1) {
+    ERROR_PRINT("pcap_setnonblock(): ERROR : %s\n", errbuf);
+    goto _error;
+  }
+
+  rtn = pcap;
+  pcap = NULL;
+
+_error:
+  if (pcap) {
+    pcap_close(pcap);
+  }
+
+  return rtn;
+}
+
+int capture_open(arpwatch_params *params) {
+  char errbuf[PCAP_ERRBUF_SIZE];
+
   pcap_if_t *interfaces = NULL, *temp;
 
   int rtn = -1;
@@ -635,51 +988,219 @@ int capture_start(arpwatch_params *params) {
   strncpy(ifr.ifr_name, params->device, IFNAMSIZ);
   ioctl(s, SIOCGIFHWADDR, &ifr);
   memcpy(params->hwaddress, ifr.ifr_hwaddr.sa_data, ETH_ALEN);
+  char hw_addr[UTILS_MAC_STRLEN];
   DEBUG_PRINT("MAC Address of %s : %s\n",
               params->device,
-              int_to_mac(params->hwaddress));
+              int_to_mac(hw_addr, params->hwaddress));
   close(s);
 
-  // Get the IP address and netmask of the interface
-  pcap_lookupnet(params->device, &netp, &maskp, errbuf);
-
-  pcap_description = pcap_open_live(params->device, BUFSIZ, 1,
-                         params->pcap_timeout, errbuf);
-  if (pcap_description == NULL) {
-    ERROR_PRINT("pcap_open_live(): ERROR : %s\n", errbuf);
+  params->pcap = capture_create(params);
+  if (params->pcap == NULL) {
     goto _error;
   }
 
-  DEBUG_PRINT("Opened interface : %s\n", params->device);
+  rtn = 0;
 
-  // Compile the pcap program
-  if (pcap_compile(pcap_description, &fp, params->program, 0, netp) == -1) {
-    ERROR_COMMENT("pcap_compile() : ERROR\n");
-    goto _error;
+_error:
+  if (interfaces) pcap_freealldevs(interfaces);
+  if (rtn && params->pcap) {
+    pcap_close(params->pcap);
+    params->pcap = NULL;
   }
 
-  // Filter based on compiled program
-  if (pcap_setfilter(pcap_description, &fp) == -1) {
-    ERROR_COMMENT("pcap_setfilter() : ERROR\n");
-    goto _error;
+  return rtn;
+}
+
+void capture_close(arpwatch_params *params) {
+  if (params->pcap) {
+    pcap_close(params->pcap);
+    params->pcap = NULL;
   }
 
-  NOTICE_PRINT("Starting capture on : %s\n", params->device);
-  pcap_loop(pcap_description, -1, capture_callback,
-            (u_char*)(params));
+  free(params->pcap_seen);
+  params->pcap_seen = NULL;
+  params->pcap_seen_num = 0;
+}
+
+static void capture_check_drops(arpwatch_params *params, int epfd) {
+  struct pcap_stat ps;
+
+  if (pcap_stats(params->pcap, &ps)) {
+    DEBUG_PRINT("%s : pcap_stats(): ERROR : %s\n", params->device,
+                pcap_geterr(params->pcap));
+    return;
+  }
+
+  // The counters only go up while the handle is open
+
+  unsigned int drop = ps.ps_drop - params->pcap_drop;
+  unsigned int ifdrop = ps.ps_ifdrop - params->pcap_ifdrop;
+  params->pcap_drop = ps.ps_drop;
+  params->pcap_ifdrop = ps.ps_ifdrop;
+  METRICS_ADD(params->metrics, capture, kernel_drops, drop);
+  METRICS_ADD(params->metrics, capture, interface_drops, ifdrop);
+
+  if (!drop && !ifdrop) {
+    return;
+  }
+
+  ALERT_PRINT("%s : Kernel dropped %u packets, interface dropped %u\n",
+              params->device, drop, ifdrop);
+
+  // A bigger buffer only helps with drops in the kernel
+
+  if (!drop || (params->pcap_buffer_size >= params->pcap_buffer_max)) {
+    return;
+  }
+
+  int size = params->pcap_buffer_size;
+  params->pcap_buffer_size = (size > (params->pcap_buffer_max / 2)) ?
+                             params->pcap_buffer_max : size * 2;
+
+  // Open the new handle before closing the old one so that no
+  // packets are missed during the swap. Frames seen by both are
+  // matched by time, length and hash and skipped on the new one.
+
+  pcap_t *pcap = capture_create(params);
+  if (!pcap) {
+    ERROR_PRINT("%s : Unable to grow kernel buffer to %d bytes\n",
+                params->device, params->pcap_buffer_size);
+    params->pcap_buffer_size = size;
+    params->pcap_buffer_max = size;
+    return;
+  }
+
+  struct epoll_event ev;
+  ev.events = EPOLLIN;
+  ev.data.ptr = params;
+  if (epoll_ctl(epfd, EPOLL_CTL_ADD, pcap_get_selectable_fd(pcap),
+                &ev) == -1) {
+    // Keep capturing on the old handle
+    ERROR_PRINT("%s : epoll_ctl(): ERROR : %s\n", params->device,
+                strerror(errno));
+    pcap_close(pcap);
+    params->pcap_buffer_size = size;
+    params->pcap_buffer_max = size;
+    return;
+  }
+
+  if (!params->pcap_seen) {
+    params->pcap_seen = malloc(CAPTURE_DRAIN_MAX *
+                               sizeof(arpwatch_frame_id));
+  }
+
+  //
+  // One bounded pass over what is left on the old handle. Under
+  // heavy traffic it keeps filling, the rest is read from the
+  // new handle.
+  //
+
+  params->pcap_seen_num = 0;
+  params->pcap_seen_pos = 0;
+  params->pcap_draining = (params->pcap_seen != NULL);
+  pcap_dispatch(params->pcap, CAPTURE_DRAIN_MAX, capture_callback,
+                (u_char*)params);
+  params->pcap_draining = 0;
+
+  epoll_ctl(epfd, EPOLL_CTL_DEL, pcap_get_selectable_fd(params->pcap), NULL);
+  pcap_close(params->pcap);
+  params->pcap = pcap;
+  params->pcap_drop = 0;
+  params->pcap_ifdrop = 0;
+
+  NOTICE_PRINT("%s : Kernel buffer grown to %d bytes\n",
+               params->device, params->pcap_buffer_size);
+}
+
+int capture_loop(arpwatch_params *params, int num_params) {
+  struct epoll_event events[CAPTURE_MAX_EVENTS];
+  time_t last_stats = time(NULL);
+  int rtn = -1;
+
+  int epfd = epoll_create1(0);
+  if (epfd == -1) {
+    ERROR_PRINT("epoll_create1(): ERROR : %s\n", strerror(errno));
+    return -1;
+  }
+
+  for (int i = 0; i < num_params; i++) {
+    struct epoll_event ev;
+    int fd = pcap_get_selectable_fd(params[i].pcap);
+    if (fd == -1) {
+      ERROR_PRINT("%s : No selectable fd\n", params[i].device);
+      goto _error;
+    }
+
+    ev.events = EPOLLIN;
+    ev.data.ptr = &params[i];
+    if (epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &ev) == -1) {
+      ERROR_PRINT("epoll_ctl(): ERROR : %s\n", strerror(errno));
+      goto _error;
+    }
+
+    NOTICE_PRINT("Starting capture on : %s\n", params[i].device);
+  }
+
+  while (capture_running) {
+    int n = epoll_wait(epfd, events, CAPTURE_MAX_EVENTS,
+                       CAPTURE_POLL_TIMEOUT);
+    if (n == -1) {
+      if (errno == EINTR) {
+        continue;
+      }
+      ERROR_PRINT("epoll_wait(): ERROR : %s\n", strerror(errno));
+      goto _error;
+    }
+
+    for (int i = 0; i < n; i++) {
+      arpwatch_params *p = (arpwatch_params *)events[i].data.ptr;
+      if (pcap_dispatch(p->pcap, -1, capture_callback,
+                        (u_char*)p) == PCAP_ERROR) {
+        ERROR_PRINT("%s : pcap_dispatch(): ERROR : %s\n",
+                    p->device, pcap_geterr(p->pcap));
+      }
+    }
+
+    // Tell the watchdog capture is not stuck
+
+    uint64_t heartbeat = metrics_clock();
+    for (int i = 0; i < num_params; i++) {
+      METRICS_SET(params[i].metrics, capture, heartbeat, heartbeat);
+    }
+
+    time_t now = time(NULL);
+    if ((now - last_stats) >= CAPTURE_STATS_INTERVAL) {
+      for (int i = 0; i < num_params; i++) {
+        capture_check_drops(&params[i], epfd);
+      }
+      last_stats = now;
+    }
+
+    PROFILE_CHECK(params[0].device);
+
+    if (recorder_dump_flag) {
+      recorder_dump_flag = 0;
+      for (int i = 0; i < num_params; i++) {
+        recorder_dump(&params[i].recorder, params[i].device,
+                      params[i].journal_dir);
+      }
+    }
+  }
 
   rtn = 0;
 
 _error:
-  if (interfaces) pcap_freealldevs(interfaces);
-
+  close(epfd);
   return rtn;
 }
 
 int capture_stop(void) {
-  if (pcap_description) {
-    pcap_breakloop(pcap_description);
-  }
+  // Called from signal handlers
+  capture_running = 0;
+  return 0;
+}
 
+int capture_resume(void) {
+  capture_running = 1;
   return 0;
 }
@@ -60,6 +60,12 @@
 #define EPICS_DPORT                 5064
 #define EPICS_BEACON_DPORT          5065
 #define EPICS_PVA_DPORT             5076
+#define CAPTURE_MAX_EVENTS          16
+#define CAPTURE_POLL_TIMEOUT        1000
+#define CAPTURE_SNAPLEN             1518  // Tagged ethernet frame
+#define CAPTURE_STATS_INTERVAL      10    // Seconds
+#define CAPTURE_DRAIN_MAX           4096  // Frames drained from an old handle
+#define CAPTURE_HASH_LEN            64    // Bytes of a frame hashed to match it
 
 struct ethernet_header {
   uint8_t ether_dhost[ETH_ALEN];
@@ -157,7 +163,34 @@ struct ca_proto_search {
   uint32_t cid2;
 } __attribute__((__packed__));
 
-int capture_start(arpwatch_params *params);
+int capture_open(arpwatch_params *params);
+/*
+ * Open the pcap handle for the device in params with a kernel
+ * buffer of pcap_buffer_size and install the filter program.
+ */
+int capture_loop(arpwatch_params *params, int num_params);
+/*
+ * Capture on all num_params interfaces in params from a single
+ * epoll loop until capture_stop() is called. capture_stop() is
+ * async signal safe, capture_resume() allows the loop to be
+ * entered again. Kernel drops are checked every
+ * CAPTURE_STATS_INTERVAL and the kernel buffer of an interface
+ * dropping packets is doubled up to pcap_buffer_max.
+ */
+void capture_close(arpwatch_params *params);
+void capture_callback(u_char *args, const struct pcap_pkthdr* pkthdr,
+                      const u_char* packet);
+/*
+ * Decode one packet onto the buffer, args is the arpwatch_params of
+ * the interface. Called by pcap_dispatch() and by the benchmarks
+ * to replay saved captures.
+ */
+int capture_set_filter(arpwatch_params *params, const char *program);
+/*
+ * Compile program and install it on the open pcap handle. The
+ * previous filter stays in place if this fails.
+ */
 int capture_stop(void);
+int capture_resume(void);
 
 #endif  // SRC_CAPTURE_H_
@@ -53,74 +53,96 @@ extern int debug_flag;
 #define SD_DEBUG   ""
 #endif
 
+#include "log.h"
+
 #ifndef __FILENAME__
 #define __FILENAME__      __FILE__
 #endif
 
+//
+// All messages go through log_print(), which queues them for the
+// log writer thread and limits the rate of each call site. Each
+// expansion has its own static log_site.
+//
+
+#define LOG_SITE_PRINT(fmt, ...) \
+  do { \
+    static log_site _log_site = {__FILENAME__, __LINE__, \
+                                 0, 0, 0, NULL, 0}; \
+    log_print(&_log_site, fmt, __VA_ARGS__); \
+  } while (0)
+
 #ifdef DEBUG
 
 #define DEBUG_PRINT(fmt, ...) \
-  if (debug_flag) fprintf(stderr, SD_DEBUG " %s:%-4d:%s(): " fmt, \
-          __FILENAME__, __LINE__, __func__, __VA_ARGS__);
+  do { \
+    if (debug_flag) LOG_SITE_PRINT(SD_DEBUG " %s:%-4d:%s(): " fmt, \
+          __FILENAME__, __LINE__, __func__, __VA_ARGS__); \
+  } while (0)
 
 #define DEBUG_COMMENT(txt) \
-  if (debug_flag) fprintf(stderr, SD_DEBUG " %s:%-4d:%s(): %s", \
-          __FILENAME__, __LINE__, __func__, txt);
+  do { \
+    if (debug_flag) LOG_SITE_PRINT(SD_DEBUG " %s:%-4d:%s(): %s", \
+          __FILENAME__, __LINE__, __func__, txt); \
+  } while (0)
 
 #define NOTICE_PRINT(fmt, ...) \
-  fprintf(stderr, SD_NOTICE " %s:%-4d:%s(): " fmt, \
-          __FILENAME__, __LINE__, __func__, __VA_ARGS__);
+  LOG_SITE_PRINT(SD_NOTICE " %s:%-4d:%s(): " fmt, \
+          __FILENAME__, __LINE__, __func__, __VA_ARGS__)
 
 #define NOTICE_COMMENT(txt) \
-  fprintf(stderr, SD_NOTICE " %s:%-4d:%s(): %s", \
-          __FILENAME__, __LINE__, __func__, txt);
+  LOG_SITE_PRINT(SD_NOTICE " %s:%-4d:%s(): %s", \
+          __FILENAME__, __LINE__, __func__, txt)
 
 #define ERROR_PRINT(fmt, ...) \
-  fprintf(stderr, SD_ERR " %s:%-4d:%s(): " fmt, \
-          __FILENAME__, __LINE__, __func__, __VA_ARGS__);
+  LOG_SITE_PRINT(SD_ERR " %s:%-4d:%s(): " fmt, \
+          __FILENAME__, __LINE__, __func__, __VA_ARGS__)
 
 #define ERROR_COMMENT(txt) \
-  fprintf(stderr, SD_ERR " %s:%-4d:%s(): %s", \
-          __FILENAME__, __LINE__, __func__, txt);
+  LOG_SITE_PRINT(SD_ERR " %s:%-4d:%s(): %s", \
+          __FILENAME__, __LINE__, __func__, txt)
 
 #define ALERT_PRINT(fmt, ...) \
-  fprintf(stderr, SD_ALERT " %s:%-4d:%s(): " fmt, \
-          __FILENAME__, __LINE__, __func__, __VA_ARGS__);
+  LOG_SITE_PRINT(SD_ALERT " %s:%-4d:%s(): " fmt, \
+          __FILENAME__, __LINE__, __func__, __VA_ARGS__)
 
 #define ALERT_COMMENT(txt) \
-  fprintf(stderr, SD_ALERT " %s:%-4d:%s(): %s", \
-          __FILENAME__, __LINE__, __func__, txt);
+  LOG_SITE_PRINT(SD_ALERT " %s:%-4d:%s(): %s", \
+          __FILENAME__, __LINE__, __func__, txt)
 
 #else
 
 #define DEBUG_PRINT(fmt, ...) \
-  if (debug_flag) fprintf(stderr, SD_DEBUG " " fmt, \
-          __VA_ARGS__);
+  do { \
+    if (debug_flag) LOG_SITE_PRINT(SD_DEBUG " " fmt, __VA_ARGS__); \
+  } while (0)
 
 #define DEBUG_COMMENT(txt) \
-  if (debug_flag) fprintf(stderr, SD_DEBUG " %s", txt);
+  do { \
+    if (debug_flag) LOG_SITE_PRINT(SD_DEBUG " %s", txt); \
+  } while (0)
 
 #define NOTICE_PRINT(fmt, ...) \
-  fprintf(stderr, SD_NOTICE " " fmt, \
-          __VA_ARGS__);
+  LOG_SITE_PRINT(SD_NOTICE " " fmt, \
+          __VA_ARGS__)
 
 #define NOTICE_COMMENT(txt) \
-  fprintf(stderr, SD_NOTICE " %s", txt);
+  LOG_SITE_PRINT(SD_NOTICE " %s", txt)
 
 #define ERROR_PRINT(fmt, ...) \
-  fprintf(stderr, SD_ERR " %s(): " fmt, \
-          __func__, __VA_ARGS__);
+  LOG_SITE_PRINT(SD_ERR " %s(): " fmt, \
+          __func__, __VA_ARGS__)
 
 #define ERROR_COMMENT(txt) \
-  fprintf(stderr, SD_ERR " %s(): %s", \
-          __func__, txt);
+  LOG_SITE_PRINT(SD_ERR " %s(): %s", \
+          __func__, txt)
 
 #define ALERT_PRINT(fmt, ...) \
-  fprintf(stderr, SD_ERR " %s(): " fmt, \
-          __func__, __VA_ARGS__);
+  LOG_SITE_PRINT(SD_ALERT " %s(): " fmt, \
+          __func__, __VA_ARGS__)
 
 #define ALERT_COMMENT(txt) \
-  fprintf(stderr, SD_ALERT " %s", txt);
+  LOG_SITE_PRINT(SD_ALERT " %s", txt)
 
 #endif
 
@@ -0,0 +1,262 @@
+//
+//  arptools
+//
+//  Stuart B. Wilkins, Brookhaven National Laboratory
+//
+//
+//  BSD 3-Clause License
+//
+//  Copyright (c) 2021, Brookhaven Science Associates
+//  All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without
+//  modification, are permitted provided that the following conditions are met:
+//
+//  1. Redistributions of source code must retain the above copyright notice,
+//     this list of conditions and the following disclaimer.
+//
+//  2. Redistributions in binary form must reproduce the above copyright notice,
+//     this list of conditions and the following disclaimer in the documentation
+//     and/or other materials provided with the distribution.
+//
+//  3. Neither the name of the copyright holder nor the names of its
+//     contributors may be used to endorse or promote products derived from
+//     this software without specific prior written permission.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+//  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+//  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+//  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+//  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+//  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+//  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+//  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+//  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+//  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+//  THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <net/ethernet.h>
+
+#include "hosts.h"
+#include "debug.h"
+
+int hosts_init(hosts_data *hosts) {
+  hosts->net = NULL;
+  hosts->num_net = 0;
+  return HOSTS_NOERR;
+}
+
+static void hosts_free_network(hosts_network *hn) {
+  free(hn->last_seen);
+  free(hn->srtt);
+  free(hn->hw_addr);
+  free(hn->probe);
+  free(hn);
+}
+
+void hosts_free(hosts_data *hosts) {
+  for (int i = 0; i < hosts->num_net; i++) {
+    hosts_free_network(hosts->net[i]);
+  }
+
+  free(hosts->net);
+  hosts->net = NULL;
+  hosts->num_net = 0;
+}
+
+hosts_network* hosts_add(hosts_data *hosts, uint32_t base,
+                         uint32_t num_hosts, int vlan) {
+  for (int i = 0; i < hosts->num_net; i++) {
+    hosts_network *hn = hosts->net[i];
+    if ((hn->base == base) && (hn->num_hosts == num_hosts) &&
+        (hn->vlan == vlan)) {
+      hn->retired = 0;
+      return hn;
+    }
+  }
+
+  if (!num_hosts || (num_hosts > HOSTS_MAX_HOSTS)) {
+    DEBUG_PRINT("Not tracking network of %u hosts\n", num_hosts);
+    return NULL;
+  }
+
+  hosts_network **net = realloc(hosts->net, sizeof(hosts_network *) *
+                                (hosts->num_net + 1));
+  if (!net) {
+    goto _error;
+  }
+  hosts->net = net;
+
+  hosts_network *hn = calloc(1, sizeof(hosts_network));
+  if (!hn) {
+    goto _error;
+  }
+
+  hn->base = base;
+  hn->num_hosts = num_hosts;
+  hn->vlan = vlan;
+  hn->last_seen = calloc(num_hosts, sizeof(uint32_t));
+  hn->srtt = calloc(num_hosts, sizeof(uint32_t));
+  hn->hw_addr = calloc(num_hosts, sizeof(uint64_t));
+  hn->probe = calloc(num_hosts, sizeof(hosts_probe));
+  if (!hn->last_seen || !hn->srtt || !hn->hw_addr || !hn->probe) {
+    free(hn->last_seen);
+    free(hn->srtt);
+    free(hn->hw_addr);
+    free(hn->probe);
+    free(hn);
+    goto _error;
+  }
+
+  hosts->net[hosts->num_net++] = hn;
+  return hn;
+
+_error:
+  ERROR_COMMENT("Unable to allocate memory for host state\n");
+  return NULL;
+}
+
+void hosts_retire(hosts_network *hn) {
+  hn->retired = 1;
+}
+
+int hosts_collect(hosts_data *hosts) {
+  int n = 0;
+  for (int i = 0; i < hosts->num_net; i++) {
+    if (hosts->net[i]->retired) {
+      hosts_free_network(hosts->net[i]);
+    } else {
+      hosts->net[n++] = hosts->net[i];
+    }
+  }
+
+  int freed = hosts->num_net - n;
+  hosts->num_net = n;
+  return freed;
+}
+
+static void hosts_miss(hosts_probe *p) {
+  if (p->miss < UINT8_MAX) {
+    p->miss++;
+  }
+
+  int backoff = p->miss < HOSTS_BACKOFF_MAX ? p->miss : HOSTS_BACKOFF_MAX;
+  p->skip = (1 << backoff) - 1;
+}
+
+int hosts_seen(hosts_network *hn, struct in_addr ip_addr,
+               const unsigned char *hw_addr, time_t ts) {
+  uint32_t idx = ntohl(ip_addr.s_addr) - hn->base;
+  if (idx >= hn->num_hosts) {
+    return 0;
+  }
+
+  __atomic_store_n(&hn->last_seen[idx], (uint32_t)ts, __ATOMIC_RELAXED);
+
+  // Packed so the ARP thread never sees a torn address
+
+  uint64_t hw = 0;
+  for (int i = 0; i < ETH_ALEN; i++) {
+    hw = (hw << 8) | hw_addr[i];
+  }
+
+  if (hw && (hw != HOSTS_HW_BCAST)) {
+    __atomic_store_n(&hn->hw_addr[idx], hw, __ATOMIC_RELAXED);
+  }
+
+  if (__atomic_load_n(&hn->probe[idx].absent, __ATOMIC_RELAXED) &&
+      __atomic_exchange_n(&hn->probe[idx].absent, 0, __ATOMIC_RELAXED)) {
+    return HOSTS_RETURNED;
+  }
+
+  return HOSTS_SEEN;
+}
+
+uint64_t hosts_hw_addr(hosts_network *hn, uint32_t idx) {
+  return __atomic_load_n(&hn->hw_addr[idx], __ATOMIC_RELAXED);
+}
+
+void hosts_rtt(hosts_network *hn, uint32_t idx, uint32_t rtt) {
+  // EWMA with a gain of 1/8 as for TCP
+
+  uint32_t srtt = __atomic_load_n(&hn->srtt[idx], __ATOMIC_RELAXED);
+  if (srtt) {
+    srtt = srtt - (srtt >> 3) + (rtt >> 3);
+  } else {
+    srtt = rtt ? rtt : 1;
+  }
+  __atomic_store_n(&hn->srtt[idx], srtt, __ATOMIC_RELAXED);
+}
+
+int hosts_probe_timeout(hosts_network *hn, uint32_t idx,
+                        int absent_sweeps) {
+  hosts_probe *p = &hn->probe[idx];
+  uint32_t seen = __atomic_load_n(&hn->last_seen[idx], __ATOMIC_RELAXED);
+
+  if (!p->pending) {
+    return 0;
+  }
+
+  p->pending = 0;
+  if (seen >= p->last_probe) {
+    // Seen by other traffic
+    p->miss = 0;
+    p->skip = 0;
+    return 0;
+  }
+
+  hosts_miss(p);
+
+  // Only hosts we have seen can go missing
+
+  if (seen && absent_sweeps && (p->miss >= absent_sweeps) &&
+      !__atomic_load_n(&p->absent, __ATOMIC_RELAXED)) {
+    __atomic_store_n(&p->absent, 1, __ATOMIC_RELAXED);
+    return -1;
+  }
+
+  return 0;
+}
+
+int hosts_should_probe(hosts_network *hn, uint32_t idx, uint32_t now,
+                       int fresh_time, int backoff) {
+  hosts_probe *p = &hn->probe[idx];
+  uint32_t seen = __atomic_load_n(&hn->last_seen[idx], __ATOMIC_RELAXED);
+
+  // Back off if the host did not answer our last probe,
+  // start again as soon as it is seen
+
+  if (p->pending && (seen < p->last_probe)) {
+    hosts_miss(p);
+  } else if (seen >= p->last_probe) {
+    p->miss = 0;
+    p->skip = 0;
+  }
+  p->pending = 0;
+
+  if (seen && fresh_time && ((now - seen) < (uint32_t)fresh_time)) {
+    // Passive capture has seen it recently
+    return 0;
+  }
+
+  // The back-off may have been lowered by a config reload
+
+  int max_skip = (1 << backoff) - 1;
+  if (p->skip > max_skip) {
+    p->skip = max_skip;
+  }
+
+  if (p->skip) {
+    p->skip--;
+    return 0;
+  }
+
+  p->last_probe = now;
+  p->pending = 1;
+  return -1;
+}
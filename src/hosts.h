@@ -0,0 +1,148 @@
+//
+//  arptools
+//
+//  Stuart B. Wilkins, Brookhaven National Laboratory
+//
+//
+//  BSD 3-Clause License
+//
+//  Copyright (c) 2021, Brookhaven Science Associates
+//  All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without
+//  modification, are permitted provided that the following conditions are met:
+//
+//  1. Redistributions of source code must retain the above copyright notice,
+//     this list of conditions and the following disclaimer.
+//
+//  2. Redistributions in binary form must reproduce the above copyright notice,
+//     this list of conditions and the following disclaimer in the documentation
+//     and/or other materials provided with the distribution.
+//
+//  3. Neither the name of the copyright holder nor the names of its
+//     contributors may be used to endorse or promote products derived from
+//     this software without specific prior written permission.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+//  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+//  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+//  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+//  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+//  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+//  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+//  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+//  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+//  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+//  THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+#ifndef SRC_HOSTS_H_
+#define SRC_HOSTS_H_
+
+#include <stdint.h>
+#include <time.h>
+#include <arpa/inet.h>
+
+/* Macro Definitions */
+
+#define HOSTS_NOERR              0
+#define HOSTS_ERR_MEMORY         1
+#define HOSTS_MAX_HOSTS          (1 << 20)  // Largest network tracked
+#define HOSTS_BACKOFF_MAX        5          // Skip at most 31 sweeps
+#define HOSTS_SEEN               1
+#define HOSTS_RETURNED           2
+#define HOSTS_HW_BCAST           0xFFFFFFFFFFFFULL
+
+//
+// Per address state for one network. last_seen and srtt are written
+// by the capture thread and read by the ARP thread with relaxed
+// atomics, as is the absent flag in the other direction. The rest of
+// the probe state is only used by the ARP thread.
+//
+
+typedef struct {
+  uint32_t last_probe;
+  uint8_t miss;                  // Unanswered probes in a row
+  uint8_t pending;               // Last probe not yet accounted for
+  uint8_t skip;                  // Sweeps left to skip
+  uint8_t absent;
+} hosts_probe;
+
+typedef struct {
+  uint32_t base;                 // First host address (host order)
+  uint32_t num_hosts;
+  int vlan;
+  int retired;                   // Freed by the next hosts_collect()
+  uint32_t *last_seen;
+  uint32_t *srtt;                // Smoothed RTT in microseconds
+  uint64_t *hw_addr;             // Last hw address, 0 if unknown
+  hosts_probe *probe;
+} hosts_network;
+
+typedef struct {
+  hosts_network **net;
+  int num_net;
+} hosts_data;
+
+/* HOSTS Functions */
+
+int hosts_init(hosts_data *hosts);
+void hosts_free(hosts_data *hosts);
+/*
+ * Free the state of all networks. No other thread may be using
+ * the networks.
+ */
+hosts_network* hosts_add(hosts_data *hosts, uint32_t base,
+                         uint32_t num_hosts, int vlan);
+/*
+ * Return the state for the network of num_hosts addresses starting
+ * at base (host order) on vlan, adding it if it does not exist.
+ * A network marked by hosts_retire() is returned to use. Returns
+ * NULL if the network is larger than HOSTS_MAX_HOSTS or on error.
+ */
+void hosts_retire(hosts_network *hn);
+/*
+ * Mark the network as no longer configured. Its state is freed by
+ * the next hosts_collect() unless hosts_add() returns it first.
+ */
+int hosts_collect(hosts_data *hosts);
+/*
+ * Free the networks marked by hosts_retire(). The caller must make
+ * sure no sweep or pending probe still refers to them. Returns the
+ * number of networks freed.
+ */
+int hosts_seen(hosts_network *hn, struct in_addr ip_addr,
+               const unsigned char *hw_addr, time_t ts);
+/*
+ * Record that ip_addr was seen with hw_addr at time ts. Returns 0
+ * if ip_addr is not in the network, HOSTS_RETURNED if the host was
+ * marked absent and HOSTS_SEEN otherwise.
+ */
+uint64_t hosts_hw_addr(hosts_network *hn, uint32_t idx);
+/*
+ * Return the last hw address seen for host idx as a 48 bit integer,
+ * or 0 if the host has not been seen.
+ */
+void hosts_rtt(hosts_network *hn, uint32_t idx, uint32_t rtt);
+/*
+ * Fold the round trip time rtt of a probe of host idx into its
+ * smoothed RTT.
+ */
+int hosts_probe_timeout(hosts_network *hn, uint32_t idx,
+                        int absent_sweeps);
+/*
+ * Account for a probe of host idx which was not answered. Returns
+ * non-zero if the host has now missed absent_sweeps probes in a row
+ * and has been marked absent.
+ */
+int hosts_should_probe(hosts_network *hn, uint32_t idx, uint32_t now,
+                       int fresh_time, int backoff);
+/*
+ * Decide if host idx of the network should be probed in this sweep.
+ * Hosts seen within fresh_time seconds are skipped and hosts which
+ * did not answer their last probes are skipped for an exponentially
+ * growing number of sweeps, at most 2^backoff - 1 (0 to never skip).
+ * Must be called once per host per sweep.
+ */
+
+#endif  // SRC_HOSTS_H_
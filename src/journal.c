@@ -0,0 +1,245 @@
+//
+//  arptools
+//
+//  Stuart B. Wilkins, Brookhaven National Laboratory
+//
+//
+//  BSD 3-Clause License
+//
+//  Copyright (c) 2021, Brookhaven Science Associates
+//  All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without
+//  modification, are permitted provided that the following conditions are met:
+//
+//  1. Redistributions of source code must retain the above copyright notice,
+//     this list of conditions and the following disclaimer.
+//
+//  2. Redistributions in binary form must reproduce the above copyright notice,
+//     this list of conditions and the following disclaimer in the documentation
+//     and/or other materials provided with the distribution.
+//
+//  3. Neither the name of the copyright holder nor the names of its
+//     contributors may be used to endorse or promote products derived from
+//     this software without specific prior written permission.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+//  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+//  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+//  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+//  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+//  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+//  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+//  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+//  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+//  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+//  THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+
+#include "debug.h"
+#include "buffer.h"
+#include "journal.h"
+#include "latency.h"
+#include "arpwatch.h"
+
+static int journal_filename(arpwatch_params *params, char *filename,
+                            size_t len, const char *ext) {
+  int n = snprintf(filename, len, "%s/arpwatch-%s.journal%s",
+                   params->journal_dir, params->device, ext);
+  if ((n < 0) || ((size_t)n >= len)) {
+    ERROR_PRINT("%s : Journal filename too long\n", params->device);
+    return -1;
+  }
+
+  return 0;
+}
+
+int journal_spill(arpwatch_params *params, const arp_data *pending,
+                  int num_pending, int *spilled, int *dropped) {
+  char filename[ARPWATCH_MAX_FILENAME];
+  char tmpname[ARPWATCH_MAX_FILENAME];
+  FILE *fp = NULL;
+  int rtn = -1;
+
+  *spilled = 0;
+  *dropped = 0;
+
+  arp_data *arp = buffer_get_tail(&(params->data_buffer), 0);
+  if (!arp && !num_pending) {
+    // Nothing to do
+    return 0;
+  }
+
+  if (!*params->journal_dir) {
+    ERROR_PRINT("%s : No journal_dir set\n", params->device);
+    goto _error;
+  }
+
+  //
+  // Write to a temporary file and rename so a partial journal
+  // is never replayed
+  //
+
+  if (journal_filename(params, filename, sizeof(filename), "") ||
+      journal_filename(params, tmpname, sizeof(tmpname), ".tmp")) {
+    goto _error;
+  }
+
+  fp = fopen(tmpname, "w");
+  if (!fp) {
+    ERROR_PRINT("%s : Unable to open %s (%s)\n", params->device,
+                tmpname, strerror(errno));
+    goto _error;
+  }
+
+  journal_header header;
+  memset(&header, 0, sizeof(header));
+  header.magic = JOURNAL_MAGIC;
+  header.version = JOURNAL_VERSION;
+  header.record_size = sizeof(arp_data);
+
+  if (fwrite(&header, sizeof(header), 1, fp) != 1) {
+    goto _write_error;
+  }
+
+  *spilled = num_pending;
+  if (num_pending &&
+      (fwrite(pending, sizeof(arp_data), num_pending, fp) !=
+       (size_t)num_pending)) {
+    goto _write_error;
+  }
+
+  while (arp) {
+    if (fwrite(arp, sizeof(arp_data), 1, fp) != 1) {
+      goto _write_error;
+    }
+    (*spilled)++;
+
+    buffer_advance_tail(&(params->data_buffer));
+    arp = buffer_get_tail(&(params->data_buffer), 0);
+  }
+
+  if (fflush(fp) || fsync(fileno(fp))) {
+    goto _write_error;
+  }
+
+  fclose(fp);
+  fp = NULL;
+
+  if (rename(tmpname, filename)) {
+    ERROR_PRINT("%s : Unable to rename %s (%s)\n", params->device,
+                tmpname, strerror(errno));
+    unlink(tmpname);
+    *dropped = *spilled;
+    *spilled = 0;
+    return -1;
+  }
+
+  return 0;
+
+_write_error:
+  ERROR_PRINT("%s : Unable to write %s (%s)\n", params->device,
+              tmpname, strerror(errno));
+  fclose(fp);
+  fp = NULL;
+  unlink(tmpname);
+
+  // Anything already written to the file is lost as well
+
+  *dropped = *spilled;
+  *spilled = 0;
+
+_error:
+  // Count and discard the remaining records, and the pending ones
+  // if nothing was written
+
+  if (!*dropped) {
+    *dropped = num_pending;
+  }
+
+  arp = buffer_get_tail(&(params->data_buffer), 0);
+  while (arp) {
+    (*dropped)++;
+    buffer_advance_tail(&(params->data_buffer));
+    arp = buffer_get_tail(&(params->data_buffer), 0);
+  }
+
+  return rtn;
+}
+
+int journal_replay(arpwatch_params *params) {
+  char filename[ARPWATCH_MAX_FILENAME];
+  int replayed = 0;
+  int dropped = 0;
+  int rtn = -1;
+
+  if (!*params->journal_dir) {
+    return 0;
+  }
+
+  if (journal_filename(params, filename, sizeof(filename), "")) {
+    return -1;
+  }
+
+  FILE *fp = fopen(filename, "r");
+  if (!fp) {
+    if (errno == ENOENT) {
+      // No journal from a previous run
+      return 0;
+    }
+    ERROR_PRINT("%s : Unable to open %s (%s)\n", params->device,
+                filename, strerror(errno));
+    return -1;
+  }
+
+  journal_header header;
+  if ((fread(&header, sizeof(header), 1, fp) != 1) ||
+      (header.magic != JOURNAL_MAGIC) ||
+      (header.version != JOURNAL_VERSION) ||
+      (header.record_size != sizeof(arp_data))) {
+    ERROR_PRINT("%s : Invalid journal %s, discarding\n", params->device,
+                filename);
+    goto _error;
+  }
+
+  //
+  // Records go straight onto the buffer before capture starts. If
+  // the buffer fills the rest of the journal is dropped.
+  //
+
+  arp_data *arp = buffer_get_head(&(params->data_buffer));
+  while (fread(arp, sizeof(arp_data), 1, fp) == 1) {
+    if (replayed >= (params->data_buffer.size - 1)) {
+      dropped++;
+      continue;
+    }
+
+    arp->pv_num = arp->pv_num < 0 ? 0 : arp->pv_num;
+    arp->pv_num = arp->pv_num > BUFFER_PV_MAX ? BUFFER_PV_MAX : arp->pv_num;
+    arp->dhcp_name[BUFFER_NAME_MAX - 1] = '\0';
+    arp->queued = latency_now();
+
+    buffer_advance_head(&(params->data_buffer), 0);
+    arp = buffer_get_head(&(params->data_buffer));
+    replayed++;
+  }
+
+  NOTICE_PRINT("%s : Replayed %d records from %s (%d dropped)\n",
+               params->device, replayed, filename, dropped);
+  rtn = replayed;
+
+_error:
+  fclose(fp);
+  if (unlink(filename)) {
+    ERROR_PRINT("%s : Unable to remove %s (%s)\n", params->device,
+                filename, strerror(errno));
+  }
+
+  return rtn;
+}
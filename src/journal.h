@@ -0,0 +1,78 @@
+//
+//  arptools
+//
+//  Stuart B. Wilkins, Brookhaven National Laboratory
+//
+//
+//  BSD 3-Clause License
+//
+//  Copyright (c) 2021, Brookhaven Science Associates
+//  All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without
+//  modification, are permitted provided that the following conditions are met:
+//
+//  1. Redistributions of source code must retain the above copyright notice,
+//     this list of conditions and the following disclaimer.
+//
+//  2. Redistributions in binary form must reproduce the above copyright notice,
+//     this list of conditions and the following disclaimer in the documentation
+//     and/or other materials provided with the distribution.
+//
+//  3. Neither the name of the copyright holder nor the names of its
+//     contributors may be used to endorse or promote products derived from
+//     this software without specific prior written permission.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+//  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+//  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+//  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+//  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+//  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+//  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+//  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+//  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+//  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+//  THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+#ifndef SRC_JOURNAL_H_
+#define SRC_JOURNAL_H_
+
+#include <stdint.h>
+
+#include "buffer.h"
+#include "arpwatch.h"
+
+/* Macro Definitions */
+
+#define JOURNAL_MAGIC            0x57505241  // "ARPW"
+#define JOURNAL_VERSION          1
+
+typedef struct {
+  uint32_t magic;
+  uint32_t version;
+  uint32_t record_size;
+  uint32_t reserved;
+} journal_header;
+
+/* JOURNAL Functions */
+
+int journal_spill(arpwatch_params *params, const arp_data *pending,
+                  int num_pending, int *spilled, int *dropped);
+/*
+ * Write the num_pending records of pending, taken off the buffer but
+ * not stored, and then all records remaining on the data buffer of
+ * params to the journal file in journal_dir and empty the buffer.
+ * The number of records written is returned in spilled and the
+ * number lost (if journal_dir is not set or the file could not be
+ * written) in dropped.
+ */
+int journal_replay(arpwatch_params *params);
+/*
+ * Load records from the journal file written by a previous shutdown
+ * onto the data buffer of params and remove the file. Returns the
+ * number of records replayed or -1 on error.
+ */
+
+#endif  // SRC_JOURNAL_H_
@@ -0,0 +1,148 @@
+//
+//  arptools
+//
+//  Stuart B. Wilkins, Brookhaven National Laboratory
+//
+//
+//  BSD 3-Clause License
+//
+//  Copyright (c) 2021, Brookhaven Science Associates
+//  All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without
+//  modification, are permitted provided that the following conditions are met:
+//
+//  1. Redistributions of source code must retain the above copyright notice,
+//     this list of conditions and the following disclaimer.
+//
+//  2. Redistributions in binary form must reproduce the above copyright notice,
+//     this list of conditions and the following disclaimer in the documentation
+//     and/or other materials provided with the distribution.
+//
+//  3. Neither the name of the copyright holder nor the names of its
+//     contributors may be used to endorse or promote products derived from
+//     this software without specific prior written permission.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+//  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+//  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+//  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+//  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+//  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+//  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+//  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+//  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+//  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+//  THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "latency.h"
+
+const char *latency_stage_name[LATENCY_STAGES] = {
+  "capture", "queue", "commit", "dns", "total"
+};
+
+int64_t latency_now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_REALTIME, &ts);
+  return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+int latency_bucket(uint64_t usec) {
+  if (usec < LATENCY_SUB) {
+    return (int)usec;
+  }
+
+  // The top LATENCY_SUB_BITS + 1 bits pick the bucket
+
+  int exp = 63 - __builtin_clzll(usec);
+  if (exp >= LATENCY_MAX_BITS) {
+    return LATENCY_BUCKETS - 1;
+  }
+
+  int sub = (usec >> (exp - LATENCY_SUB_BITS)) & (LATENCY_SUB - 1);
+  return (exp - LATENCY_SUB_BITS + 1) * LATENCY_SUB + sub;
+}
+
+uint64_t latency_bucket_upper(int bucket) {
+  if (bucket < LATENCY_SUB) {
+    return bucket;
+  }
+
+  int exp = bucket / LATENCY_SUB + LATENCY_SUB_BITS - 1;
+  int sub = bucket % LATENCY_SUB;
+  uint64_t width = (uint64_t)1 << (exp - LATENCY_SUB_BITS);
+  return ((uint64_t)(LATENCY_SUB + sub) << (exp - LATENCY_SUB_BITS)) +
+         width - 1;
+}
+
+static void latency_add(uint64_t *counter, uint64_t n) {
+  __atomic_store_n(counter, __atomic_load_n(counter, __ATOMIC_RELAXED) + n,
+                   __ATOMIC_RELAXED);
+}
+
+void latency_record(latency_hist *hist, int64_t usec) {
+  uint64_t v = usec < 0 ? 0 : (uint64_t)usec;
+
+  // Count first, so a reader never sees more in the buckets
+
+  latency_add(&hist->count, 1);
+  latency_add(&hist->bucket[latency_bucket(v)], 1);
+  latency_add(&hist->sum, v);
+  if (v > __atomic_load_n(&hist->max, __ATOMIC_RELAXED)) {
+    __atomic_store_n(&hist->max, v, __ATOMIC_RELAXED);
+  }
+}
+
+uint64_t latency_count_below(const latency_hist *hist, uint64_t usec) {
+  uint64_t count = 0;
+  int last = latency_bucket(usec);
+
+  for (int i = 0; i < last; i++) {
+    count += __atomic_load_n(&hist->bucket[i], __ATOMIC_RELAXED);
+  }
+
+  return count;
+}
+
+int64_t latency_percentile(const latency_hist *hist,
+                           const latency_hist *base, double pct) {
+  uint64_t count = __atomic_load_n(&hist->count, __ATOMIC_RELAXED);
+  if (base) {
+    count -= base->count;
+  }
+
+  if (!count) {
+    return 0;
+  }
+
+  uint64_t target = (uint64_t)(count * pct);
+  uint64_t sum = 0;
+
+  for (int i = 0; i < LATENCY_BUCKETS; i++) {
+    sum += __atomic_load_n(&hist->bucket[i], __ATOMIC_RELAXED);
+    if (base) {
+      sum -= base->bucket[i];
+    }
+    if (sum > target) {
+      return (int64_t)latency_bucket_upper(i);
+    }
+  }
+
+  return (int64_t)latency_bucket_upper(LATENCY_BUCKETS - 1);
+}
+
+void latency_copy(latency_hist *dst, const latency_hist *src) {
+  dst->count = __atomic_load_n(&src->count, __ATOMIC_RELAXED);
+  dst->sum = __atomic_load_n(&src->sum, __ATOMIC_RELAXED);
+  dst->max = __atomic_load_n(&src->max, __ATOMIC_RELAXED);
+  for (int i = 0; i < LATENCY_BUCKETS; i++) {
+    dst->bucket[i] = __atomic_load_n(&src->bucket[i], __ATOMIC_RELAXED);
+  }
+}
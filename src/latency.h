@@ -0,0 +1,111 @@
+//
+//  arptools
+//
+//  Stuart B. Wilkins, Brookhaven National Laboratory
+//
+//
+//  BSD 3-Clause License
+//
+//  Copyright (c) 2021, Brookhaven Science Associates
+//  All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without
+//  modification, are permitted provided that the following conditions are met:
+//
+//  1. Redistributions of source code must retain the above copyright notice,
+//     this list of conditions and the following disclaimer.
+//
+//  2. Redistributions in binary form must reproduce the above copyright notice,
+//     this list of conditions and the following disclaimer in the documentation
+//     and/or other materials provided with the distribution.
+//
+//  3. Neither the name of the copyright holder nor the names of its
+//     contributors may be used to endorse or promote products derived from
+//     this software without specific prior written permission.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+//  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+//  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+//  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+//  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+//  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+//  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+//  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+//  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+//  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+//  THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+#ifndef SRC_LATENCY_H_
+#define SRC_LATENCY_H_
+
+#include <stdint.h>
+
+/* Macro Definitions */
+
+#define LATENCY_SUB_BITS         3          // 8 buckets per power of 2
+#define LATENCY_SUB              (1 << LATENCY_SUB_BITS)
+#define LATENCY_MAX_BITS         40         // About 12 days in us
+#define LATENCY_BUCKETS          \
+  ((LATENCY_MAX_BITS - LATENCY_SUB_BITS + 1) * LATENCY_SUB)
+#define LATENCY_REPORT_INTERVAL  300        // Seconds
+
+#define LATENCY_CAPTURE          0          // Packet time to buffer
+#define LATENCY_QUEUE            1          // Buffer to writer pickup
+#define LATENCY_COMMIT           2          // Writer pickup to commit
+#define LATENCY_DNS              3          // Reverse DNS lookup
+#define LATENCY_TOTAL            4          // Packet time to commit
+#define LATENCY_STAGES           5
+
+//
+// Log-linear (HDR style) histogram of latencies in microseconds,
+// with a relative error of at most 1 / LATENCY_SUB. Like the other
+// metrics each histogram has a single writer thread and is read
+// with relaxed loads.
+//
+
+typedef struct {
+  uint64_t count;
+  uint64_t sum;
+  uint64_t max;
+  uint64_t bucket[LATENCY_BUCKETS];
+} __attribute__((aligned(64))) latency_hist;
+
+extern const char *latency_stage_name[LATENCY_STAGES];
+
+/* LATENCY Functions */
+
+int64_t latency_now(void);
+/*
+ * Current time in microseconds since the epoch, the clock of the
+ * packet timestamps.
+ */
+void latency_record(latency_hist *hist, int64_t usec);
+/*
+ * Add a latency of usec to hist. Negative values (clock steps)
+ * are counted as 0.
+ */
+int latency_bucket(uint64_t usec);
+uint64_t latency_bucket_upper(int bucket);
+/*
+ * Map a latency to its bucket and a bucket to the largest latency
+ * it holds.
+ */
+uint64_t latency_count_below(const latency_hist *hist, uint64_t usec);
+/*
+ * Number of latencies in hist less than usec, rounded down to a
+ * bucket boundary.
+ */
+int64_t latency_percentile(const latency_hist *hist,
+                           const latency_hist *base, double pct);
+/*
+ * Return the upper edge of the bucket holding percentile pct of
+ * the latencies recorded in hist since the copy base was taken
+ * (base may be NULL), or 0 if there are none.
+ */
+void latency_copy(latency_hist *dst, const latency_hist *src);
+/*
+ * Copy src with relaxed loads, for use as base above.
+ */
+
+#endif  // SRC_LATENCY_H_
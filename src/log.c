@@ -0,0 +1,349 @@
+//
+//  arptools
+//
+//  Stuart B. Wilkins, Brookhaven National Laboratory
+//
+//
+//  BSD 3-Clause License
+//
+//  Copyright (c) 2021, Brookhaven Science Associates
+//  All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without
+//  modification, are permitted provided that the following conditions are met:
+//
+//  1. Redistributions of source code must retain the above copyright notice,
+//     this list of conditions and the following disclaimer.
+//
+//  2. Redistributions in binary form must reproduce the above copyright notice,
+//     this list of conditions and the following disclaimer in the documentation
+//     and/or other materials provided with the distribution.
+//
+//  3. Neither the name of the copyright holder nor the names of its
+//     contributors may be used to endorse or promote products derived from
+//     this software without specific prior written permission.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+//  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+//  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+//  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+//  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+//  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+//  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+//  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+//  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+//  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+//  THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include "log.h"
+#include "debug.h"
+
+#define LOG_WRITE_SIZE        (64 * 1024)
+
+// Rings are never freed, a ring whose thread has exited is reused
+// once it has been drained
+static log_ring *log_rings[LOG_MAX_THREADS];
+static int log_num_rings = 0;
+static pthread_mutex_t log_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_once_t log_once = PTHREAD_ONCE_INIT;
+static pthread_key_t log_key;
+static __thread log_ring *log_local = NULL;
+
+// Sites with suppressed messages, pushed by the logging threads
+static log_site *log_sites = NULL;
+
+static pthread_t log_thread_id;
+static int log_running = 0;
+static int log_stopping = 0;
+
+static void log_release(void *arg) {
+  log_ring *ring = (log_ring*)arg;
+  __atomic_store_n(&ring->active, 0, __ATOMIC_RELEASE);
+}
+
+static void log_key_init(void) {
+  pthread_key_create(&log_key, log_release);
+}
+
+static log_ring* log_get_ring(void) {
+  if (log_local) {
+    return log_local;
+  }
+
+  pthread_once(&log_once, log_key_init);
+  pthread_mutex_lock(&log_mutex);
+
+  log_ring *ring = NULL;
+  for (int i = 0; i < log_num_rings; i++) {
+    log_ring *r = log_rings[i];
+    if (!__atomic_load_n(&r->active, __ATOMIC_ACQUIRE) &&
+        (__atomic_load_n(&r->tail, __ATOMIC_ACQUIRE) == r->head)) {
+      ring = r;
+      break;
+    }
+  }
+
+  if (!ring && (log_num_rings < LOG_MAX_THREADS)) {
+    ring = calloc(1, sizeof(log_ring));
+    if (ring) {
+      log_rings[log_num_rings] = ring;
+      __atomic_store_n(&log_num_rings, log_num_rings + 1,
+                       __ATOMIC_RELEASE);
+    }
+  }
+
+  if (ring) {
+    __atomic_store_n(&ring->active, 1, __ATOMIC_RELEASE);
+    pthread_setspecific(log_key, ring);
+    log_local = ring;
+  }
+
+  pthread_mutex_unlock(&log_mutex);
+  return ring;
+}
+
+static uint64_t log_window(void) {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC_COARSE, &now);
+  return now.tv_sec / LOG_RATE_WINDOW;
+}
+
+static int log_allow(log_site *site, uint64_t *suppressed) {
+  // The first thread to see a new window resets the count and
+  // reports what was suppressed in the last one
+
+  uint64_t window = log_window();
+  uint64_t last = __atomic_load_n(&site->window, __ATOMIC_RELAXED);
+
+  *suppressed = 0;
+  if ((last != window) &&
+      __atomic_compare_exchange_n(&site->window, &last, window, 0,
+                                  __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+    __atomic_store_n(&site->count, 0, __ATOMIC_RELAXED);
+    *suppressed = __atomic_exchange_n(&site->suppressed, 0,
+                                      __ATOMIC_RELAXED);
+  }
+
+  if (__atomic_add_fetch(&site->count, 1, __ATOMIC_RELAXED) >
+      LOG_RATE_BURST) {
+    __atomic_add_fetch(&site->suppressed, 1, __ATOMIC_RELAXED);
+    if (!__atomic_exchange_n(&site->listed, 1, __ATOMIC_RELAXED)) {
+      site->next = __atomic_load_n(&log_sites, __ATOMIC_RELAXED);
+      while (!__atomic_compare_exchange_n(&log_sites, &site->next, site, 0,
+                                          __ATOMIC_RELEASE,
+                                          __ATOMIC_RELAXED)) {}
+    }
+    return 0;
+  }
+
+  return 1;
+}
+
+static void log_queue(log_ring *ring, const char *fmt, va_list ap) {
+  uint64_t head = ring->head;
+  uint64_t tail = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+
+  if ((head - tail) >= LOG_RING_SLOTS) {
+    // Never wait on the writer, count it instead
+    __atomic_store_n(&ring->dropped, ring->dropped + 1, __ATOMIC_RELAXED);
+    return;
+  }
+
+  char *msg = ring->msg[head % LOG_RING_SLOTS];
+  int len = vsnprintf(msg, LOG_MSG_SIZE, fmt, ap);
+  if (len < 0) {
+    return;
+  }
+
+  // Every message is written as a whole line
+
+  if (len > LOG_MSG_SIZE - 2) {
+    len = LOG_MSG_SIZE - 2;
+  }
+  if (!len || (msg[len - 1] != '\n')) {
+    msg[len++] = '\n';
+    msg[len] = '\0';
+  }
+
+  __atomic_store_n(&ring->head, head + 1, __ATOMIC_RELEASE);
+}
+
+static void log_vmessage(const char *fmt, va_list ap) {
+  log_ring *ring = NULL;
+  if (__atomic_load_n(&log_running, __ATOMIC_ACQUIRE)) {
+    ring = log_get_ring();
+  }
+
+  if (ring) {
+    log_queue(ring, fmt, ap);
+  } else {
+    vfprintf(stderr, fmt, ap);
+  }
+}
+
+static void log_message(const char *fmt, ...) {
+  va_list ap;
+  va_start(ap, fmt);
+  log_vmessage(fmt, ap);
+  va_end(ap);
+}
+
+void log_print(log_site *site, const char *fmt, ...) {
+  uint64_t suppressed;
+  int allow = log_allow(site, &suppressed);
+
+  if (suppressed) {
+    log_message(SD_WARNING " %s:%-4d: %lu messages suppressed\n",
+                site->file, site->line, (unsigned long)suppressed);
+  }
+
+  if (!allow) {
+    return;
+  }
+
+  va_list ap;
+  va_start(ap, fmt);
+  log_vmessage(fmt, ap);
+  va_end(ap);
+}
+
+static void log_write(char *buf, size_t len) {
+  size_t done = 0;
+  while (done < len) {
+    ssize_t n = write(STDERR_FILENO, buf + done, len - done);
+    if (n <= 0) {
+      return;
+    }
+    done += n;
+  }
+}
+
+static size_t log_summary(char *buf, size_t len) {
+  // Report sites that have been quiet since they last suppressed
+  // messages, sites are never removed from the list
+
+  uint64_t window = log_window();
+  log_site *site = __atomic_load_n(&log_sites, __ATOMIC_ACQUIRE);
+
+  for (; site && ((len + LOG_MSG_SIZE) <= LOG_WRITE_SIZE);
+       site = site->next) {
+    if (__atomic_load_n(&site->window, __ATOMIC_RELAXED) == window ||
+        !__atomic_load_n(&site->suppressed, __ATOMIC_RELAXED)) {
+      continue;
+    }
+
+    uint64_t suppressed = __atomic_exchange_n(&site->suppressed, 0,
+                                              __ATOMIC_RELAXED);
+    if (suppressed) {
+      len += snprintf(buf + len, LOG_MSG_SIZE,
+                      SD_WARNING " %s:%-4d: %lu messages suppressed\n",
+                      site->file, site->line, (unsigned long)suppressed);
+    }
+  }
+
+  return len;
+}
+
+static void log_drain(char *buf, uint64_t *reported) {
+  size_t len = 0;
+  int num = __atomic_load_n(&log_num_rings, __ATOMIC_ACQUIRE);
+
+  for (int i = 0; i < num; i++) {
+    log_ring *ring = log_rings[i];
+    uint64_t tail = ring->tail;
+    uint64_t head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+
+    for (; tail != head; tail++) {
+      const char *msg = ring->msg[tail % LOG_RING_SLOTS];
+      size_t n = strnlen(msg, LOG_MSG_SIZE);
+      if ((len + n) > LOG_WRITE_SIZE) {
+        log_write(buf, len);
+        len = 0;
+      }
+      memcpy(buf + len, msg, n);
+      len += n;
+      __atomic_store_n(&ring->tail, tail + 1, __ATOMIC_RELEASE);
+    }
+
+    uint64_t dropped = __atomic_load_n(&ring->dropped, __ATOMIC_RELAXED);
+    if (dropped != reported[i]) {
+      if ((len + LOG_MSG_SIZE) > LOG_WRITE_SIZE) {
+        log_write(buf, len);
+        len = 0;
+      }
+      len += snprintf(buf + len, LOG_MSG_SIZE,
+                      SD_WARNING " Log ring full, %lu messages dropped\n",
+                      (unsigned long)(dropped - reported[i]));
+      reported[i] = dropped;
+    }
+  }
+
+  if (len > LOG_WRITE_SIZE - LOG_MSG_SIZE) {
+    log_write(buf, len);
+    len = 0;
+  }
+  len = log_summary(buf, len);
+
+  log_write(buf, len);
+}
+
+static void *log_thread(void *arg) {
+  (void)arg;
+
+  char *buf = malloc(LOG_WRITE_SIZE);
+  uint64_t reported[LOG_MAX_THREADS] = {0};
+  if (!buf) {
+    return NULL;
+  }
+
+  struct timespec delay = {0, LOG_FLUSH_MSEC * 1000000L};
+  for (;;) {
+    int stopping = __atomic_load_n(&log_stopping, __ATOMIC_ACQUIRE);
+    log_drain(buf, reported);
+    if (stopping) {
+      break;
+    }
+    nanosleep(&delay, NULL);
+  }
+
+  free(buf);
+  return NULL;
+}
+
+int log_start(void) {
+  if (__atomic_load_n(&log_running, __ATOMIC_ACQUIRE)) {
+    return LOG_NOERR;
+  }
+
+  __atomic_store_n(&log_stopping, 0, __ATOMIC_RELEASE);
+  if (pthread_create(&log_thread_id, NULL, log_thread, NULL)) {
+    fprintf(stderr, SD_ERR " Unable to create log thread.\n");
+    return LOG_ERR_THREAD;
+  }
+
+  __atomic_store_n(&log_running, 1, __ATOMIC_RELEASE);
+  return LOG_NOERR;
+}
+
+void log_stop(void) {
+  if (!__atomic_load_n(&log_running, __ATOMIC_ACQUIRE)) {
+    return;
+  }
+
+  // New messages are written directly, the writer empties the
+  // rings before it exits
+
+  __atomic_store_n(&log_running, 0, __ATOMIC_RELEASE);
+  __atomic_store_n(&log_stopping, 1, __ATOMIC_RELEASE);
+  pthread_join(log_thread_id, NULL);
+}
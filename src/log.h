@@ -0,0 +1,111 @@
+//
+//  arptools
+//
+//  Stuart B. Wilkins, Brookhaven National Laboratory
+//
+//
+//  BSD 3-Clause License
+//
+//  Copyright (c) 2021, Brookhaven Science Associates
+//  All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without
+//  modification, are permitted provided that the following conditions are met:
+//
+//  1. Redistributions of source code must retain the above copyright notice,
+//     this list of conditions and the following disclaimer.
+//
+//  2. Redistributions in binary form must reproduce the above copyright notice,
+//     this list of conditions and the following disclaimer in the documentation
+//     and/or other materials provided with the distribution.
+//
+//  3. Neither the name of the copyright holder nor the names of its
+//     contributors may be used to endorse or promote products derived from
+//     this software without specific prior written permission.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+//  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+//  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+//  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+//  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+//  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+//  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+//  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+//  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+//  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+//  THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+#ifndef SRC_LOG_H_
+#define SRC_LOG_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Macro Definitions */
+
+#define LOG_MSG_SIZE          256        // Longest message, truncated
+#define LOG_RING_SLOTS        256        // Messages queued per thread
+#define LOG_MAX_THREADS       64
+#define LOG_RATE_BURST        10         // Messages per site per window
+#define LOG_RATE_WINDOW       1          // Seconds
+#define LOG_FLUSH_MSEC        50         // Writer poll interval
+
+#define LOG_NOERR             0
+#define LOG_ERR_MEMORY        -1
+#define LOG_ERR_THREAD        -2
+
+//
+// State of one call site of the logging macros, used to limit the
+// rate at which it logs. Updated with relaxed atomics as a site
+// can be reached from more than one thread, the limit is only
+// approximate. Sites that have suppressed messages are listed so
+// the writer can report them when the site goes quiet.
+//
+
+typedef struct log_site {
+  const char *file;
+  int line;
+  uint64_t window;
+  uint64_t count;
+  uint64_t suppressed;
+  struct log_site *next;
+  int listed;
+} log_site;
+
+//
+// Single producer, single consumer ring of formatted messages,
+// one per thread. The owner advances head and the writer thread
+// advances tail.
+//
+
+typedef struct {
+  char msg[LOG_RING_SLOTS][LOG_MSG_SIZE];
+  uint64_t head;
+  uint64_t tail;
+  uint64_t dropped;
+  int active;
+} log_ring;
+
+/* LOG Functions */
+
+void log_print(log_site *site, const char *fmt, ...)
+  __attribute__((format(printf, 2, 3)));
+/*
+ * Format a message and queue it on the ring of the calling thread,
+ * or write it directly to stderr when the writer is not running.
+ * Messages over LOG_RATE_BURST per LOG_RATE_WINDOW from one site
+ * are counted and reported as a summary. Used by the macros in
+ * debug.h.
+ */
+int log_start(void);
+/*
+ * Start the writer thread, from then on messages are queued. Call
+ * in each process with signals blocked.
+ */
+void log_stop(void);
+/*
+ * Stop the writer thread after writing everything queued.
+ */
+
+#endif  // SRC_LOG_H_
@@ -0,0 +1,377 @@
+//
+//  arptools
+//
+//  Stuart B. Wilkins, Brookhaven National Laboratory
+//
+//
+//  BSD 3-Clause License
+//
+//  Copyright (c) 2021, Brookhaven Science Associates
+//  All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without
+//  modification, are permitted provided that the following conditions are met:
+//
+//  1. Redistributions of source code must retain the above copyright notice,
+//     this list of conditions and the following disclaimer.
+//
+//  2. Redistributions in binary form must reproduce the above copyright notice,
+//     this list of conditions and the following disclaimer in the documentation
+//     and/or other materials provided with the distribution.
+//
+//  3. Neither the name of the copyright holder nor the names of its
+//     contributors may be used to endorse or promote products derived from
+//     this software without specific prior written permission.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+//  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+//  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+//  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+//  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+//  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+//  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+//  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+//  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+//  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+//  THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+#define _GNU_SOURCE  // For accept4()
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <poll.h>
+#include <unistd.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/time.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include "metrics.h"
+#include "debug.h"
+
+static const char *metrics_type_name[METRICS_PACKET_TYPES] = {
+  "unknown", "arp_src", "arp_dst", "arp_probe", "arp_grat", "udp",
+  "dhcp_err", "ip", "epics", "epics_pva", "dhcp_discover",
+  "dhcp_offer", "dhcp_request", "dhcp_decline", "dhcp_ack",
+  "dhcp_nack", "dhcp_release", "epics_beacon"
+};
+
+static pthread_t metrics_thread_id;
+static volatile int metrics_running = 0;
+
+int metrics_init(metrics_data *metrics) {
+  metrics->fd = -1;
+  metrics->iface = mmap(NULL,
+                        METRICS_MAX_INTERFACES * sizeof(metrics_interface),
+                        PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS,
+                        -1, 0);
+  if (metrics->iface == MAP_FAILED) {
+    ERROR_PRINT("Unable to map metrics : %s\n", strerror(errno));
+    metrics->iface = NULL;
+    return METRICS_ERR_MEMORY;
+  }
+
+  return METRICS_NOERR;
+}
+
+void metrics_free(metrics_data *metrics) {
+  if (metrics->fd >= 0) {
+    close(metrics->fd);
+    metrics->fd = -1;
+  }
+
+  if (metrics->iface) {
+    munmap(metrics->iface,
+           METRICS_MAX_INTERFACES * sizeof(metrics_interface));
+    metrics->iface = NULL;
+  }
+}
+
+metrics_interface* metrics_slot(metrics_data *metrics, const char *device) {
+  metrics_interface *slot = NULL;
+
+  if (!metrics->iface) {
+    return NULL;
+  }
+
+  for (int i = 0; i < METRICS_MAX_INTERFACES; i++) {
+    metrics_interface *m = &metrics->iface[i];
+    if (!strncmp(m->device, device, METRICS_DEVICE_MAX)) {
+      slot = m;
+      break;
+    }
+    if (!slot && !m->device[0]) {
+      slot = m;
+    }
+  }
+
+  if (!slot) {
+    ERROR_PRINT("%s : No free metrics slot\n", device);
+    return NULL;
+  }
+
+  strncpy(slot->device, device, METRICS_DEVICE_MAX - 1);
+  __atomic_store_n(&slot->ready, 0, __ATOMIC_RELAXED);
+  __atomic_store_n(&slot->active, 1, __ATOMIC_RELEASE);
+
+  return slot;
+}
+
+void metrics_release(metrics_data *metrics, const char *device) {
+  if (!metrics->iface) {
+    return;
+  }
+
+  for (int i = 0; i < METRICS_MAX_INTERFACES; i++) {
+    metrics_interface *m = &metrics->iface[i];
+    if (!strncmp(m->device, device, METRICS_DEVICE_MAX)) {
+      __atomic_store_n(&m->active, 0, __ATOMIC_RELEASE);
+      break;
+    }
+  }
+}
+
+int metrics_listen(metrics_data *metrics, const char *address, int port) {
+  struct sockaddr_in addr;
+  int one = 1;
+
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(port);
+  if (!inet_aton(address, &addr.sin_addr)) {
+    ERROR_PRINT("Invalid metrics address %s\n", address);
+    return -1;
+  }
+
+  int fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC | SOCK_NONBLOCK, 0);
+  if (fd < 0) {
+    ERROR_PRINT("socket(): ERROR : %s\n", strerror(errno));
+    return -1;
+  }
+
+  setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+
+  if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) ||
+      listen(fd, 16)) {
+    ERROR_PRINT("Unable to listen for metrics on %s:%d : %s\n",
+                address, port, strerror(errno));
+    close(fd);
+    return -1;
+  }
+
+  NOTICE_PRINT("Serving metrics on %s:%d\n", address, port);
+  metrics->fd = fd;
+  return 0;
+}
+
+#define METRICS_LOAD(m, group, field) \
+  ((unsigned long long)__atomic_load_n(&(m)->group.field, __ATOMIC_RELAXED))
+
+static void metrics_family(FILE *fp, metrics_data *metrics,
+                           const char *name, const char *type,
+                           const char *help, size_t offset) {
+  // One metric for every active interface, offset is the counter
+  // within metrics_interface
+
+  fprintf(fp, "# HELP arpwatch_%s %s\n", name, help);
+  fprintf(fp, "# TYPE arpwatch_%s %s\n", name, type);
+
+  for (int i = 0; i < METRICS_MAX_INTERFACES; i++) {
+    metrics_interface *m = &metrics->iface[i];
+    if (!__atomic_load_n(&m->active, __ATOMIC_ACQUIRE)) {
+      continue;
+    }
+    uint64_t *c = (uint64_t *)((char *)m + offset);
+    fprintf(fp, "arpwatch_%s{device=\"%s\"} %llu\n", name, m->device,
+            (unsigned long long)__atomic_load_n(c, __ATOMIC_RELAXED));
+  }
+}
+
+#define METRICS_FAMILY(fp, metrics, name, type, help, group, field) \
+  metrics_family(fp, metrics, name, type, help, \
+                 offsetof(metrics_interface, group.field))
+
+static void metrics_write(FILE *fp, metrics_data *metrics) {
+  fprintf(fp, "# HELP arpwatch_packets_total Packets captured by type\n");
+  fprintf(fp, "# TYPE arpwatch_packets_total counter\n");
+  for (int i = 0; i < METRICS_MAX_INTERFACES; i++) {
+    metrics_interface *m = &metrics->iface[i];
+    if (!__atomic_load_n(&m->active, __ATOMIC_ACQUIRE)) {
+      continue;
+    }
+    for (int t = 0; t < METRICS_PACKET_TYPES; t++) {
+      fprintf(fp, "arpwatch_packets_total{device=\"%s\",type=\"%s\"} "
+              "%llu\n", m->device, metrics_type_name[t],
+              METRICS_LOAD(m, capture, packets[t]));
+    }
+  }
+
+  METRICS_FAMILY(fp, metrics, "duplicates_total", "counter",
+                 "Records dropped as already buffered",
+                 capture, duplicates);
+  METRICS_FAMILY(fp, metrics, "kernel_drops_total", "counter",
+                 "Packets dropped by the kernel", capture, kernel_drops);
+  METRICS_FAMILY(fp, metrics, "interface_drops_total", "counter",
+                 "Packets dropped by the interface",
+                 capture, interface_drops);
+  METRICS_FAMILY(fp, metrics, "ring_used", "gauge",
+                 "Records waiting on the buffer", sink, ring_used);
+  METRICS_FAMILY(fp, metrics, "ring_size", "gauge",
+                 "Size of the buffer in records", sink, ring_size);
+  METRICS_FAMILY(fp, metrics, "ring_overruns_total", "counter",
+                 "Records overwritten on a full buffer",
+                 sink, ring_overruns);
+  METRICS_FAMILY(fp, metrics, "flushes_total", "counter",
+                 "Flushes of the buffer to the database", sink, flushes);
+  METRICS_FAMILY(fp, metrics, "flush_microseconds_total", "counter",
+                 "Time spent flushing in microseconds", sink, flush_usec);
+  METRICS_FAMILY(fp, metrics, "records_total", "counter",
+                 "Records taken off the buffer", sink, records);
+  METRICS_FAMILY(fp, metrics, "rows_written_total", "counter",
+                 "Records written to the database", sink, rows_written);
+  METRICS_FAMILY(fp, metrics, "write_cache_hits_total", "counter",
+                 "Writes skipped as the database is current",
+                 sink, write_cache_hits);
+  METRICS_FAMILY(fp, metrics, "dns_lookups_total", "counter",
+                 "Reverse DNS lookups", sink, dns_lookups);
+  METRICS_FAMILY(fp, metrics, "dns_failures_total", "counter",
+                 "Reverse DNS lookups without an answer",
+                 sink, dns_failures);
+  METRICS_FAMILY(fp, metrics, "probes_sent_total", "counter",
+                 "ARP requests sent", arp, probes_sent);
+  METRICS_FAMILY(fp, metrics, "probes_answered_total", "counter",
+                 "ARP requests answered", capture, probes_answered);
+  METRICS_FAMILY(fp, metrics, "probes_expired_total", "counter",
+                 "ARP requests not answered", arp, probes_expired);
+  METRICS_FAMILY(fp, metrics, "sweeps_total", "counter",
+                 "ARP sweeps completed", arp, sweeps);
+
+  // The histograms have finer buckets than are worth exporting
+
+  fprintf(fp, "# HELP arpwatch_latency_microseconds Latency of each "
+          "stage from capture to commit\n");
+  fprintf(fp, "# TYPE arpwatch_latency_microseconds histogram\n");
+  for (int i = 0; i < METRICS_MAX_INTERFACES; i++) {
+    metrics_interface *m = &metrics->iface[i];
+    if (!__atomic_load_n(&m->active, __ATOMIC_ACQUIRE)) {
+      continue;
+    }
+    for (int s = 0; s < LATENCY_STAGES; s++) {
+      latency_hist *h = &m->latency[s];
+      const char *stage = latency_stage_name[s];
+      for (int e = METRICS_LATENCY_MIN; e <= METRICS_LATENCY_MAX; e++) {
+        uint64_t le = (uint64_t)1 << (2 * e);
+        fprintf(fp, "arpwatch_latency_microseconds_bucket{device=\"%s\","
+                "stage=\"%s\",le=\"%llu\"} %llu\n", m->device, stage,
+                (unsigned long long)le,
+                (unsigned long long)latency_count_below(h, le));
+      }
+      unsigned long long count = __atomic_load_n(&h->count,
+                                                 __ATOMIC_RELAXED);
+      fprintf(fp, "arpwatch_latency_microseconds_bucket{device=\"%s\","
+              "stage=\"%s\",le=\"+Inf\"} %llu\n", m->device, stage, count);
+      fprintf(fp, "arpwatch_latency_microseconds_sum{device=\"%s\","
+              "stage=\"%s\"} %llu\n", m->device, stage,
+              (unsigned long long)__atomic_load_n(&h->sum,
+                                                  __ATOMIC_RELAXED));
+      fprintf(fp, "arpwatch_latency_microseconds_count{device=\"%s\","
+              "stage=\"%s\"} %llu\n", m->device, stage, count);
+    }
+  }
+}
+
+static void metrics_client(metrics_data *metrics, int fd) {
+  char request[METRICS_REQUEST_MAX];
+  struct timeval tv = {METRICS_IO_TIMEOUT, 0};
+
+  // Do not let a slow client hold up the caller
+
+  setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+  setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+
+  ssize_t len = recv(fd, request, sizeof(request) - 1, 0);
+  if (len <= 0) {
+    close(fd);
+    return;
+  }
+  request[len] = '\0';
+
+  FILE *fp = fdopen(fd, "w");
+  if (!fp) {
+    close(fd);
+    return;
+  }
+
+  if (strncmp(request, "GET /metrics", 12)) {
+    fprintf(fp, "HTTP/1.0 404 Not Found\r\n"
+            "Content-Type: text/plain\r\n\r\nNot Found\n");
+  } else {
+    fprintf(fp, "HTTP/1.0 200 OK\r\n"
+            "Content-Type: text/plain; version=0.0.4\r\n\r\n");
+    metrics_write(fp, metrics);
+  }
+
+  fclose(fp);
+}
+
+uint64_t metrics_clock(void) {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC_COARSE, &now);
+  return now.tv_sec;
+}
+
+int metrics_poll(metrics_data *metrics, int timeout) {
+  struct pollfd pfd;
+  pfd.fd = metrics->fd;
+  pfd.events = POLLIN;
+
+  int n = poll(&pfd, 1, timeout);
+  if (n < 0) {
+    return (errno == EINTR) ? -1 : 0;
+  }
+
+  while (n > 0) {
+    int fd = accept4(metrics->fd, NULL, NULL, SOCK_CLOEXEC);
+    if (fd < 0) {
+      break;
+    }
+    metrics_client(metrics, fd);
+  }
+
+  return 0;
+}
+
+static void* metrics_thread(void *arg) {
+  metrics_data *metrics = (metrics_data *)arg;
+
+  while (__atomic_load_n(&metrics_running, __ATOMIC_RELAXED)) {
+    metrics_poll(metrics, METRICS_POLL_TIMEOUT);
+  }
+
+  return NULL;
+}
+
+int metrics_start(metrics_data *metrics) {
+  metrics_running = 1;
+  int err = pthread_create(&metrics_thread_id, NULL,
+                           &metrics_thread, (void *)metrics);
+  if (err) {
+    ERROR_COMMENT("Unable to create thread.");
+    metrics_running = 0;
+    return -1;
+  }
+  return 0;
+}
+
+void metrics_stop(void) {
+  if (metrics_running) {
+    __atomic_store_n(&metrics_running, 0, __ATOMIC_RELAXED);
+    pthread_join(metrics_thread_id, NULL);
+  }
+}
@@ -0,0 +1,169 @@
+//
+//  arptools
+//
+//  Stuart B. Wilkins, Brookhaven National Laboratory
+//
+//
+//  BSD 3-Clause License
+//
+//  Copyright (c) 2021, Brookhaven Science Associates
+//  All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without
+//  modification, are permitted provided that the following conditions are met:
+//
+//  1. Redistributions of source code must retain the above copyright notice,
+//     this list of conditions and the following disclaimer.
+//
+//  2. Redistributions in binary form must reproduce the above copyright notice,
+//     this list of conditions and the following disclaimer in the documentation
+//     and/or other materials provided with the distribution.
+//
+//  3. Neither the name of the copyright holder nor the names of its
+//     contributors may be used to endorse or promote products derived from
+//     this software without specific prior written permission.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+//  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+//  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+//  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+//  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+//  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+//  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+//  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+//  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+//  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+//  THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+#ifndef SRC_METRICS_H_
+#define SRC_METRICS_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "latency.h"
+
+/* Macro Definitions */
+
+#define METRICS_NOERR            0
+#define METRICS_ERR_MEMORY       1
+#define METRICS_MAX_INTERFACES   64
+#define METRICS_DEVICE_MAX       64
+#define METRICS_PACKET_TYPES     18         // Unknown and BUFFER_TYPE_*
+#define METRICS_POLL_TIMEOUT     1000       // Milliseconds
+#define METRICS_IO_TIMEOUT       1          // Seconds per client
+#define METRICS_REQUEST_MAX      1024
+#define METRICS_LATENCY_MIN      4          // Buckets at 4^n us
+#define METRICS_LATENCY_MAX      18
+
+//
+// Every counter has a single writer thread, so it is updated with a
+// relaxed load and store (no locked instruction) and read by the
+// exporter with a relaxed load. The groups written by each thread
+// are on their own cache lines.
+//
+
+#define METRICS_ADD(m, group, field, n) do { \
+    if (m) { \
+      uint64_t *_c = &(m)->group.field; \
+      __atomic_store_n(_c, __atomic_load_n(_c, __ATOMIC_RELAXED) + (n), \
+                       __ATOMIC_RELAXED); \
+    } \
+  } while (0)
+
+#define METRICS_SET(m, group, field, n) do { \
+    if (m) { \
+      __atomic_store_n(&(m)->group.field, (uint64_t)(n), \
+                       __ATOMIC_RELAXED); \
+    } \
+  } while (0)
+
+typedef struct {
+  uint64_t packets[METRICS_PACKET_TYPES];
+  uint64_t duplicates;           // Dropped as already on the buffer
+  uint64_t kernel_drops;
+  uint64_t interface_drops;
+  uint64_t probes_answered;
+  uint64_t heartbeat;            // metrics_clock() of the last loop
+} __attribute__((aligned(64))) metrics_capture;
+
+typedef struct {
+  uint64_t ring_used;            // Gauge
+  uint64_t ring_size;            // Gauge
+  uint64_t ring_overruns;        // Gauge, counted by the buffer
+  uint64_t flushes;
+  uint64_t flush_usec;
+  uint64_t records;
+  uint64_t rows_written;
+  uint64_t write_cache_hits;
+  uint64_t dns_lookups;
+  uint64_t dns_failures;
+  uint64_t heartbeat;            // metrics_clock() of the last loop
+  uint64_t last_flush;           // metrics_clock() of the last flush
+  uint64_t period;               // Seconds between loops
+} __attribute__((aligned(64))) metrics_sink;
+
+typedef struct {
+  uint64_t probes_sent;
+  uint64_t probes_expired;
+  uint64_t sweeps;
+} __attribute__((aligned(64))) metrics_arp;
+
+typedef struct {
+  int active;
+  int ready;                     // Set once capture has started
+  char device[METRICS_DEVICE_MAX];
+  metrics_capture capture;
+  metrics_sink sink;
+  metrics_arp arp;
+  latency_hist latency[LATENCY_STAGES];  // Capture stage by capture
+} metrics_interface;
+
+typedef struct {
+  metrics_interface *iface;      // Shared with the child processes
+  int fd;                        // Listening socket or -1
+} metrics_data;
+
+/* METRICS Functions */
+
+int metrics_init(metrics_data *metrics);
+/*
+ * Map METRICS_MAX_INTERFACES counter slots in memory shared with
+ * processes forked later.
+ */
+void metrics_free(metrics_data *metrics);
+metrics_interface* metrics_slot(metrics_data *metrics, const char *device);
+/*
+ * Return the slot for device, reusing its old slot if it ran before
+ * so counters carry on across restarts. Returns NULL if all slots
+ * are in use.
+ */
+void metrics_release(metrics_data *metrics, const char *device);
+/*
+ * Stop exporting the slot of device.
+ */
+int metrics_listen(metrics_data *metrics, const char *address, int port);
+/*
+ * Listen for HTTP scrapes on address:port. Returns 0 on success or
+ * -1 on error.
+ */
+int metrics_poll(metrics_data *metrics, int timeout);
+/*
+ * Wait up to timeout milliseconds for scrapes and answer them with
+ * the counters in Prometheus text format. Returns -1 if interrupted
+ * by a signal.
+ */
+uint64_t metrics_clock(void);
+/*
+ * Monotonic time in seconds, the same in every process, for the
+ * heartbeats.
+ */
+int metrics_start(metrics_data *metrics);
+void metrics_stop(void);
+/*
+ * Serve scrapes from a thread, for when there is no parent process
+ * to do it.
+ */
+
+#endif  // SRC_METRICS_H_
@@ -38,19 +38,24 @@
 
 #include <stdio.h>
 #include <stdlib.h>
-#include <pthread.h>
 #include <unistd.h>
 #include <string.h>
-#include <netdb.h>
 #include <mysql/mysql.h>
 #include <mysql/mysqld_error.h>
 
 #include "debug.h"
 #include "buffer.h"
+#include "registry.h"
+#include "sink.h"
 #include "mysql.h"
 #include "utils.h"
 #include "arpwatch.h"
 
+typedef struct {
+  MYSQL *con;
+  char sql_buffer[100000];
+} mysql_context;
+
 unsigned int mysql_handle_error(MYSQL *con) {
   const char *err = mysql_error(con);
   unsigned int errno = mysql_errno(con);
@@ -63,189 +68,231 @@ unsigned int mysql_handle_error(MYSQL *con) {
   return errno;
 }
 
-void * mysql_thread(void * arg) {
-  arpwatch_params *params = (arpwatch_params *) arg;
+void* mysql_sink_open(arpwatch_params *params) {
+  mysql_context *ctx = malloc(sizeof(mysql_context));
+  if (!ctx) {
+    ERROR_COMMENT("Unable to allocate memory for MySQL context\n");
+    return NULL;
+  }
 
-  NOTICE_COMMENT("Starting mysql thread\n");
+  ctx->con = mysql_init(NULL);
+  if (!ctx->con) {
+    ERROR_COMMENT("Unable to initialize MySQL\n");
+    goto _error;
+  }
 
-  for (;;) {
-    char sql_buffer[100000];
-    MYSQL *con = mysql_init(NULL);
-    if (!con) {
-      mysql_handle_error(con);
-      goto _error;
-    }
+  // Do not let an unreachable server hold up the writer (and
+  // the shutdown flush) indefinitely
+
+  unsigned int connect_timeout = MYSQL_CONNECT_TIMEOUT;
+  unsigned int io_timeout = MYSQL_IO_TIMEOUT;
+  mysql_options(ctx->con, MYSQL_OPT_CONNECT_TIMEOUT, &connect_timeout);
+  mysql_options(ctx->con, MYSQL_OPT_READ_TIMEOUT, &io_timeout);
+  mysql_options(ctx->con, MYSQL_OPT_WRITE_TIMEOUT, &io_timeout);
+
+  if (mysql_real_connect(ctx->con, params->hostname,
+                         params->username,
+                         params->password,
+                         params->database,
+                         0, NULL, 0) == NULL) {
+    mysql_handle_error(ctx->con);
+    goto _error;
+  }
 
-    if (mysql_real_connect(con, params->hostname,
-                           params->username,
-                           params->password,
-                           params->database,
-                           0, NULL, 0) == NULL) {
-      mysql_handle_error(con);
-      goto _error;
-    }
+  return ctx;
 
-    // Write to daemon database
+_error:
+  if (ctx->con) mysql_close(ctx->con);
+  free(ctx);
+  return NULL;
+}
 
-    snprintf(sql_buffer, sizeof(sql_buffer),
-            "INSERT INTO daemondata "
-            "(hostname, iface, last_updated) "
-            "VALUES ('%s','%s',NOW()) "
-            "ON DUPLICATE KEY UPDATE "
-            "last_updated = NOW();",
-            params->daemon_hostname,
-            params->device);
+void mysql_sink_close(void *arg) {
+  mysql_context *ctx = (mysql_context *)arg;
 
-    DEBUG_PRINT("DAEMON SQL query : %s\n", sql_buffer);
+  mysql_close(ctx->con);
+  free(ctx);
+}
 
-    if (mysql_real_query(con, sql_buffer, strlen(sql_buffer))) {
-      mysql_handle_error(con);
-    }
+int mysql_sink_query(mysql_context *ctx) {
+  if (mysql_real_query(ctx->con, ctx->sql_buffer,
+                       strlen(ctx->sql_buffer))) {
+    return mysql_handle_error(ctx->con);
+  }
 
-    arp_data *arp = buffer_get_tail(&(params->data_buffer), 0);
-
-    while (arp) {
-      char time_buffer[256];
-      char hostname[256];
-
-      struct tm gm;
-      if (localtime_r(&(arp->ts.tv_sec), &gm)) {
-        strftime(time_buffer, sizeof(time_buffer),
-                "%Y-%m-%d %H:%M:%S", &gm);
-
-        DEBUG_PRINT("Packet time : %s\n", time_buffer);
-      } else {
-        // Error building time
-        strncpy(time_buffer, "1970-01-01 00:00:00", sizeof(time_buffer));
-        ERROR_COMMENT("Unable to convert packet time");
-      }
-
-      // Now lookup DNS entry
-      // TODO(swilkins) : Use reentrant version here
-
-      struct  hostent *he = gethostbyaddr(&arp->ip_addr,
-                                          sizeof(arp->ip_addr),
-                                          AF_INET);
-      if (he) {
-        snprintf(hostname, sizeof(hostname), "'%s'", he->h_name);
-        DEBUG_PRINT("Hostname : %s\n", hostname);
-      } else {
-        snprintf(hostname, sizeof(hostname), "NULL");
-        DEBUG_PRINT("Hostname (not found) : %s\n", hostname);
-      }
-
-      const char *hw_addr = int_to_mac(arp->hw_addr);
-      const char *ip_addr = inet_ntoa(arp->ip_addr);
-      //
-      // Database:
-      // Currently KEY fields are (hw_address, vlan, location)
-      // This allows for duplicate MACs as long as they are
-      // Unique to VLAN and location
-      //
-      // First lets insert the common data of
-      // hw_address
-      // ip_address
-      // location
-      // label
-      // type
-      // last_seen
-      // hostname
-      // vlan
-      //
-      snprintf(sql_buffer, sizeof(sql_buffer),
-              "INSERT INTO arpdata "
-              "(hw_address, vlan, location, "
-              "label, ip_address, type, last_seen, hostname) "
-              "VALUES ('%s',%d,'%s',"
-              "'%s','%s', %d, '%s', %s) "
-              "ON DUPLICATE KEY UPDATE "
-              "ip_address = '%s', "
-              "label = '%s', "
-              "type = type | %d, "
-              "last_seen = '%s', "
-              "hostname = %s",
-              hw_addr, arp->vlan, params->location,  // KEY FIELDS
-              params->label, ip_addr, arp->type, time_buffer, hostname,
-              ip_addr, params->label, arp->type, time_buffer, hostname);
-
-      DEBUG_PRINT("BASE SQL query : %s\n", sql_buffer);
-
-      if (mysql_real_query(con, sql_buffer, strlen(sql_buffer))) {
-        if (mysql_handle_error(con) == ER_DUP_ENTRY) {
-          ALERT_PRINT("Duplicate database entry found for %s %d %s\n",
-                      hw_addr, arp->vlan, params->location);
-        }
-      }
-
-      if ((arp->type & BUFFER_TYPE_DHCP) && (*arp->dhcp_name)) {
-        snprintf(sql_buffer, sizeof(sql_buffer),
-                "UPDATE arpdata SET "
-                "dhcp_name = '%s' "
-                "WHERE hw_address = '%s' "
-                "AND vlan = %d AND location = '%s';",
-                arp->dhcp_name, hw_addr, arp->vlan,
-                params->location);
-
-        DEBUG_PRINT("DHCP SQL query : %s\n", sql_buffer);
-
-        if (mysql_real_query(con, sql_buffer, strlen(sql_buffer))) {
-          mysql_handle_error(con);
-        }
-      }
-
-      if ((arp->type & BUFFER_TYPE_EPICS) &&
-          (params->num_epics_pv_vlan)) {
-        // First check if the vlan is correct
-
-        for (int i=0; i < params->num_epics_pv_vlan; i++) {
-          if (params->epics_pv_vlan[i] == arp->vlan) {
-            DEBUG_PRINT("Process %d EPICS PVs\n", arp->pv_num);
-            for (int pvc=0; pvc < arp->pv_num; pvc++) {
-              snprintf(sql_buffer, sizeof(sql_buffer),
-                      "INSERT INTO epicsdata "
-                      "(hw_address, vlan, pv_name, last_seen) "
-                      "VALUES ('%s', %d, '%s', '%s') "
-                      "ON DUPLICATE KEY UPDATE "
-                      "last_seen = '%s';",
-                      hw_addr, arp->vlan, arp->pv_name[pvc],
-                      time_buffer, time_buffer);
-
-              DEBUG_PRINT("EPICSDATA SQL query : %s\n", sql_buffer);
-
-              if (mysql_real_query(con, sql_buffer, strlen(sql_buffer))) {
-                mysql_handle_error(con);
-              }
-            }
-            break;
-          }
-        }
-      }
-
-      buffer_advance_tail(&(params->data_buffer));
-      arp = buffer_get_tail(&(params->data_buffer), 0);
-    }
+  return 0;
+}
 
-_error:
-    if (con) mysql_close(con);
-    DEBUG_PRINT("Sleep for %d\n", params->mysql_loop_delay);
-    sleep(params->mysql_loop_delay);
+int mysql_sink_write_daemon(void *arg, arpwatch_params *params) {
+  mysql_context *ctx = (mysql_context *)arg;
+
+  snprintf(ctx->sql_buffer, sizeof(ctx->sql_buffer),
+          "INSERT INTO daemondata "
+          "(hostname, iface, last_updated) "
+          "VALUES ('%s','%s',NOW()) "
+          "ON DUPLICATE KEY UPDATE "
+          "last_updated = NOW();",
+          params->daemon_hostname,
+          params->device);
+
+  DEBUG_PRINT("DAEMON SQL query : %s\n", ctx->sql_buffer);
+
+  return mysql_sink_query(ctx);
+}
+
+int mysql_sink_write_arp(void *arg, arpwatch_params *params,
+                         arp_data *arp, const char *host,
+                         const char *time) {
+  mysql_context *ctx = (mysql_context *)arg;
+  char hostname[300];
+
+  if (host) {
+    snprintf(hostname, sizeof(hostname), "'%s'", host);
+  } else {
+    snprintf(hostname, sizeof(hostname), "NULL");
   }
 
-  return NULL;
+  char hw_addr[UTILS_MAC_STRLEN];
+  char ip_addr[INET_ADDRSTRLEN];
+  int_to_mac(hw_addr, arp->hw_addr);
+  int_to_ip(ip_addr, arp->ip_addr);
+
+  //
+  // Database:
+  // Currently KEY fields are (hw_address, vlan, location)
+  // This allows for duplicate MACs as long as they are
+  // Unique to VLAN and location
+  //
+  // First lets insert the common data of
+  // hw_address
+  // ip_address
+  // location
+  // label
+  // type
+  // last_seen
+  // hostname
+  // vlan
+  //
+  snprintf(ctx->sql_buffer, sizeof(ctx->sql_buffer),
+          "INSERT INTO arpdata "
+          "(hw_address, vlan, location, "
+          "label, ip_address, type, last_seen, hostname) "
+          "VALUES ('%s',%d,'%s',"
+          "'%s','%s', %d, '%s', %s) "
+          "ON DUPLICATE KEY UPDATE "
+          "ip_address = '%s', "
+          "label = '%s', "
+          "type = type | %d, "
+          "last_seen = '%s', "
+          "hostname = %s",
+          hw_addr, arp->vlan, params->location,  // KEY FIELDS
+          params->label, ip_addr, arp->type, time, hostname,
+          ip_addr, params->label, arp->type, time, hostname);
+
+  DEBUG_PRINT("BASE SQL query : %s\n", ctx->sql_buffer);
+
+  int err = mysql_sink_query(ctx);
+  if (err == ER_DUP_ENTRY) {
+    ALERT_PRINT("Duplicate database entry found for %s %d %s\n",
+                hw_addr, arp->vlan, params->location);
+  }
+
+  return err;
+}
+
+int mysql_sink_write_dhcp(void *arg, arpwatch_params *params,
+                          arp_data *arp) {
+  mysql_context *ctx = (mysql_context *)arg;
+  char hw_addr[UTILS_MAC_STRLEN];
+
+  snprintf(ctx->sql_buffer, sizeof(ctx->sql_buffer),
+          "UPDATE arpdata SET "
+          "dhcp_name = '%s' "
+          "WHERE hw_address = '%s' "
+          "AND vlan = %d AND location = '%s';",
+          arp->dhcp_name, int_to_mac(hw_addr, arp->hw_addr), arp->vlan,
+          params->location);
+
+  DEBUG_PRINT("DHCP SQL query : %s\n", ctx->sql_buffer);
+
+  return mysql_sink_query(ctx);
 }
 
-int mysql_setup(arpwatch_params *params) {
-  DEBUG_PRINT("MySQL client version: %s\n", mysql_get_client_info());
+int mysql_sink_write_epics(void *arg, arpwatch_params *params,
+                           arp_data *arp, int pv, const char *time) {
+  mysql_context *ctx = (mysql_context *)arg;
+  char hw_addr[UTILS_MAC_STRLEN];
+  (void)params;
 
-  // Setup thread data
+  snprintf(ctx->sql_buffer, sizeof(ctx->sql_buffer),
+          "INSERT INTO epicsdata "
+          "(hw_address, vlan, pv_name, last_seen) "
+          "VALUES ('%s', %d, '%s', '%s') "
+          "ON DUPLICATE KEY UPDATE "
+          "last_seen = '%s';",
+          int_to_mac(hw_addr, arp->hw_addr), arp->vlan, arp->pv_name[pv],
+          time, time);
 
-  pthread_t threadId;
-  int err = pthread_create(&threadId, NULL,
-                           &mysql_thread, (void *)params);
-  if (err) {
-    ERROR_COMMENT("Unable to create thread.");
-    return -1;
+  DEBUG_PRINT("EPICSDATA SQL query : %s\n", ctx->sql_buffer);
+
+  return mysql_sink_query(ctx);
+}
+
+registry_set* mysql_sink_load_registration(void *arg,
+                                           arpwatch_params *params) {
+  mysql_context *ctx = (mysql_context *)arg;
+  (void)params;
+
+  snprintf(ctx->sql_buffer, sizeof(ctx->sql_buffer),
+           "SELECT hw_address, not_registered "
+           "FROM registrationdata;");
+
+  if (mysql_sink_query(ctx)) {
+    return NULL;
   }
 
-  return 0;
+  MYSQL_RES *result = mysql_store_result(ctx->con);
+  if (!result) {
+    mysql_handle_error(ctx->con);
+    return NULL;
+  }
+
+  registry_set *set = registry_set_alloc((int)mysql_num_rows(result));
+  if (!set) {
+    mysql_free_result(result);
+    return NULL;
+  }
+
+  int count = 0;
+  MYSQL_ROW row;
+  while ((row = mysql_fetch_row(result))) {
+    unsigned char hw_addr[ETH_ALEN];
+    if (!row[0] || mac_to_int(hw_addr, row[0])) {
+      ERROR_PRINT("Invalid hw_address %s in registrationdata\n",
+                  row[0] ? row[0] : "NULL");
+      continue;
+    }
+
+    registry_set_add(set, hw_addr, row[1] && atoi(row[1]));
+    count++;
+  }
+
+  mysql_free_result(result);
+
+  DEBUG_PRINT("Loaded %d hw addresses from registrationdata\n", count);
+
+  return set;
 }
+
+const sink_ops mysql_sink = {
+  .name = "mysql",
+  .open = mysql_sink_open,
+  .close = mysql_sink_close,
+  .begin = NULL,
+  .commit = NULL,
+  .write_daemon = mysql_sink_write_daemon,
+  .write_arp = mysql_sink_write_arp,
+  .write_dhcp = mysql_sink_write_dhcp,
+  .write_epics = mysql_sink_write_epics,
+  .load_registration = mysql_sink_load_registration
+};
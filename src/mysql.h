@@ -38,8 +38,13 @@
 #ifndef SRC_MYSQL_H_
 #define SRC_MYSQL_H_
 
-#include "arpwatch.h"
+#include "sink.h"
 
-int mysql_setup(arpwatch_params *params);
+/* Macro Definitions */
+
+#define MYSQL_CONNECT_TIMEOUT    10         // Seconds
+#define MYSQL_IO_TIMEOUT         30         // Seconds per read or write
+
+extern const sink_ops mysql_sink;
 
 #endif  // SRC_MYSQL_H_
@@ -0,0 +1,236 @@
+//
+//  arptools
+//
+//  Stuart B. Wilkins, Brookhaven National Laboratory
+//
+//
+//  BSD 3-Clause License
+//
+//  Copyright (c) 2021, Brookhaven Science Associates
+//  All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without
+//  modification, are permitted provided that the following conditions are met:
+//
+//  1. Redistributions of source code must retain the above copyright notice,
+//     this list of conditions and the following disclaimer.
+//
+//  2. Redistributions in binary form must reproduce the above copyright notice,
+//     this list of conditions and the following disclaimer in the documentation
+//     and/or other materials provided with the distribution.
+//
+//  3. Neither the name of the copyright holder nor the names of its
+//     contributors may be used to endorse or promote products derived from
+//     this software without specific prior written permission.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+//  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+//  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+//  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+//  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+//  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+//  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+//  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+//  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+//  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+//  THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include <pthread.h>
+#ifdef SYSTEMD
+#include <systemd/sd-daemon.h>
+#endif
+
+#include "notify.h"
+#include "debug.h"
+
+static pthread_t notify_thread_id;
+static int notify_running = 0;
+
+static void notify_send(const char *state) {
+#ifdef SYSTEMD
+  sd_notify(0, state);
+#else
+  (void)state;
+#endif
+}
+
+void notify_init(notify_data *notify, metrics_data *metrics,
+                 int stall_timeout) {
+  memset(notify, 0, sizeof(notify_data));
+  notify->metrics = metrics;
+  notify->stall_timeout = stall_timeout;
+
+#ifdef SYSTEMD
+  notify->enabled = getenv("NOTIFY_SOCKET") != NULL;
+  if (sd_watchdog_enabled(0, &notify->watchdog_usec) <= 0) {
+    notify->watchdog_usec = 0;
+  }
+#endif
+
+  if (notify->watchdog_usec) {
+    NOTICE_PRINT("Watchdog enabled, timeout %lus\n",
+                 (unsigned long)(notify->watchdog_usec / 1000000));
+  }
+}
+
+static int notify_stalled(notify_data *notify, metrics_interface *m,
+                          uint64_t now) {
+  uint64_t capture = __atomic_load_n(&m->capture.heartbeat,
+                                     __ATOMIC_RELAXED);
+  uint64_t sink = __atomic_load_n(&m->sink.heartbeat, __ATOMIC_RELAXED);
+  uint64_t period = __atomic_load_n(&m->sink.period, __ATOMIC_RELAXED);
+  int stalled = 0;
+
+  // A heartbeat of 0 is a loop that has not run yet
+
+  if (capture && ((now - capture) > (uint64_t)notify->stall_timeout)) {
+    if (!notify->stalled) {
+      ALERT_PRINT("%s : Capture has not run for %lus\n", m->device,
+                  (unsigned long)(now - capture));
+    }
+    stalled = 1;
+  }
+
+  if (sink && ((now - sink) > (period + notify->stall_timeout))) {
+    if (!notify->stalled) {
+      ALERT_PRINT("%s : Writer has not run for %lus\n", m->device,
+                  (unsigned long)(now - sink));
+    }
+    stalled = 1;
+  }
+
+  return stalled;
+}
+
+void notify_check(notify_data *notify) {
+  metrics_data *metrics = notify->metrics;
+  if (!notify->enabled || !metrics->iface) {
+    return;
+  }
+
+  uint64_t now = metrics_clock();
+  uint64_t elapsed = now - notify->last_check;
+  if (elapsed < NOTIFY_INTERVAL) {
+    return;
+  }
+  notify->last_check = now;
+
+  char status[NOTIFY_STATUS_MAX] = "STATUS=";
+  size_t len = strlen(status);
+  int num = 0, ready = 1, stalled = 0;
+
+  for (int i = 0; i < METRICS_MAX_INTERFACES; i++) {
+    metrics_interface *m = &metrics->iface[i];
+    if (!__atomic_load_n(&m->active, __ATOMIC_ACQUIRE)) {
+      continue;
+    }
+    num++;
+
+    if (!__atomic_load_n(&m->ready, __ATOMIC_ACQUIRE)) {
+      ready = 0;
+      continue;
+    }
+
+    int stuck = notify_stalled(notify, m, now);
+    stalled |= stuck;
+
+    uint64_t packets = 0;
+    for (int t = 0; t < METRICS_PACKET_TYPES; t++) {
+      packets += __atomic_load_n(&m->capture.packets[t], __ATOMIC_RELAXED);
+    }
+    uint64_t pps = (packets - notify->packets[i]) / elapsed;
+    if (!notify->packets[i]) {
+      pps = 0;  // First look at this interface
+    }
+    notify->packets[i] = packets;
+
+    uint64_t used = __atomic_load_n(&m->sink.ring_used, __ATOMIC_RELAXED);
+    uint64_t size = __atomic_load_n(&m->sink.ring_size, __ATOMIC_RELAXED);
+    uint64_t flush = __atomic_load_n(&m->sink.last_flush, __ATOMIC_RELAXED);
+
+    if (len < sizeof(status)) {
+      char age[32] = "no flush yet";
+      if (flush) {
+        snprintf(age, sizeof(age), "flushed %lus ago",
+                 (unsigned long)(now - flush));
+      }
+      len += snprintf(status + len, sizeof(status) - len,
+                      "%s%s %lu pps, buffer %lu%%, %s%s",
+                      num > 1 ? "; " : "", m->device, (unsigned long)pps,
+                      (unsigned long)(size ? used * 100 / size : 0), age,
+                      stuck ? " (STALLED)" : "");
+    }
+  }
+
+  if (!num) {
+    return;
+  }
+
+  if (!notify->ready && ready) {
+    NOTICE_PRINT("All %d interface(s) started\n", num);
+    notify_send("READY=1");
+    notify->ready = 1;
+  }
+
+  if (stalled && !notify->stalled) {
+    ALERT_COMMENT("Stopping watchdog pings\n");
+  } else if (!stalled && notify->stalled) {
+    NOTICE_COMMENT("Progress resumed, restarting watchdog pings\n");
+  }
+  notify->stalled = stalled;
+
+  // Startup is covered by TimeoutStartSec, not the watchdog
+
+  if (notify->watchdog_usec && (!notify->ready || !stalled)) {
+    notify_send("WATCHDOG=1");
+  }
+  if (notify->ready) {
+    notify_send(status);
+  }
+}
+
+void notify_stopping(notify_data *notify) {
+  if (notify->enabled) {
+    notify_send("STOPPING=1");
+  }
+}
+
+static void *notify_thread(void *arg) {
+  notify_data *notify = (notify_data *)arg;
+
+  struct timespec delay = {NOTIFY_INTERVAL, 0};
+  while (__atomic_load_n(&notify_running, __ATOMIC_RELAXED)) {
+    notify_check(notify);
+    nanosleep(&delay, NULL);
+  }
+
+  return NULL;
+}
+
+int notify_start(notify_data *notify) {
+  if (!notify->enabled) {
+    return 0;
+  }
+
+  __atomic_store_n(&notify_running, 1, __ATOMIC_RELAXED);
+  if (pthread_create(&notify_thread_id, NULL, notify_thread, notify)) {
+    ERROR_COMMENT("Unable to create thread.\n");
+    __atomic_store_n(&notify_running, 0, __ATOMIC_RELAXED);
+    return -1;
+  }
+
+  return 0;
+}
+
+void notify_stop(void) {
+  if (__atomic_load_n(&notify_running, __ATOMIC_RELAXED)) {
+    __atomic_store_n(&notify_running, 0, __ATOMIC_RELAXED);
+    pthread_join(notify_thread_id, NULL);
+  }
+}
@@ -0,0 +1,95 @@
+//
+//  arptools
+//
+//  Stuart B. Wilkins, Brookhaven National Laboratory
+//
+//
+//  BSD 3-Clause License
+//
+//  Copyright (c) 2021, Brookhaven Science Associates
+//  All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without
+//  modification, are permitted provided that the following conditions are met:
+//
+//  1. Redistributions of source code must retain the above copyright notice,
+//     this list of conditions and the following disclaimer.
+//
+//  2. Redistributions in binary form must reproduce the above copyright notice,
+//     this list of conditions and the following disclaimer in the documentation
+//     and/or other materials provided with the distribution.
+//
+//  3. Neither the name of the copyright holder nor the names of its
+//     contributors may be used to endorse or promote products derived from
+//     this software without specific prior written permission.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+//  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+//  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+//  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+//  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+//  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+//  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+//  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+//  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+//  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+//  THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+#ifndef SRC_NOTIFY_H_
+#define SRC_NOTIFY_H_
+
+#include <stdint.h>
+
+#include "metrics.h"
+
+/* Macro Definitions */
+
+#define NOTIFY_INTERVAL          1          // Seconds between checks
+#define NOTIFY_STATUS_MAX        256
+
+//
+// systemd notification state, kept by the process systemd started.
+// Health is judged from the shared metrics so it works the same
+// whether the interfaces run in child processes or in this one.
+//
+
+typedef struct {
+  metrics_data *metrics;
+  int enabled;                   // NOTIFY_SOCKET was set
+  int ready;                     // READY=1 sent
+  int stalled;                   // Watchdog pings withheld
+  int stall_timeout;             // Seconds without a heartbeat
+  uint64_t watchdog_usec;        // 0 without WatchdogSec
+  uint64_t last_check;           // metrics_clock()
+  uint64_t packets[METRICS_MAX_INTERFACES];
+} notify_data;
+
+/* NOTIFY Functions */
+
+void notify_init(notify_data *notify, metrics_data *metrics,
+                 int stall_timeout);
+/*
+ * Find out if systemd wants notifications and a watchdog. Each
+ * heartbeat may be up to stall_timeout seconds late (on top of the
+ * loop period of the writer) before the pings stop.
+ */
+void notify_check(notify_data *notify);
+/*
+ * Call at least every NOTIFY_INTERVAL. Sends READY=1 once every
+ * interface has started, then WATCHDOG=1 while capture and the
+ * writers are making progress, with a STATUS= line of packets per
+ * second, buffer fill and age of the last flush.
+ */
+void notify_stopping(notify_data *notify);
+/*
+ * Send STOPPING=1.
+ */
+int notify_start(notify_data *notify);
+void notify_stop(void);
+/*
+ * Run notify_check() from a thread, for when there is no parent
+ * process to do it.
+ */
+
+#endif  // SRC_NOTIFY_H_
@@ -0,0 +1,101 @@
+//
+//  arptools
+//
+//  Stuart B. Wilkins, Brookhaven National Laboratory
+//
+//
+//  BSD 3-Clause License
+//
+//  Copyright (c) 2021, Brookhaven Science Associates
+//  All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without
+//  modification, are permitted provided that the following conditions are met:
+//
+//  1. Redistributions of source code must retain the above copyright notice,
+//     this list of conditions and the following disclaimer.
+//
+//  2. Redistributions in binary form must reproduce the above copyright notice,
+//     this list of conditions and the following disclaimer in the documentation
+//     and/or other materials provided with the distribution.
+//
+//  3. Neither the name of the copyright holder nor the names of its
+//     contributors may be used to endorse or promote products derived from
+//     this software without specific prior written permission.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+//  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+//  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+//  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+//  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+//  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+//  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+//  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+//  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+//  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+//  THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+#include <stdio.h>
+
+#include "sink.h"
+#include "null.h"
+#include "arpwatch.h"
+
+static int null_sink_context;
+
+void* null_sink_open(arpwatch_params *params) {
+  (void)params;
+  return &null_sink_context;
+}
+
+void null_sink_close(void *ctx) {
+  (void)ctx;
+}
+
+int null_sink_write_daemon(void *ctx, arpwatch_params *params) {
+  (void)ctx;
+  (void)params;
+  return 0;
+}
+
+int null_sink_write_arp(void *ctx, arpwatch_params *params, arp_data *arp,
+                        const char *hostname, const char *time) {
+  (void)ctx;
+  (void)params;
+  (void)arp;
+  (void)hostname;
+  (void)time;
+  return 0;
+}
+
+int null_sink_write_dhcp(void *ctx, arpwatch_params *params,
+                         arp_data *arp) {
+  (void)ctx;
+  (void)params;
+  (void)arp;
+  return 0;
+}
+
+int null_sink_write_epics(void *ctx, arpwatch_params *params, arp_data *arp,
+                          int pv, const char *time) {
+  (void)ctx;
+  (void)params;
+  (void)arp;
+  (void)pv;
+  (void)time;
+  return 0;
+}
+
+const sink_ops null_sink = {
+  .name = "null",
+  .open = null_sink_open,
+  .close = null_sink_close,
+  .begin = NULL,
+  .commit = NULL,
+  .write_daemon = null_sink_write_daemon,
+  .write_arp = null_sink_write_arp,
+  .write_dhcp = null_sink_write_dhcp,
+  .write_epics = null_sink_write_epics,
+  .load_registration = NULL
+};
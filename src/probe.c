@@ -0,0 +1,286 @@
+//
+//  arptools
+//
+//  Stuart B. Wilkins, Brookhaven National Laboratory
+//
+//
+//  BSD 3-Clause License
+//
+//  Copyright (c) 2021, Brookhaven Science Associates
+//  All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without
+//  modification, are permitted provided that the following conditions are met:
+//
+//  1. Redistributions of source code must retain the above copyright notice,
+//     this list of conditions and the following disclaimer.
+//
+//  2. Redistributions in binary form must reproduce the above copyright notice,
+//     this list of conditions and the following disclaimer in the documentation
+//     and/or other materials provided with the distribution.
+//
+//  3. Neither the name of the copyright holder nor the names of its
+//     contributors may be used to endorse or promote products derived from
+//     this software without specific prior written permission.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+//  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+//  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+//  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+//  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+//  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+//  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+//  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+//  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+//  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+//  THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <time.h>
+#include <pthread.h>
+#include <arpa/inet.h>
+
+#include "probe.h"
+#include "hosts.h"
+#include "utils.h"
+#include "debug.h"
+
+int64_t probe_now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_REALTIME, &ts);
+  return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static void probe_timeout(timer_entry *timer, void *data);
+
+static uint32_t probe_hash(uint32_t ip_addr, int vlan) {
+  uint64_t key = ((uint64_t)vlan << 32) | ip_addr;
+  key *= 0x9E3779B97F4A7C15ULL;
+  return (uint32_t)(key >> 32) & (PROBE_HASH_SIZE - 1);
+}
+
+int probe_init(probe_table *table) {
+  memset(table, 0, sizeof(probe_table));
+
+  table->entry = calloc(PROBE_TABLE_SIZE, sizeof(probe_entry));
+  table->hash = malloc(PROBE_HASH_SIZE * sizeof(int));
+  if (!table->entry || !table->hash) {
+    ERROR_COMMENT("Unable to allocate memory for probe table\n");
+    probe_free(table);
+    return PROBE_ERR_MEMORY;
+  }
+
+  for (int i = 0; i < PROBE_HASH_SIZE; i++) {
+    table->hash[i] = PROBE_NONE;
+  }
+
+  // All entries start on the free list (linked by hash_next)
+
+  for (int i = 0; i < PROBE_TABLE_SIZE; i++) {
+    table->entry[i].hash_next = i + 1;
+  }
+  table->entry[PROBE_TABLE_SIZE - 1].hash_next = PROBE_NONE;
+  table->free = 0;
+
+  timer_init(&table->wheel, PROBE_WHEEL_TICK, probe_now());
+  for (int i = 0; i < PROBE_TABLE_SIZE; i++) {
+    timer_entry_init(&table->entry[i].timer, probe_timeout, table);
+  }
+
+  pthread_mutex_init(&table->mutex, NULL);
+
+  return PROBE_NOERR;
+}
+
+void probe_free(probe_table *table) {
+  free(table->entry);
+  free(table->hash);
+  table->entry = NULL;
+  table->hash = NULL;
+}
+
+static int* probe_find(probe_table *table, uint32_t ip_addr, int vlan) {
+  // Return the link pointing at the entry, or at PROBE_NONE
+
+  int *link = &table->hash[probe_hash(ip_addr, vlan)];
+  while (*link != PROBE_NONE) {
+    probe_entry *e = &table->entry[*link];
+    if ((e->ip_addr == ip_addr) && (e->vlan == vlan)) {
+      break;
+    }
+    link = &e->hash_next;
+  }
+
+  return link;
+}
+
+static void probe_remove(probe_table *table, int *link) {
+  int i = *link;
+  probe_entry *e = &table->entry[i];
+
+  // Unlink from the hash chain and the wheel
+
+  *link = e->hash_next;
+  timer_cancel(&table->wheel, &e->timer);
+
+  e->hash_next = table->free;
+  table->free = i;
+  table->used--;
+}
+
+static void probe_timeout(timer_entry *timer, void *data) {
+  // Called from probe_expire() with the table locked
+
+  probe_table *table = data;
+  probe_entry *e = (probe_entry *)((char *)timer -
+                                   offsetof(probe_entry, timer));
+
+  if (e->hosts &&
+      hosts_probe_timeout(e->hosts, e->idx, table->absent_sweeps)) {
+    struct in_addr ip;
+    char ip_addr[INET_ADDRSTRLEN];
+    ip.s_addr = e->ip_addr;
+    NOTICE_PRINT("%s : Host %s on vlan %d is absent\n",
+                 table->device, int_to_ip(ip_addr, ip), e->vlan);
+  }
+
+  probe_remove(table, probe_find(table, e->ip_addr, e->vlan));
+  table->expired++;
+}
+
+int probe_add(probe_table *table, uint32_t ip_addr, int vlan,
+              hosts_network *hosts, uint32_t idx, int64_t now) {
+  int rtn = 0;
+
+  pthread_mutex_lock(&table->mutex);
+  table->sent++;
+
+  int *link = probe_find(table, ip_addr, vlan);
+  if (*link != PROBE_NONE) {
+    goto _unlock;
+  }
+
+  if (table->free == PROBE_NONE) {
+    table->untracked++;
+    rtn = -1;
+    goto _unlock;
+  }
+
+  int i = table->free;
+  probe_entry *e = &table->entry[i];
+  table->free = e->hash_next;
+  table->used++;
+
+  e->ip_addr = ip_addr;
+  e->vlan = vlan;
+  e->sent = now;
+  e->hosts = hosts;
+  e->idx = idx;
+
+  e->hash_next = PROBE_NONE;
+  *link = i;
+
+  timer_add(&table->wheel, &e->timer, now + PROBE_TIMEOUT);
+
+_unlock:
+  pthread_mutex_unlock(&table->mutex);
+  return rtn;
+}
+
+int64_t probe_match(probe_table *table, uint32_t ip_addr, int vlan,
+                    int64_t now) {
+  int64_t rtt = -1;
+
+  pthread_mutex_lock(&table->mutex);
+
+  int *link = probe_find(table, ip_addr, vlan);
+  if (*link == PROBE_NONE) {
+    goto _unlock;
+  }
+
+  probe_entry *e = &table->entry[*link];
+  rtt = now - e->sent;
+  rtt = rtt < 0 ? 0 : rtt;
+
+  int bucket = 0;
+  while ((bucket < (PROBE_RTT_BUCKETS - 1)) && ((rtt >> bucket) > 1)) {
+    bucket++;
+  }
+  table->rtt_hist[bucket]++;
+  table->answered++;
+
+  if (e->hosts) {
+    hosts_rtt(e->hosts, e->idx, (uint32_t)rtt);
+  }
+
+  probe_remove(table, link);
+
+_unlock:
+  pthread_mutex_unlock(&table->mutex);
+  return rtt;
+}
+
+int probe_expire(probe_table *table, int64_t now, int absent_sweeps,
+                 const char *device) {
+  pthread_mutex_lock(&table->mutex);
+  table->absent_sweeps = absent_sweeps;
+  table->device = device;
+  int expired = timer_advance(&table->wheel, now);
+  pthread_mutex_unlock(&table->mutex);
+
+  return expired;
+}
+
+int64_t probe_next(probe_table *table) {
+  pthread_mutex_lock(&table->mutex);
+  int64_t next = timer_next(&table->wheel);
+  pthread_mutex_unlock(&table->mutex);
+
+  return next;
+}
+
+static int64_t probe_percentile(uint64_t *hist, uint64_t count,
+                                double pct) {
+  uint64_t target = (uint64_t)(count * pct);
+  uint64_t sum = 0;
+
+  for (int i = 0; i < PROBE_RTT_BUCKETS; i++) {
+    sum += hist[i];
+    if (sum > target) {
+      // Upper edge of the bucket
+      return (int64_t)1 << (i + 1);
+    }
+  }
+
+  return 0;
+}
+
+void probe_report(probe_table *table, const char *device) {
+  uint64_t hist[PROBE_RTT_BUCKETS];
+
+  pthread_mutex_lock(&table->mutex);
+  uint64_t sent = table->sent;
+  uint64_t answered = table->answered;
+  uint64_t expired = table->expired;
+  uint64_t untracked = table->untracked;
+  memcpy(hist, table->rtt_hist, sizeof(hist));
+  table->sent = 0;
+  table->answered = 0;
+  table->expired = 0;
+  table->untracked = 0;
+  memset(table->rtt_hist, 0, sizeof(table->rtt_hist));
+  pthread_mutex_unlock(&table->mutex);
+
+  NOTICE_PRINT("%s : ARP probes sent %lu answered %lu expired %lu "
+               "untracked %lu RTT p50 < %ldus p90 < %ldus p99 < %ldus\n",
+               device, (unsigned long)sent, (unsigned long)answered,
+               (unsigned long)expired, (unsigned long)untracked,
+               (long)probe_percentile(hist, answered, 0.5),
+               (long)probe_percentile(hist, answered, 0.9),
+               (long)probe_percentile(hist, answered, 0.99));
+}
@@ -0,0 +1,131 @@
+//
+//  arptools
+//
+//  Stuart B. Wilkins, Brookhaven National Laboratory
+//
+//
+//  BSD 3-Clause License
+//
+//  Copyright (c) 2021, Brookhaven Science Associates
+//  All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without
+//  modification, are permitted provided that the following conditions are met:
+//
+//  1. Redistributions of source code must retain the above copyright notice,
+//     this list of conditions and the following disclaimer.
+//
+//  2. Redistributions in binary form must reproduce the above copyright notice,
+//     this list of conditions and the following disclaimer in the documentation
+//     and/or other materials provided with the distribution.
+//
+//  3. Neither the name of the copyright holder nor the names of its
+//     contributors may be used to endorse or promote products derived from
+//     this software without specific prior written permission.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+//  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+//  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+//  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+//  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+//  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+//  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+//  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+//  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+//  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+//  THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+#ifndef SRC_PROBE_H_
+#define SRC_PROBE_H_
+
+#include <stdint.h>
+#include <pthread.h>
+
+#include "hosts.h"
+#include "timer.h"
+
+/* Macro Definitions */
+
+#define PROBE_NOERR              0
+#define PROBE_ERR_MEMORY         1
+#define PROBE_TABLE_SIZE         (1 << 14)  // Outstanding probes
+#define PROBE_HASH_SIZE          (1 << 15)
+#define PROBE_WHEEL_TICK         10000      // Microseconds
+#define PROBE_TIMEOUT            1000000    // Microseconds
+#define PROBE_RTT_BUCKETS        32         // log2 of microseconds
+#define PROBE_NONE               -1
+
+typedef struct {
+  timer_entry timer;
+  uint32_t ip_addr;              // Network order
+  int vlan;
+  int64_t sent;                  // Microseconds since the epoch
+  hosts_network *hosts;
+  uint32_t idx;
+  int hash_next;
+} probe_entry;
+
+typedef struct {
+  probe_entry *entry;
+  int *hash;
+  timer_wheel wheel;
+  int free;
+  int used;
+  int absent_sweeps;             // Arguments of the running expire
+  const char *device;
+  uint64_t sent;
+  uint64_t answered;
+  uint64_t expired;
+  uint64_t untracked;
+  uint64_t rtt_hist[PROBE_RTT_BUCKETS];
+  pthread_mutex_t mutex;
+} probe_table;
+
+/* PROBE Functions */
+
+int probe_init(probe_table *table);
+/*
+ * Initialize the table of outstanding ARP probes. Probes are added
+ * by the ARP thread, matched by the capture thread and expired on a
+ * timer wheel with ticks of PROBE_WHEEL_TICK.
+ */
+void probe_free(probe_table *table);
+int probe_add(probe_table *table, uint32_t ip_addr, int vlan,
+              hosts_network *hosts, uint32_t idx, int64_t now);
+/*
+ * Record a probe of ip_addr on vlan (host idx of hosts) sent at now.
+ * A probe already outstanding for the address is kept. Returns -1 if
+ * the table is full.
+ */
+int64_t probe_match(probe_table *table, uint32_t ip_addr, int vlan,
+                    int64_t now);
+/*
+ * Match a reply from ip_addr on vlan received at now to its probe,
+ * recording the round trip time in the histogram and the smoothed
+ * RTT of the host. Returns the RTT in microseconds or -1 if there
+ * is no outstanding probe.
+ */
+int probe_expire(probe_table *table, int64_t now, int absent_sweeps,
+                 const char *device);
+/*
+ * Expire probes unanswered for PROBE_TIMEOUT. Hosts missing
+ * absent_sweeps probes in a row are marked absent. Returns the
+ * number of probes expired.
+ */
+int64_t probe_next(probe_table *table);
+/*
+ * Return the time in microseconds since the epoch when probe_expire()
+ * next has work to do, or -1 if no probes are outstanding.
+ */
+void probe_report(probe_table *table, const char *device);
+/*
+ * Log the probe counters and RTT percentiles and reset them.
+ */
+int64_t probe_now(void);
+/*
+ * Current time in microseconds since the epoch. Matches the packet
+ * capture timestamps.
+ */
+
+#endif  // SRC_PROBE_H_
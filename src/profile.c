@@ -0,0 +1,204 @@
+//
+//  arptools
+//
+//  Stuart B. Wilkins, Brookhaven National Laboratory
+//
+//
+//  BSD 3-Clause License
+//
+//  Copyright (c) 2021, Brookhaven Science Associates
+//  All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without
+//  modification, are permitted provided that the following conditions are met:
+//
+//  1. Redistributions of source code must retain the above copyright notice,
+//     this list of conditions and the following disclaimer.
+//
+//  2. Redistributions in binary form must reproduce the above copyright notice,
+//     this list of conditions and the following disclaimer in the documentation
+//     and/or other materials provided with the distribution.
+//
+//  3. Neither the name of the copyright holder nor the names of its
+//     contributors may be used to endorse or promote products derived from
+//     this software without specific prior written permission.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+//  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+//  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+//  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+//  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+//  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+//  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+//  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+//  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+//  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+//  THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#include "profile.h"
+#include "debug.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define PROFILE_UNIT           "cycles"
+#else
+#define PROFILE_UNIT           "ns"
+#endif
+
+volatile sig_atomic_t profile_dump_flag = 0;
+
+static __thread profile_thread profile_local;
+
+static const char *profile_stage_name[PROFILE_STAGES] = {
+  "dispatch", "vlan", "arp", "ip", "dhcp", "epics", "registry", "buffer"
+};
+
+static const char *profile_class_name[PROFILE_CLASSES] = {
+  "other", "arp", "ip", "udp", "dhcp", "epics"
+};
+
+static inline uint64_t profile_clock(void) {
+#if defined(__x86_64__) || defined(__i386__)
+  return __rdtsc();
+#else
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (uint64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+#endif
+}
+
+static void profile_record(profile_hist *hist, uint64_t value) {
+  int bucket = value ? 63 - __builtin_clzll(value) : 0;
+  hist->count++;
+  hist->sum += value;
+  hist->bucket[bucket]++;
+}
+
+static uint64_t profile_percentile(const profile_hist *hist, double pct) {
+  // Upper edge of the bucket holding the percentile
+
+  uint64_t target = hist->count * pct / 100.0;
+  uint64_t count = 0;
+  for (int i = 0; i < PROFILE_BUCKETS - 1; i++) {
+    count += hist->bucket[i];
+    if (count > target) {
+      return 2ULL << i;
+    }
+  }
+
+  return UINT64_MAX;
+}
+
+static void profile_charge(profile_thread *t, uint64_t now) {
+  t->pending[t->stack[t->depth - 1]] += now - t->last;
+  t->last = now;
+}
+
+void profile_begin(void) {
+  profile_thread *t = &profile_local;
+
+  memset(t->pending, 0, sizeof(t->pending));
+  t->stack[0] = PROFILE_DISPATCH;
+  t->depth = 1;
+  t->overflow = 0;
+  t->class = PROFILE_CLASS_OTHER;
+  t->start = t->last = profile_clock();
+}
+
+void profile_push(int stage) {
+  profile_thread *t = &profile_local;
+  if (!t->depth) {
+    return;
+  }
+
+  profile_charge(t, profile_clock());
+  if (t->depth < PROFILE_DEPTH) {
+    t->stack[t->depth++] = stage;
+  } else {
+    t->overflow++;
+  }
+}
+
+void profile_pop(void) {
+  profile_thread *t = &profile_local;
+  if (!t->depth) {
+    return;
+  }
+
+  profile_charge(t, profile_clock());
+  if (t->overflow) {
+    t->overflow--;
+  } else if (t->depth > 1) {
+    t->depth--;
+  }
+}
+
+void profile_class(int class) {
+  profile_local.class = class;
+}
+
+void profile_end(void) {
+  profile_thread *t = &profile_local;
+  if (!t->depth) {
+    return;
+  }
+
+  uint64_t now = profile_clock();
+  profile_charge(t, now);
+  t->depth = 0;
+
+  profile_hist *hist = t->hist[t->class];
+  for (int i = 0; i < PROFILE_STAGES; i++) {
+    if (t->pending[i]) {
+      profile_record(&hist[i], t->pending[i]);
+    }
+  }
+  profile_record(&hist[PROFILE_TOTAL], now - t->start);
+}
+
+void profile_dump(const char *label) {
+  profile_thread *t = &profile_local;
+
+  for (int c = 0; c < PROFILE_CLASSES; c++) {
+    profile_hist *hist = t->hist[c];
+    profile_hist *total = &hist[PROFILE_TOTAL];
+    if (!total->count) {
+      continue;
+    }
+
+    NOTICE_PRINT("%s : Profile %-5s %lu packets %lu " PROFILE_UNIT
+                 "/packet p50 < %lu p99 < %lu\n", label, profile_class_name[c],
+                 (unsigned long)total->count,
+                 (unsigned long)(total->sum / total->count),
+                 (unsigned long)profile_percentile(total, 50),
+                 (unsigned long)profile_percentile(total, 99));
+
+    // Stages are averaged over all packets of the class
+
+    char stages[LOG_MSG_SIZE] = "";
+    int len = 0;
+    for (int i = 0; i < PROFILE_STAGES; i++) {
+      if (hist[i].count && (len < (int)sizeof(stages))) {
+        len += snprintf(stages + len, sizeof(stages) - len, " %s %lu",
+                        profile_stage_name[i],
+                        (unsigned long)(hist[i].sum / total->count));
+      }
+    }
+
+    NOTICE_PRINT("%s : Profile %-5s " PROFILE_UNIT "/packet by stage :%s\n",
+                 label, profile_class_name[c], stages);
+  }
+}
+
+void profile_signal(int sig) {
+  (void)sig;
+  profile_dump_flag = 1;
+}
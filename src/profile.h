@@ -0,0 +1,153 @@
+//
+//  arptools
+//
+//  Stuart B. Wilkins, Brookhaven National Laboratory
+//
+//
+//  BSD 3-Clause License
+//
+//  Copyright (c) 2021, Brookhaven Science Associates
+//  All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without
+//  modification, are permitted provided that the following conditions are met:
+//
+//  1. Redistributions of source code must retain the above copyright notice,
+//     this list of conditions and the following disclaimer.
+//
+//  2. Redistributions in binary form must reproduce the above copyright notice,
+//     this list of conditions and the following disclaimer in the documentation
+//     and/or other materials provided with the distribution.
+//
+//  3. Neither the name of the copyright holder nor the names of its
+//     contributors may be used to endorse or promote products derived from
+//     this software without specific prior written permission.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+//  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+//  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+//  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+//  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+//  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+//  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+//  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+//  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+//  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+//  THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+#ifndef SRC_PROFILE_H_
+#define SRC_PROFILE_H_
+
+#include <stdint.h>
+#include <signal.h>
+
+/* Macro Definitions */
+
+#define PROFILE_DISPATCH       0          // capture_callback()
+#define PROFILE_VLAN           1          // ether_get_vlan()
+#define PROFILE_ARP            2          // ARP decode
+#define PROFILE_IP             3          // IP and UDP decode
+#define PROFILE_DHCP           4          // DHCP option loop
+#define PROFILE_EPICS          5          // EPICS search parsing
+#define PROFILE_REGISTRY       6          // Registration and hosts
+#define PROFILE_BUFFER         7          // buffer_advance_head()
+#define PROFILE_STAGES         8
+#define PROFILE_TOTAL          PROFILE_STAGES
+
+#define PROFILE_CLASS_OTHER    0
+#define PROFILE_CLASS_ARP      1
+#define PROFILE_CLASS_IP       2
+#define PROFILE_CLASS_UDP      3
+#define PROFILE_CLASS_DHCP     4
+#define PROFILE_CLASS_EPICS    5
+#define PROFILE_CLASSES        6
+
+#define PROFILE_DEPTH          8          // Nesting of stages
+#define PROFILE_BUCKETS        64         // Powers of 2
+
+//
+// With PROFILE defined the packet path is divided into stages by
+// PROFILE_PUSH() and PROFILE_POP(). Time is charged to the stage on
+// top of the stack, so each stage only counts its own time. At the
+// end of a packet the time of each stage is added to per thread
+// histograms for the class of the packet. Without PROFILE the
+// macros compile to nothing.
+//
+
+#ifdef PROFILE
+
+#define PROFILE_BEGIN()        profile_begin()
+#define PROFILE_PUSH(stage)    profile_push(stage)
+#define PROFILE_POP()          profile_pop()
+#define PROFILE_CLASS(class)   profile_class(class)
+#define PROFILE_END()          profile_end()
+#define PROFILE_DUMP(label)    profile_dump(label)
+#define PROFILE_CHECK(label) \
+  do { \
+    if (profile_dump_flag) { \
+      profile_dump_flag = 0; \
+      profile_dump(label); \
+    } \
+  } while (0)
+
+#else
+
+#define PROFILE_BEGIN()        do {} while (0)
+#define PROFILE_PUSH(stage)    do {} while (0)
+#define PROFILE_POP()          do {} while (0)
+#define PROFILE_CLASS(class)   do {} while (0)
+#define PROFILE_END()          do {} while (0)
+#define PROFILE_DUMP(label)    do {} while (0)
+#define PROFILE_CHECK(label)   do {} while (0)
+
+#endif
+
+typedef struct {
+  uint64_t count;
+  uint64_t sum;
+  uint64_t bucket[PROFILE_BUCKETS];
+} profile_hist;
+
+typedef struct {
+  profile_hist hist[PROFILE_CLASSES][PROFILE_STAGES + 1];
+  uint64_t pending[PROFILE_STAGES];
+  uint64_t start;
+  uint64_t last;
+  int stack[PROFILE_DEPTH];
+  int depth;
+  int overflow;
+  int class;
+} profile_thread;
+
+extern volatile sig_atomic_t profile_dump_flag;
+
+/* PROFILE Functions */
+
+void profile_begin(void);
+void profile_end(void);
+/*
+ * Start and finish timing a packet on the calling thread. Stages
+ * outside of a packet are not timed.
+ */
+void profile_push(int stage);
+void profile_pop(void);
+/*
+ * Enter and leave a stage, a stage can be entered more than once
+ * for each packet.
+ */
+void profile_class(int class);
+/*
+ * Set the class the current packet is counted under.
+ */
+void profile_dump(const char *label);
+/*
+ * Log the mean cost of each stage by class, and percentiles of the
+ * total, for the calling thread.
+ */
+void profile_signal(int sig);
+/*
+ * Signal handler that asks for a dump, see PROFILE_CHECK().
+ */
+
+#endif  // SRC_PROFILE_H_
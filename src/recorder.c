@@ -0,0 +1,262 @@
+//
+//  arptools
+//
+//  Stuart B. Wilkins, Brookhaven National Laboratory
+//
+//
+//  BSD 3-Clause License
+//
+//  Copyright (c) 2021, Brookhaven Science Associates
+//  All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without
+//  modification, are permitted provided that the following conditions are met:
+//
+//  1. Redistributions of source code must retain the above copyright notice,
+//     this list of conditions and the following disclaimer.
+//
+//  2. Redistributions in binary form must reproduce the above copyright notice,
+//     this list of conditions and the following disclaimer in the documentation
+//     and/or other materials provided with the distribution.
+//
+//  3. Neither the name of the copyright holder nor the names of its
+//     contributors may be used to endorse or promote products derived from
+//     this software without specific prior written permission.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+//  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+//  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+//  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+//  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+//  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+//  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+//  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+//  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+//  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+//  THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pcap.h>
+
+#include "recorder.h"
+#include "debug.h"
+
+volatile sig_atomic_t recorder_dump_flag = 0;
+
+static const char *recorder_anomaly_name[RECORDER_ANOMALIES] = {
+  "short", "arp", "dhcp", "epics"
+};
+
+static int recorder_ring_init(recorder_ring *ring, int size,
+                              u_char *slab, int snaplen) {
+  ring->size = size;
+  ring->head = 0;
+  ring->frame = calloc(size ? size : 1, sizeof(recorder_frame));
+  if (!ring->frame) {
+    return RECORDER_ERR_MEMORY;
+  }
+
+  for (int i = 0; i < size; i++) {
+    ring->frame[i].data = slab + (size_t)i * snaplen;
+  }
+
+  return RECORDER_NOERR;
+}
+
+int recorder_init(recorder_data *rec, int frames, int anomalies,
+                  int snaplen) {
+  memset(rec, 0, sizeof(recorder_data));
+  if (frames <= 0) {
+    return RECORDER_NOERR;
+  }
+  if (anomalies < 0) {
+    anomalies = 0;
+  }
+
+  // Touch the slab now so the capture path never faults it in
+
+  size_t size = (size_t)(frames + anomalies) * snaplen;
+  rec->slab = malloc(size);
+  if (!rec->slab) {
+    ERROR_COMMENT("Unable to allocate memory for flight recorder\n");
+    return RECORDER_ERR_MEMORY;
+  }
+  memset(rec->slab, 0, size);
+  rec->snaplen = snaplen;
+
+  if (recorder_ring_init(&rec->recent, frames, rec->slab,
+                         snaplen) != RECORDER_NOERR ||
+      recorder_ring_init(&rec->anomaly, anomalies,
+                         rec->slab + (size_t)frames * snaplen,
+                         snaplen) != RECORDER_NOERR) {
+    ERROR_COMMENT("Unable to allocate memory for flight recorder\n");
+    recorder_free(rec);
+    return RECORDER_ERR_MEMORY;
+  }
+
+  return RECORDER_NOERR;
+}
+
+void recorder_free(recorder_data *rec) {
+  free(rec->slab);
+  free(rec->recent.frame);
+  free(rec->anomaly.frame);
+  memset(rec, 0, sizeof(recorder_data));
+}
+
+static void recorder_copy(recorder_frame *dst, const struct timeval *ts,
+                          uint32_t caplen, uint32_t len, uint64_t seq,
+                          const u_char *data) {
+  dst->ts = *ts;
+  dst->caplen = caplen;
+  dst->len = len;
+  dst->seq = seq;
+  memcpy(dst->data, data, caplen);
+}
+
+void recorder_add(recorder_data *rec, const struct pcap_pkthdr *pkthdr,
+                  const u_char *packet) {
+  if (!rec->slab) {
+    return;
+  }
+
+  recorder_ring *ring = &rec->recent;
+  recorder_frame *f = &ring->frame[ring->head++ % ring->size];
+  uint32_t caplen = pkthdr->caplen;
+  if (caplen > (uint32_t)rec->snaplen) {
+    caplen = rec->snaplen;
+  }
+
+  recorder_copy(f, &pkthdr->ts, caplen, pkthdr->len, ++rec->seq, packet);
+}
+
+void recorder_tag(recorder_data *rec, int anomaly) {
+  if (!rec->slab || !rec->recent.head || !rec->anomaly.size) {
+    return;
+  }
+
+  recorder_ring *ring = &rec->anomaly;
+  recorder_frame *last = &rec->recent.frame[(rec->recent.head - 1) %
+                                            rec->recent.size];
+
+  // A frame may trip more than one check
+
+  if (ring->head &&
+      (ring->frame[(ring->head - 1) % ring->size].seq == last->seq)) {
+    return;
+  }
+
+  recorder_frame *f = &ring->frame[ring->head++ % ring->size];
+  recorder_copy(f, &last->ts, last->caplen, last->len, last->seq,
+                last->data);
+  rec->tagged[anomaly]++;
+}
+
+static recorder_frame* recorder_next(recorder_ring *ring, uint64_t *pos) {
+  // Oldest frame first, starting from *pos = 0
+
+  uint64_t start = ring->head > (uint64_t)ring->size ?
+                   ring->head - ring->size : 0;
+  if (*pos < start) {
+    *pos = start;
+  }
+  if (*pos >= ring->head) {
+    return NULL;
+  }
+
+  return &ring->frame[(*pos)++ % ring->size];
+}
+
+int recorder_dump(recorder_data *rec, const char *device,
+                  const char *dir) {
+  char filename[4096];
+  char stamp[32];
+  int rtn = RECORDER_ERR_FILE;
+
+  if (!rec->slab) {
+    NOTICE_PRINT("%s : Flight recorder is disabled\n", device);
+    return RECORDER_NOERR;
+  }
+
+  if (!*dir) {
+    ERROR_PRINT("%s : No journal_dir set\n", device);
+    return RECORDER_ERR_FILE;
+  }
+
+  time_t now = time(NULL);
+  struct tm tm;
+  strftime(stamp, sizeof(stamp), "%Y%m%d-%H%M%S", localtime_r(&now, &tm));
+  snprintf(filename, sizeof(filename), "%s/arpwatch-%s-%s.pcap",
+           dir, device, stamp);
+
+  pcap_t *pcap = pcap_open_dead(DLT_EN10MB, rec->snaplen);
+  if (!pcap) {
+    ERROR_PRINT("%s : Unable to open pcap for dump\n", device);
+    return RECORDER_ERR_FILE;
+  }
+
+  pcap_dumper_t *dumper = pcap_dump_open(pcap, filename);
+  if (!dumper) {
+    ERROR_PRINT("%s : Unable to open %s : %s\n", device, filename,
+                pcap_geterr(pcap));
+    goto _error;
+  }
+
+  //
+  // Merge the rings by sequence number, frames in both are only
+  // written once
+  //
+
+  uint64_t pos_recent = 0, pos_anomaly = 0;
+  recorder_frame *r = recorder_next(&rec->recent, &pos_recent);
+  recorder_frame *a = recorder_next(&rec->anomaly, &pos_anomaly);
+  int written = 0;
+
+  while (r || a) {
+    recorder_frame *f;
+    if (!a || (r && (r->seq <= a->seq))) {
+      if (a && (r->seq == a->seq)) {
+        a = recorder_next(&rec->anomaly, &pos_anomaly);
+      }
+      f = r;
+      r = recorder_next(&rec->recent, &pos_recent);
+    } else {
+      f = a;
+      a = recorder_next(&rec->anomaly, &pos_anomaly);
+    }
+
+    struct pcap_pkthdr hdr;
+    hdr.ts = f->ts;
+    hdr.caplen = f->caplen;
+    hdr.len = f->len;
+    pcap_dump((u_char *)dumper, &hdr, f->data);
+    written++;
+  }
+
+  pcap_dump_close(dumper);
+
+  char tagged[128] = "";
+  int len = 0;
+  for (int i = 0; i < RECORDER_ANOMALIES; i++) {
+    len += snprintf(tagged + len, sizeof(tagged) - len, " %s %lu",
+                    recorder_anomaly_name[i],
+                    (unsigned long)rec->tagged[i]);
+  }
+
+  NOTICE_PRINT("%s : Wrote %d frames to %s, anomalies tagged :%s\n",
+               device, written, filename, tagged);
+  rtn = RECORDER_NOERR;
+
+_error:
+  pcap_close(pcap);
+  return rtn;
+}
+
+void recorder_signal(int sig) {
+  (void)sig;
+  recorder_dump_flag = 1;
+}
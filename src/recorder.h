@@ -0,0 +1,121 @@
+//
+//  arptools
+//
+//  Stuart B. Wilkins, Brookhaven National Laboratory
+//
+//
+//  BSD 3-Clause License
+//
+//  Copyright (c) 2021, Brookhaven Science Associates
+//  All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without
+//  modification, are permitted provided that the following conditions are met:
+//
+//  1. Redistributions of source code must retain the above copyright notice,
+//     this list of conditions and the following disclaimer.
+//
+//  2. Redistributions in binary form must reproduce the above copyright notice,
+//     this list of conditions and the following disclaimer in the documentation
+//     and/or other materials provided with the distribution.
+//
+//  3. Neither the name of the copyright holder nor the names of its
+//     contributors may be used to endorse or promote products derived from
+//     this software without specific prior written permission.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+//  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+//  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+//  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+//  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+//  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+//  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+//  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+//  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+//  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+//  THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+#ifndef SRC_RECORDER_H_
+#define SRC_RECORDER_H_
+
+#include <stdint.h>
+#include <signal.h>
+#include <pcap.h>
+
+/* Macro Definitions */
+
+#define RECORDER_NOERR           0
+#define RECORDER_ERR_MEMORY      1
+#define RECORDER_ERR_FILE        2
+
+#define RECORDER_ANOMALY_SHORT   0          // Truncated headers
+#define RECORDER_ANOMALY_ARP     1          // Not an IPv4 ARP
+#define RECORDER_ANOMALY_DHCP    2          // Bad type or hostname
+#define RECORDER_ANOMALY_EPICS   3          // Malformed CA search
+#define RECORDER_ANOMALIES       4
+
+//
+// Flight recorder of the frames seen on an interface. The last
+// frames are kept in one ring, and copies of frames tagged as
+// anomalies in a second ring so they outlive normal traffic. The
+// frame data of both is in one slab allocated up front. Only the
+// capture thread touches the recorder.
+//
+
+typedef struct {
+  struct timeval ts;
+  uint32_t caplen;
+  uint32_t len;
+  uint64_t seq;                  // Matches copies across the rings
+  u_char *data;
+} recorder_frame;
+
+typedef struct {
+  recorder_frame *frame;
+  int size;
+  uint64_t head;                 // Frames ever added
+} recorder_ring;
+
+typedef struct {
+  u_char *slab;
+  int snaplen;
+  uint64_t seq;
+  recorder_ring recent;
+  recorder_ring anomaly;
+  uint64_t tagged[RECORDER_ANOMALIES];
+} recorder_data;
+
+extern volatile sig_atomic_t recorder_dump_flag;
+
+/* RECORDER Functions */
+
+int recorder_init(recorder_data *rec, int frames, int anomalies,
+                  int snaplen);
+/*
+ * Allocate and touch room for frames recent frames and anomalies
+ * tagged frames of up to snaplen bytes. With frames of 0 the
+ * recorder is disabled.
+ */
+void recorder_free(recorder_data *rec);
+void recorder_add(recorder_data *rec, const struct pcap_pkthdr *pkthdr,
+                  const u_char *packet);
+/*
+ * Record a frame, overwriting the oldest.
+ */
+void recorder_tag(recorder_data *rec, int anomaly);
+/*
+ * Keep a copy of the last frame recorded as an anomaly.
+ */
+int recorder_dump(recorder_data *rec, const char *device,
+                  const char *dir);
+/*
+ * Write the recorded frames, oldest first, to a pcap file named
+ * after the device and time in dir.
+ */
+void recorder_signal(int sig);
+/*
+ * Signal handler that asks for a dump.
+ */
+
+#endif  // SRC_RECORDER_H_
@@ -0,0 +1,285 @@
+//
+//  arptools
+//
+//  Stuart B. Wilkins, Brookhaven National Laboratory
+//
+//
+//  BSD 3-Clause License
+//
+//  Copyright (c) 2021, Brookhaven Science Associates
+//  All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without
+//  modification, are permitted provided that the following conditions are met:
+//
+//  1. Redistributions of source code must retain the above copyright notice,
+//     this list of conditions and the following disclaimer.
+//
+//  2. Redistributions in binary form must reproduce the above copyright notice,
+//     this list of conditions and the following disclaimer in the documentation
+//     and/or other materials provided with the distribution.
+//
+//  3. Neither the name of the copyright holder nor the names of its
+//     contributors may be used to endorse or promote products derived from
+//     this software without specific prior written permission.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+//  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+//  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+//  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+//  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+//  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+//  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+//  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+//  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+//  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+//  THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "registry.h"
+#include "debug.h"
+
+//
+// Keys are the 48 bit hardware address with REGISTRY_KEY_USED set
+// so that a zero key marks an empty slot. The not_registered flag
+// is stored in REGISTRY_KEY_FLAG.
+//
+
+#define REGISTRY_KEY_USED             (1ULL << 62)
+#define REGISTRY_KEY_FLAG             (1ULL << 61)
+#define REGISTRY_KEY_MASK             ((1ULL << 48) - 1)
+
+static uint64_t registry_key(const unsigned char *hw_addr) {
+  uint64_t key = 0;
+  for (int i = 0; i < ETH_ALEN; i++) {
+    key = (key << 8) | hw_addr[i];
+  }
+  return key;
+}
+
+static uint64_t registry_hash(uint64_t key) {
+  // splitmix64 finalizer
+  key ^= key >> 30;
+  key *= 0xBF58476D1CE4E5B9ULL;
+  key ^= key >> 27;
+  key *= 0x94D049BB133111EBULL;
+  key ^= key >> 31;
+  return key;
+}
+
+static int registry_table_size(int count) {
+  // Power of two with a load factor of at most 1/2
+  int size = 16;
+  while (size < (count * 2)) {
+    size <<= 1;
+  }
+  return size;
+}
+
+registry_set* registry_set_alloc(int count) {
+  registry_set *set = calloc(1, sizeof(registry_set));
+  if (set == NULL) {
+    goto _error;
+  }
+
+  set->size = registry_table_size(count);
+  set->keys = calloc(set->size, sizeof(uint64_t));
+  if (set->keys == NULL) {
+    goto _error;
+  }
+
+  uint64_t bits = 1024;
+  while (bits < (uint64_t)count * REGISTRY_BLOOM_BITS_PER_KEY) {
+    bits <<= 1;
+  }
+
+  set->bloom_mask = bits - 1;
+  set->bloom = calloc(bits / 64, sizeof(uint64_t));
+  if (set->bloom == NULL) {
+    goto _error;
+  }
+
+  return set;
+
+_error:
+  ERROR_COMMENT("Unable to allocate memory for registry\n");
+  registry_set_free(set);
+  return NULL;
+}
+
+void registry_set_free(registry_set *set) {
+  if (set) {
+    free(set->bloom);
+    free(set->keys);
+    free(set);
+  }
+}
+
+static uint64_t* registry_set_slot(registry_set *set, uint64_t key) {
+  int mask = set->size - 1;
+  int i = (int)(registry_hash(key) & mask);
+
+  while (set->keys[i] &&
+         ((set->keys[i] & REGISTRY_KEY_MASK) != key)) {
+    i = (i + 1) & mask;
+  }
+
+  return &set->keys[i];
+}
+
+static int registry_bloom_test(registry_set *set, uint64_t key, int add) {
+  // Double hashing (Kirsch-Mitzenmacher) from one 64 bit hash
+  uint64_t hash = registry_hash(key ^ 0x9E3779B97F4A7C15ULL);
+  uint64_t h1 = hash & 0xFFFFFFFF;
+  uint64_t h2 = (hash >> 32) | 1;
+
+  for (int i = 0; i < REGISTRY_BLOOM_HASHES; i++) {
+    uint64_t bit = (h1 + i * h2) & set->bloom_mask;
+    if (add) {
+      set->bloom[bit >> 6] |= 1ULL << (bit & 63);
+    } else if (!(set->bloom[bit >> 6] & (1ULL << (bit & 63)))) {
+      return 0;
+    }
+  }
+
+  return -1;
+}
+
+int registry_set_add(registry_set *set, const unsigned char *hw_addr,
+                     int not_registered) {
+  uint64_t key = registry_key(hw_addr);
+  uint64_t *slot = registry_set_slot(set, key);
+
+  if (!*slot) {
+    if ((set->used + 1) * 2 > set->size) {
+      return REGISTRY_ERR_MEMORY;
+    }
+    set->used++;
+  }
+
+  *slot = key | REGISTRY_KEY_USED | (not_registered ? REGISTRY_KEY_FLAG : 0);
+  registry_bloom_test(set, key, 1);
+
+  return REGISTRY_NOERR;
+}
+
+int registry_init(registry_data *registry) {
+  registry->set = NULL;
+  registry->retired = NULL;
+  registry->seen = registry_set_alloc(REGISTRY_SEEN_SIZE);
+  if (registry->seen == NULL) {
+    return REGISTRY_ERR_MEMORY;
+  }
+
+  pthread_mutex_init(&registry->mutex, NULL);
+
+  return REGISTRY_NOERR;
+}
+
+void registry_free(registry_data *registry) {
+  while (registry->retired) {
+    registry_set *next = registry->retired->next;
+    registry_set_free(registry->retired);
+    registry->retired = next;
+  }
+
+  registry_set_free(registry->set);
+  registry_set_free(registry->seen);
+  registry->set = NULL;
+  registry->seen = NULL;
+}
+
+void registry_swap(registry_data *registry, registry_set *set) {
+  //
+  // Lookups read the set pointer without a lock, so the old set is
+  // only freed by registry_collect() once no lookup can still be
+  // using it
+  //
+
+  registry_set *old = __atomic_exchange_n(&registry->set, set,
+                                          __ATOMIC_ACQ_REL);
+  if (old == NULL) {
+    return;
+  }
+
+  pthread_mutex_lock(&registry->mutex);
+  old->retired = time(NULL);
+  old->next = registry->retired;
+  registry->retired = old;
+  pthread_mutex_unlock(&registry->mutex);
+}
+
+int registry_collect(registry_data *registry) {
+  time_t now = time(NULL);
+  int freed = 0;
+
+  pthread_mutex_lock(&registry->mutex);
+
+  registry_set **prev = &registry->retired;
+  while (*prev) {
+    registry_set *set = *prev;
+    if ((now - set->retired) >= REGISTRY_GRACE_PERIOD) {
+      *prev = set->next;
+      registry_set_free(set);
+      freed++;
+    } else {
+      prev = &set->next;
+    }
+  }
+
+  pthread_mutex_unlock(&registry->mutex);
+
+  return freed;
+}
+
+int registry_lookup(registry_data *registry, const unsigned char *hw_addr) {
+  registry_set *set = __atomic_load_n(&registry->set, __ATOMIC_ACQUIRE);
+  uint64_t key = registry_key(hw_addr);
+  int status;
+
+  if (set == NULL) {
+    status = REGISTRY_UNKNOWN;
+  } else if (!registry_bloom_test(set, key, 0)) {
+    // Definitely not in the set
+    status = REGISTRY_UNREGISTERED;
+  } else {
+    uint64_t slot = *registry_set_slot(set, key);
+    if (!slot) {
+      // Bloom filter false positive
+      status = REGISTRY_UNREGISTERED;
+    } else if (slot & REGISTRY_KEY_FLAG) {
+      status = REGISTRY_NOT_REGISTERED;
+    } else {
+      status = REGISTRY_REGISTERED;
+    }
+  }
+
+  return status;
+}
+
+int registry_first_sight(registry_data *registry,
+                         const unsigned char *hw_addr) {
+  registry_set *seen = registry->seen;
+  uint64_t key = registry_key(hw_addr);
+
+  if (*registry_set_slot(seen, key)) {
+    return 0;
+  }
+
+  if (registry_set_add(seen, hw_addr, 0) != REGISTRY_NOERR) {
+    // Table is full, forget what we have seen and start again
+    DEBUG_COMMENT("Clearing registry seen table\n");
+    memset(seen->keys, 0, seen->size * sizeof(uint64_t));
+    seen->used = 0;
+    registry_set_add(seen, hw_addr, 0);
+  }
+
+  return -1;
+}
@@ -0,0 +1,121 @@
+//
+//  arptools
+//
+//  Stuart B. Wilkins, Brookhaven National Laboratory
+//
+//
+//  BSD 3-Clause License
+//
+//  Copyright (c) 2021, Brookhaven Science Associates
+//  All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without
+//  modification, are permitted provided that the following conditions are met:
+//
+//  1. Redistributions of source code must retain the above copyright notice,
+//     this list of conditions and the following disclaimer.
+//
+//  2. Redistributions in binary form must reproduce the above copyright notice,
+//     this list of conditions and the following disclaimer in the documentation
+//     and/or other materials provided with the distribution.
+//
+//  3. Neither the name of the copyright holder nor the names of its
+//     contributors may be used to endorse or promote products derived from
+//     this software without specific prior written permission.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+//  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+//  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+//  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+//  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+//  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+//  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+//  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+//  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+//  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+//  THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+#ifndef SRC_REGISTRY_H_
+#define SRC_REGISTRY_H_
+
+#include <stdint.h>
+#include <time.h>
+#include <pthread.h>
+#include <net/ethernet.h>
+
+/* Macro Definitions */
+
+#define REGISTRY_NOERR                0
+#define REGISTRY_ERR_MEMORY           1
+#define REGISTRY_BLOOM_BITS_PER_KEY   10
+#define REGISTRY_BLOOM_HASHES         7
+#define REGISTRY_SEEN_SIZE            65536
+#define REGISTRY_GRACE_PERIOD         5   // Seconds a replaced set is kept
+
+#define REGISTRY_UNKNOWN              0
+#define REGISTRY_REGISTERED           1
+#define REGISTRY_NOT_REGISTERED       2
+#define REGISTRY_UNREGISTERED         3
+
+typedef struct registry_set {
+  uint64_t *bloom;
+  uint64_t bloom_mask;
+  uint64_t *keys;
+  int size;
+  int used;
+  struct registry_set *next;    // Next retired set
+  time_t retired;               // Time the set was replaced
+} registry_set;
+
+typedef struct {
+  registry_set *set;            // Only accessed through __atomic builtins
+  registry_set *seen;
+  registry_set *retired;        // Replaced sets awaiting registry_collect()
+  pthread_mutex_t mutex;        // Protects retired
+} registry_data;
+
+/* REGISTRY Functions */
+
+int registry_init(registry_data *registry);
+/*
+ * Initialize the registry. Until a set is installed with
+ * registry_swap all lookups return REGISTRY_UNKNOWN.
+ */
+void registry_free(registry_data *registry);
+registry_set* registry_set_alloc(int count);
+/*
+ * Allocate an empty set (Bloom filter and exact hash set) sized
+ * for count hardware addresses.
+ */
+void registry_set_free(registry_set *set);
+int registry_set_add(registry_set *set, const unsigned char *hw_addr,
+                     int not_registered);
+/*
+ * Add hw_addr to the set. If not_registered is true the address is
+ * flagged as explicitly not registered.
+ */
+void registry_swap(registry_data *registry, registry_set *set);
+/*
+ * Atomically replace the current set with set. The registry takes
+ * ownership of set. The previous set may still be in use by a
+ * lookup so it is retired, not freed.
+ */
+int registry_collect(registry_data *registry);
+/*
+ * Free the sets retired at least REGISTRY_GRACE_PERIOD seconds ago.
+ * Returns the number of sets freed.
+ */
+int registry_lookup(registry_data *registry, const unsigned char *hw_addr);
+/*
+ * Return the registration status (REGISTRY_*) of hw_addr. This takes
+ * no lock and is safe to call from any thread.
+ */
+int registry_first_sight(registry_data *registry,
+                         const unsigned char *hw_addr);
+/*
+ * Returns non-zero the first time hw_addr is passed. This is only
+ * safe to call from a single (capture) thread.
+ */
+
+#endif  // SRC_REGISTRY_H_
@@ -0,0 +1,635 @@
+//
+//  arptools
+//
+//  Stuart B. Wilkins, Brookhaven National Laboratory
+//
+//
+//  BSD 3-Clause License
+//
+//  Copyright (c) 2021, Brookhaven Science Associates
+//  All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without
+//  modification, are permitted provided that the following conditions are met:
+//
+//  1. Redistributions of source code must retain the above copyright notice,
+//     this list of conditions and the following disclaimer.
+//
+//  2. Redistributions in binary form must reproduce the above copyright notice,
+//     this list of conditions and the following disclaimer in the documentation
+//     and/or other materials provided with the distribution.
+//
+//  3. Neither the name of the copyright holder nor the names of its
+//     contributors may be used to endorse or promote products derived from
+//     this software without specific prior written permission.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+//  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+//  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+//  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+//  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+//  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+//  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+//  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+//  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+//  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+//  THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <string.h>
+#include <time.h>
+#include <netdb.h>
+#include <errno.h>
+
+#include "debug.h"
+#include "buffer.h"
+#include "cache.h"
+#include "registry.h"
+#include "journal.h"
+#include "affinity.h"
+#include "latency.h"
+#include "sink.h"
+#include "mysql.h"
+#include "null.h"
+#ifdef SQLITE
+#include "sqlite.h"
+#endif
+#include "arpwatch.h"
+
+static const sink_ops *sinks[] = {
+  &mysql_sink,
+#ifdef SQLITE
+  &sqlite_sink,
+#endif
+  &null_sink,
+  NULL
+};
+
+const sink_ops* sink_find(const char *name) {
+  for (int i = 0; sinks[i]; i++) {
+    if (!strcmp(sinks[i]->name, name)) {
+      return sinks[i];
+    }
+  }
+
+  return NULL;
+}
+
+//
+// Records written but not yet committed, to time the commit stage
+// and to update the write cache only once they are stored, and the
+// histograms at the last latency report. For sinks with transactions
+// a copy of every record of the open batch is held until it commits,
+// so a rolled back batch can be written again. The first batch_num
+// records of batch are in the open transaction, the retry_num after
+// them wait to be written again.
+//
+
+typedef struct {
+  int num;
+  int64_t pickup[SINK_BATCH_SIZE];
+  int64_t ts[SINK_BATCH_SIZE];
+  cache_entry update[SINK_BATCH_SIZE];
+  arp_data *batch;
+  int batch_num;
+  int retry_num;
+  latency_hist last[LATENCY_STAGES];
+} sink_latency;
+
+typedef struct {
+  arpwatch_params *params;
+  int num_params;
+  sink_latency *latency;
+  cache_data *cache;
+  int retries;                   // Failed commits of the held batch
+} sink_args;
+
+static pthread_t sink_thread_id;
+static pthread_mutex_t sink_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t sink_cond = PTHREAD_COND_INITIALIZER;
+static int sink_running = 1;
+static time_t sink_deadline = 0;
+
+static int sink_wait(int sec) {
+  struct timespec ts;
+  clock_gettime(CLOCK_REALTIME, &ts);
+  ts.tv_sec += sec;
+
+  pthread_mutex_lock(&sink_mutex);
+  while (sink_running) {
+    if (pthread_cond_timedwait(&sink_cond, &sink_mutex, &ts) == ETIMEDOUT) {
+      break;
+    }
+  }
+  int stopped = !sink_running;
+  pthread_mutex_unlock(&sink_mutex);
+
+  return stopped;
+}
+
+static int sink_past_deadline(void) {
+  time_t deadline = __atomic_load_n(&sink_deadline, __ATOMIC_RELAXED);
+  return deadline && (time(NULL) >= deadline);
+}
+
+static void sink_committed(sink_args *args, int stored) {
+  int64_t now = latency_now();
+
+  // A failed commit was rolled back, so nothing is cached or counted
+
+  int drop = 0;
+  if (stored) {
+    args->retries = 0;
+  } else if (++args->retries > SINK_COMMIT_RETRIES) {
+    args->retries = 0;
+    drop = 1;
+  }
+
+  for (int i = 0; i < args->num_params; i++) {
+    metrics_interface *m = args->params[i].metrics;
+    sink_latency *lat = &args->latency[i];
+    for (int j = 0; stored && (j < lat->num); j++) {
+      cache_apply(args->cache, &lat->update[j]);
+      if (m) {
+        latency_record(&m->latency[LATENCY_COMMIT], now - lat->pickup[j]);
+        latency_record(&m->latency[LATENCY_TOTAL], now - lat->ts[j]);
+      }
+    }
+    if (stored) {
+      METRICS_ADD(m, sink, rows_written, lat->num);
+    }
+    lat->num = 0;
+
+    // Records of a rolled back batch are written again, unless they
+    // have failed too often
+
+    if (stored) {
+      memmove(lat->batch, &lat->batch[lat->batch_num],
+              lat->retry_num * sizeof(arp_data));
+    } else if (drop) {
+      if (lat->batch_num + lat->retry_num) {
+        ERROR_PRINT("%s : Dropping %d records after %d failed commits\n",
+                    args->params[i].device,
+                    lat->batch_num + lat->retry_num,
+                    SINK_COMMIT_RETRIES + 1);
+      }
+      lat->retry_num = 0;
+    } else {
+      lat->retry_num += lat->batch_num;
+    }
+    lat->batch_num = 0;
+  }
+}
+
+static int sink_commit(const sink_ops *ops, void *ctx, sink_args *args) {
+  int stored = 1;
+  if (ops->commit && ops->commit(ctx)) {
+    ERROR_COMMENT("Commit failed, records were not stored\n");
+    stored = 0;
+  }
+  sink_committed(args, stored);
+  return !stored;
+}
+
+static void sink_report_latency(sink_args *args) {
+  for (int i = 0; i < args->num_params; i++) {
+    metrics_interface *m = args->params[i].metrics;
+    if (!m) {
+      continue;
+    }
+
+    // Percentiles of what was recorded since the last report
+
+    for (int s = 0; s < LATENCY_STAGES; s++) {
+      latency_hist *last = &args->latency[i].last[s];
+      uint64_t count = __atomic_load_n(&m->latency[s].count,
+                                       __ATOMIC_RELAXED) - last->count;
+      if (count) {
+        NOTICE_PRINT("%s : Latency %s p50 < %ldus p90 < %ldus "
+                     "p99 < %ldus of %lu records\n",
+                     args->params[i].device, latency_stage_name[s],
+                     (long)latency_percentile(&m->latency[s], last, 0.5),
+                     (long)latency_percentile(&m->latency[s], last, 0.9),
+                     (long)latency_percentile(&m->latency[s], last, 0.99),
+                     (unsigned long)count);
+      }
+      latency_copy(last, &m->latency[s]);
+    }
+  }
+}
+
+int sink_write_buffer(const sink_ops *ops, void *ctx, sink_args *args,
+                      int iface) {
+  arpwatch_params *params = &args->params[iface];
+  sink_latency *lat = &args->latency[iface];
+  metrics_interface *m = params->metrics;
+  int records = 0;
+  int written = 0;
+  int hits = 0;
+  int lookups = 0;
+  int failures = 0;
+
+  struct timespec start;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+
+  // Records held from a batch which failed to commit are written
+  // again before any new ones
+
+  for (;;) {
+    int retry = (lat->retry_num > 0);
+    arp_data *arp = retry ? &lat->batch[lat->batch_num] :
+                    buffer_get_tail(&(params->data_buffer), 0);
+    if (!arp) {
+      break;
+    }
+
+    // Leave the rest for the journal if we are out of time
+    // to shut down
+
+    if (sink_past_deadline()) {
+      NOTICE_PRINT("%s : Shutdown deadline reached\n", params->device);
+      break;
+    }
+
+    int64_t pickup = latency_now();
+    if (m && !retry) {
+      latency_record(&m->latency[LATENCY_QUEUE], pickup - arp->queued);
+    }
+
+    char time_buffer[SINK_TIME_MAX];
+    char hostname[256];
+    char *host = NULL;
+
+    struct tm gm;
+    if (localtime_r(&(arp->ts.tv_sec), &gm)) {
+      strftime(time_buffer, sizeof(time_buffer),
+              "%Y-%m-%d %H:%M:%S", &gm);
+
+      DEBUG_PRINT("Packet time : %s\n", time_buffer);
+    } else {
+      // Error building time
+      strncpy(time_buffer, "1970-01-01 00:00:00", sizeof(time_buffer));
+      ERROR_COMMENT("Unable to convert packet time");
+    }
+
+    // Now lookup DNS entry
+    // TODO(swilkins) : Use reentrant version here
+
+    int64_t dns = latency_now();
+    struct  hostent *he = gethostbyaddr(&arp->ip_addr,
+                                        sizeof(arp->ip_addr),
+                                        AF_INET);
+    if (m) {
+      latency_record(&m->latency[LATENCY_DNS], latency_now() - dns);
+    }
+    lookups++;
+    if (he) {
+      strncpy(hostname, he->h_name, sizeof(hostname) - 1);
+      hostname[sizeof(hostname) - 1] = '\0';
+      host = hostname;
+      DEBUG_PRINT("Hostname : %s\n", hostname);
+    } else {
+      DEBUG_COMMENT("Hostname not found\n");
+      failures++;
+    }
+
+    //
+    // Skip the write if it would only move last_seen forward
+    // by less than last_seen_granularity
+    //
+
+    if (!retry) {
+      records++;
+    }
+    cache_entry *entry = cache_get(args->cache, arp);
+    if (entry && cache_is_current(entry, arp, host,
+                                  params->last_seen_granularity)) {
+      DEBUG_COMMENT("Skipping write, record is current\n");
+      hits++;
+      goto _epics;
+    }
+
+    // Failed writes are neither cached nor counted
+
+    int failed = ops->write_arp(ctx, params, arp, host, time_buffer);
+
+    if (!failed && (arp->type & BUFFER_TYPE_DHCP) && (*arp->dhcp_name)) {
+      failed = ops->write_dhcp(ctx, params, arp);
+    }
+
+    if (failed) {
+      goto _epics;
+    }
+    written++;
+
+    // The cache is updated when the batch is committed. Sinks
+    // without transactions have committed already.
+
+    lat->pickup[lat->num] = pickup;
+    lat->ts[lat->num] = (int64_t)arp->ts.tv_sec * 1000000 + arp->ts.tv_usec;
+    cache_stage(&lat->update[lat->num], arp, host);
+    lat->num++;
+    if (!ops->commit) {
+      sink_committed(args, 1);
+    }
+
+_epics:
+    if (arp->type & BUFFER_TYPE_EPICS) {
+      // First check if the vlan is correct
+
+      int epics_vlan = 0;
+      pthread_mutex_lock(&params->config_mutex);
+      for (int i=0; i < params->num_epics_pv_vlan; i++) {
+        if (params->epics_pv_vlan[i] == arp->vlan) {
+          epics_vlan = 1;
+          break;
+        }
+      }
+      pthread_mutex_unlock(&params->config_mutex);
+
+      if (epics_vlan) {
+        DEBUG_PRINT("Process %d EPICS PVs\n", arp->pv_num);
+        for (int pvc=0; pvc < arp->pv_num; pvc++) {
+          ops->write_epics(ctx, params, arp, pvc, time_buffer);
+        }
+      }
+    }
+
+    // Hold a copy until the batch commits. A record written again
+    // is already in place.
+
+    if (retry) {
+      lat->batch_num++;
+      lat->retry_num--;
+    } else {
+      if (lat->batch) {
+        memcpy(&lat->batch[lat->batch_num++], arp, sizeof(arp_data));
+      }
+      buffer_advance_tail(&(params->data_buffer));
+    }
+
+    // Commit in batches so a long backlog is not one transaction.
+    // A batch which is rolled back is kept for the next flush.
+
+    if (lat->batch && (lat->batch_num == SINK_BATCH_SIZE)) {
+      int failed = sink_commit(ops, ctx, args);
+      if (ops->begin) {
+        ops->begin(ctx);
+      }
+      if (failed) {
+        break;
+      }
+    }
+  }
+
+  DEBUG_PRINT("%s : Wrote %d of %d records\n",
+              params->device, written, records);
+
+  struct timespec end;
+  clock_gettime(CLOCK_MONOTONIC, &end);
+
+  METRICS_ADD(m, sink, flushes, 1);
+  METRICS_ADD(m, sink, flush_usec,
+              (end.tv_sec - start.tv_sec) * 1000000 +
+              (end.tv_nsec - start.tv_nsec) / 1000);
+  METRICS_ADD(m, sink, records, records);
+  METRICS_ADD(m, sink, write_cache_hits, hits);
+  METRICS_ADD(m, sink, dns_lookups, lookups);
+  METRICS_ADD(m, sink, dns_failures, failures);
+  METRICS_SET(m, sink, ring_used,
+              buffer_used_elements(&params->data_buffer));
+  METRICS_SET(m, sink, ring_size, params->data_buffer.size);
+  METRICS_SET(m, sink, ring_overruns,
+              buffer_overruns(&params->data_buffer));
+  METRICS_SET(m, sink, last_flush, metrics_clock());
+  METRICS_SET(m, sink, heartbeat, metrics_clock());
+
+  return records;
+}
+
+static void* sink_connect(const sink_ops *ops, sink_args *args,
+                          void *ctx) {
+  //
+  // The context is kept between flushes. A failure to write the
+  // daemon rows is taken as a lost connection, so reconnect.
+  //
+
+  int failed = !ctx;
+  for (int i = 0; !failed && (i < args->num_params); i++) {
+    failed = ops->write_daemon(ctx, &args->params[i]);
+  }
+
+  if (!failed) {
+    return ctx;
+  }
+
+  if (ctx) {
+    NOTICE_PRINT("Reconnecting %s sink\n", ops->name);
+    ops->close(ctx);
+  }
+
+  ctx = ops->open(args->params);
+  for (int i = 0; ctx && (i < args->num_params); i++) {
+    ops->write_daemon(ctx, &args->params[i]);
+  }
+
+  return ctx;
+}
+
+void sink_drain(const sink_ops *ops, sink_args *args, void *ctx) {
+  arpwatch_params *params = args->params;
+
+  //
+  // Final flush on shutdown. Whatever is not written before the
+  // deadline set by sink_stop() is spilled to the journal.
+  //
+
+  int *flushed = calloc(args->num_params, sizeof(int));
+  if (!flushed) {
+    ERROR_COMMENT("Unable to allocate memory for shutdown\n");
+    return;
+  }
+
+  ctx = sink_connect(ops, args, ctx);
+  if (ctx) {
+    if (ops->begin) {
+      ops->begin(ctx);
+    }
+
+    for (int i = 0; i < args->num_params; i++) {
+      flushed[i] = sink_write_buffer(ops, ctx, args, i);
+    }
+
+    sink_commit(ops, ctx, args);
+    ops->close(ctx);
+  }
+
+  for (int i = 0; i < args->num_params; i++) {
+    int spilled, dropped;
+    sink_latency *lat = &args->latency[i];
+    journal_spill(&params[i], lat->batch, lat->batch_num + lat->retry_num,
+                  &spilled, &dropped);
+    NOTICE_PRINT("%s : Shutdown flushed %d, spilled %d and dropped %d "
+                 "records\n", params[i].device, flushed[i], spilled,
+                 dropped);
+  }
+
+  free(flushed);
+}
+
+void * sink_thread(void * arg) {
+  sink_args *args = (sink_args *) arg;
+  arpwatch_params *params = args->params;
+  const sink_ops *ops = sink_find(params->sink);
+
+  NOTICE_PRINT("Starting %s sink thread for %d interface(s)\n",
+               ops->name, args->num_params);
+
+  affinity_set(params->device, "sink", params->sink_cpu,
+               params->numa_affinity);
+
+  //
+  // The write cache and registry are shared by all interfaces
+  // written by this thread
+  //
+
+  cache_data cache;
+  if (cache_init(&cache) != CACHE_NOERR) {
+    ERROR_COMMENT("Unable to initialize write cache\n");
+    return NULL;
+  }
+  args->cache = &cache;
+
+  if (ops->commit) {
+    for (int i = 0; i < args->num_params; i++) {
+      args->latency[i].batch = malloc(SINK_BATCH_SIZE * sizeof(arp_data));
+      if (!args->latency[i].batch) {
+        ERROR_COMMENT("Unable to allocate memory for sink batch\n");
+        goto _exit;
+      }
+    }
+  }
+
+  time_t registration_loaded = 0;
+  time_t reported = time(NULL);
+  void *ctx = NULL;
+
+  for (;;) {
+    // Tell the watchdog the writer is not stuck, even while the
+    // database is down
+
+    for (int i = 0; i < args->num_params; i++) {
+      METRICS_SET(params[i].metrics, sink, heartbeat, metrics_clock());
+      METRICS_SET(params[i].metrics, sink, period,
+                  params[i].mysql_loop_delay);
+    }
+
+    // Write to daemon database
+
+    ctx = sink_connect(ops, args, ctx);
+    if (!ctx) {
+      goto _error;
+    }
+
+    // Reload registered hw addresses for tagging at capture time
+
+    registry_collect(params->registry);
+
+    if (params->registration_delay && ops->load_registration &&
+        ((time(NULL) - registration_loaded) >= params->registration_delay)) {
+      registry_set *set = ops->load_registration(ctx, params);
+      if (set) {
+        registry_swap(params->registry, set);
+        registration_loaded = time(NULL);
+      }
+    }
+
+    if (ops->begin) {
+      ops->begin(ctx);
+    }
+
+    for (int i = 0; i < args->num_params; i++) {
+      sink_write_buffer(ops, ctx, args, i);
+    }
+
+    // Reconnect if the commit failed, in case the connection
+    // is broken
+
+    if (sink_commit(ops, ctx, args)) {
+      ops->close(ctx);
+      ctx = NULL;
+    }
+
+    if ((time(NULL) - reported) >= LATENCY_REPORT_INTERVAL) {
+      sink_report_latency(args);
+      reported = time(NULL);
+    }
+
+_error:
+    DEBUG_PRINT("Sleep for %d\n", params->mysql_loop_delay);
+    if (sink_wait(params->mysql_loop_delay)) {
+      break;
+    }
+  }
+
+  sink_drain(ops, args, ctx);
+
+_exit:
+  for (int i = 0; i < args->num_params; i++) {
+    free(args->latency[i].batch);
+  }
+  cache_free(&cache);
+  free(args->latency);
+  free(args);
+  return NULL;
+}
+
+int sink_setup(arpwatch_params *params, int num_params) {
+  if (!sink_find(params->sink)) {
+    ERROR_PRINT("Unknown sink %s\n", params->sink);
+    return -1;
+  }
+
+  // Setup thread data
+
+  sink_args *args = malloc(sizeof(sink_args));
+  if (!args) {
+    ERROR_COMMENT("Unable to allocate memory for sink\n");
+    return -1;
+  }
+
+  args->params = params;
+  args->num_params = num_params;
+  args->latency = calloc(num_params, sizeof(sink_latency));
+  if (!args->latency) {
+    ERROR_COMMENT("Unable to allocate memory for sink\n");
+    free(args);
+    return -1;
+  }
+
+  int err = pthread_create(&sink_thread_id, NULL,
+                           &sink_thread, (void *)args);
+  if (err) {
+    ERROR_COMMENT("Unable to create thread.");
+    free(args->latency);
+    free(args);
+    return -1;
+  }
+
+  return 0;
+}
+
+void sink_stop(int timeout) {
+  __atomic_store_n(&sink_deadline, time(NULL) + timeout, __ATOMIC_RELAXED);
+
+  pthread_mutex_lock(&sink_mutex);
+  sink_running = 0;
+  pthread_cond_broadcast(&sink_cond);
+  pthread_mutex_unlock(&sink_mutex);
+
+  pthread_join(sink_thread_id, NULL);
+}
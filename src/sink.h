@@ -0,0 +1,95 @@
+//
+//  arptools
+//
+//  Stuart B. Wilkins, Brookhaven National Laboratory
+//
+//
+//  BSD 3-Clause License
+//
+//  Copyright (c) 2021, Brookhaven Science Associates
+//  All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without
+//  modification, are permitted provided that the following conditions are met:
+//
+//  1. Redistributions of source code must retain the above copyright notice,
+//     this list of conditions and the following disclaimer.
+//
+//  2. Redistributions in binary form must reproduce the above copyright notice,
+//     this list of conditions and the following disclaimer in the documentation
+//     and/or other materials provided with the distribution.
+//
+//  3. Neither the name of the copyright holder nor the names of its
+//     contributors may be used to endorse or promote products derived from
+//     this software without specific prior written permission.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+//  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+//  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+//  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+//  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+//  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+//  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+//  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+//  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+//  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+//  THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+#ifndef SRC_SINK_H_
+#define SRC_SINK_H_
+
+#include "arpwatch.h"
+#include "buffer.h"
+#include "registry.h"
+
+#define SINK_BATCH_SIZE          1000
+#define SINK_COMMIT_RETRIES      3
+#define SINK_TIME_MAX            64
+
+//
+// A sink is the output path for captured data. Each sink provides
+// an ops table. open() returns a context which is passed to all
+// other calls and released by close(). The writer thread keeps it
+// between write loops and only opens a new one after an error.
+// All write calls return 0 on success.
+// begin(), commit() and load_registration() are optional.
+//
+// hostname is NULL if the address could not be resolved.
+// time is the packet time formatted as "%Y-%m-%d %H:%M:%S".
+//
+
+typedef struct {
+  const char *name;
+  void* (*open)(arpwatch_params *params);
+  void (*close)(void *ctx);
+  int (*begin)(void *ctx);
+  int (*commit)(void *ctx);
+  int (*write_daemon)(void *ctx, arpwatch_params *params);
+  int (*write_arp)(void *ctx, arpwatch_params *params, arp_data *arp,
+                   const char *hostname, const char *time);
+  int (*write_dhcp)(void *ctx, arpwatch_params *params, arp_data *arp);
+  int (*write_epics)(void *ctx, arpwatch_params *params, arp_data *arp,
+                     int pv, const char *time);
+  registry_set* (*load_registration)(void *ctx, arpwatch_params *params);
+} sink_ops;
+
+const sink_ops* sink_find(const char *name);
+/*
+ * Return the sink ops table for name, or NULL if no sink of
+ * that name was compiled in.
+ */
+int sink_setup(arpwatch_params *params, int num_params);
+/*
+ * Start one writer thread using the sink named in params. params
+ * is an array of num_params interfaces which share the thread,
+ * its database connection and its write cache.
+ */
+void sink_stop(int timeout);
+/*
+ * Stop the writer thread and wait for it to exit. The thread
+ * writes what remains on the buffers for at most timeout seconds
+ * and spills the rest to the journal (see journal.h).
+ */
+
+#endif  // SRC_SINK_H_
@@ -0,0 +1,364 @@
+//
+//  arptools
+//
+//  Stuart B. Wilkins, Brookhaven National Laboratory
+//
+//
+//  BSD 3-Clause License
+//
+//  Copyright (c) 2021, Brookhaven Science Associates
+//  All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without
+//  modification, are permitted provided that the following conditions are met:
+//
+//  1. Redistributions of source code must retain the above copyright notice,
+//     this list of conditions and the following disclaimer.
+//
+//  2. Redistributions in binary form must reproduce the above copyright notice,
+//     this list of conditions and the following disclaimer in the documentation
+//     and/or other materials provided with the distribution.
+//
+//  3. Neither the name of the copyright holder nor the names of its
+//     contributors may be used to endorse or promote products derived from
+//     this software without specific prior written permission.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+//  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+//  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+//  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+//  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+//  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+//  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+//  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+//  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+//  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+//  THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sqlite3.h>
+
+#include "debug.h"
+#include "buffer.h"
+#include "registry.h"
+#include "sink.h"
+#include "sqlite.h"
+#include "utils.h"
+#include "arpwatch.h"
+
+//
+// Local store using the same schema as mysql/create_database.sql
+//
+
+static const char *sqlite_schema =
+  "CREATE TABLE IF NOT EXISTS arpdata("
+  "  hw_address        CHAR(17) NOT NULL,"
+  "  vlan              SMALLINT NOT NULL,"
+  "  location          VARCHAR(256) NOT NULL,"
+  "  label             VARCHAR(256),"
+  "  ip_address        CHAR(15),"
+  "  hostname          VARCHAR(256),"
+  "  type              INTEGER DEFAULT 0,"
+  "  last_seen         DATETIME,"
+  "  created           DATETIME DEFAULT CURRENT_TIMESTAMP,"
+  "  registered        BOOL DEFAULT 0,"
+  "  notified          DATETIME,"
+  "  block_notified    DATETIME,"
+  "  audited           DATETIME,"
+  "  dhcp_name         VARCHAR(256),"
+  "  visible           BOOL DEFAULT 1,"
+  "  PRIMARY KEY (hw_address, vlan, location)"
+  ");"
+  "CREATE TABLE IF NOT EXISTS daemondata("
+  "  hostname          VARCHAR(256) NOT NULL,"
+  "  iface             VARCHAR(256) NOT NULL,"
+  "  last_updated      DATETIME,"
+  "  last_notified     DATETIME,"
+  "  PRIMARY KEY (hostname, iface)"
+  ");"
+  "CREATE TABLE IF NOT EXISTS epicsdata("
+  "  hw_address        CHAR(17) NOT NULL,"
+  "  vlan              SMALLINT NOT NULL,"
+  "  pv_name           VARCHAR(256) NOT NULL,"
+  "  last_seen         DATETIME,"
+  "  PRIMARY KEY (hw_address, vlan, pv_name)"
+  ");"
+  "CREATE TABLE IF NOT EXISTS registrationdata("
+  "  hw_address        CHAR(17) NOT NULL,"
+  "  not_registered    BOOL DEFAULT 0,"
+  "  registered_by     VARCHAR(256),"
+  "  notes             TEXT,"
+  "  created           DATETIME DEFAULT CURRENT_TIMESTAMP,"
+  "  updated           DATETIME DEFAULT CURRENT_TIMESTAMP,"
+  "  PRIMARY KEY (hw_address)"
+  ");";
+
+static const char *sqlite_sql_daemon =
+  "INSERT INTO daemondata (hostname, iface, last_updated) "
+  "VALUES (?1, ?2, datetime('now', 'localtime')) "
+  "ON CONFLICT (hostname, iface) DO UPDATE SET "
+  "last_updated = excluded.last_updated;";
+
+static const char *sqlite_sql_arp =
+  "INSERT INTO arpdata "
+  "(hw_address, vlan, location, label, ip_address, type, "
+  "last_seen, hostname) "
+  "VALUES (?1, ?2, ?3, ?4, ?5, ?6, ?7, ?8) "
+  "ON CONFLICT (hw_address, vlan, location) DO UPDATE SET "
+  "ip_address = excluded.ip_address, "
+  "label = excluded.label, "
+  "type = type | excluded.type, "
+  "last_seen = excluded.last_seen, "
+  "hostname = excluded.hostname;";
+
+static const char *sqlite_sql_dhcp =
+  "UPDATE arpdata SET dhcp_name = ?1 "
+  "WHERE hw_address = ?2 AND vlan = ?3 AND location = ?4;";
+
+static const char *sqlite_sql_epics =
+  "INSERT INTO epicsdata (hw_address, vlan, pv_name, last_seen) "
+  "VALUES (?1, ?2, ?3, ?4) "
+  "ON CONFLICT (hw_address, vlan, pv_name) DO UPDATE SET "
+  "last_seen = excluded.last_seen;";
+
+typedef struct {
+  sqlite3 *db;
+  sqlite3_stmt *daemon;
+  sqlite3_stmt *arp;
+  sqlite3_stmt *dhcp;
+  sqlite3_stmt *epics;
+} sqlite_context;
+
+static int sqlite_handle_error(sqlite3 *db) {
+  ERROR_PRINT("SQLite Error : %s\n", sqlite3_errmsg(db));
+  return sqlite3_errcode(db);
+}
+
+static int sqlite_exec(sqlite3 *db, const char *sql) {
+  char *err = NULL;
+
+  if (sqlite3_exec(db, sql, NULL, NULL, &err) != SQLITE_OK) {
+    ERROR_PRINT("SQLite Error : %s\n", err);
+    sqlite3_free(err);
+    return -1;
+  }
+
+  return 0;
+}
+
+static int sqlite_step(sqlite_context *ctx, sqlite3_stmt *stmt) {
+  int rtn = 0;
+
+  if (sqlite3_step(stmt) != SQLITE_DONE) {
+    rtn = sqlite_handle_error(ctx->db);
+  }
+
+  sqlite3_reset(stmt);
+  sqlite3_clear_bindings(stmt);
+
+  return rtn;
+}
+
+void sqlite_sink_close(void *arg) {
+  sqlite_context *ctx = (sqlite_context *)arg;
+
+  sqlite3_finalize(ctx->daemon);
+  sqlite3_finalize(ctx->arp);
+  sqlite3_finalize(ctx->dhcp);
+  sqlite3_finalize(ctx->epics);
+  sqlite3_close(ctx->db);
+  free(ctx);
+}
+
+void* sqlite_sink_open(arpwatch_params *params) {
+  sqlite_context *ctx = calloc(1, sizeof(sqlite_context));
+  if (!ctx) {
+    ERROR_COMMENT("Unable to allocate memory for SQLite context\n");
+    return NULL;
+  }
+
+  if (sqlite3_open(params->sqlite_database, &ctx->db) != SQLITE_OK) {
+    sqlite_handle_error(ctx->db);
+    goto _error;
+  }
+
+  sqlite3_busy_timeout(ctx->db, SQLITE_SINK_BUSY_TIMEOUT);
+
+  if (sqlite_exec(ctx->db, "PRAGMA journal_mode = WAL;"
+                           "PRAGMA synchronous = NORMAL;") ||
+      sqlite_exec(ctx->db, sqlite_schema)) {
+    goto _error;
+  }
+
+  if ((sqlite3_prepare_v2(ctx->db, sqlite_sql_daemon, -1,
+                          &ctx->daemon, NULL) != SQLITE_OK) ||
+      (sqlite3_prepare_v2(ctx->db, sqlite_sql_arp, -1,
+                          &ctx->arp, NULL) != SQLITE_OK) ||
+      (sqlite3_prepare_v2(ctx->db, sqlite_sql_dhcp, -1,
+                          &ctx->dhcp, NULL) != SQLITE_OK) ||
+      (sqlite3_prepare_v2(ctx->db, sqlite_sql_epics, -1,
+                          &ctx->epics, NULL) != SQLITE_OK)) {
+    sqlite_handle_error(ctx->db);
+    goto _error;
+  }
+
+  return ctx;
+
+_error:
+  sqlite_sink_close(ctx);
+  return NULL;
+}
+
+int sqlite_sink_begin(void *arg) {
+  sqlite_context *ctx = (sqlite_context *)arg;
+  return sqlite_exec(ctx->db, "BEGIN;");
+}
+
+int sqlite_sink_commit(void *arg) {
+  sqlite_context *ctx = (sqlite_context *)arg;
+
+  if (sqlite_exec(ctx->db, "COMMIT;")) {
+    sqlite_exec(ctx->db, "ROLLBACK;");
+    return -1;
+  }
+
+  return 0;
+}
+
+int sqlite_sink_write_daemon(void *arg, arpwatch_params *params) {
+  sqlite_context *ctx = (sqlite_context *)arg;
+
+  sqlite3_bind_text(ctx->daemon, 1, params->daemon_hostname,
+                    -1, SQLITE_STATIC);
+  sqlite3_bind_text(ctx->daemon, 2, params->device, -1, SQLITE_STATIC);
+
+  return sqlite_step(ctx, ctx->daemon);
+}
+
+int sqlite_sink_write_arp(void *arg, arpwatch_params *params,
+                          arp_data *arp, const char *hostname,
+                          const char *time) {
+  sqlite_context *ctx = (sqlite_context *)arg;
+  char hw_addr[UTILS_MAC_STRLEN];
+  char ip_addr[INET_ADDRSTRLEN];
+
+  sqlite3_bind_text(ctx->arp, 1, int_to_mac(hw_addr, arp->hw_addr),
+                    -1, SQLITE_TRANSIENT);
+  sqlite3_bind_int(ctx->arp, 2, arp->vlan);
+  sqlite3_bind_text(ctx->arp, 3, params->location, -1, SQLITE_STATIC);
+  sqlite3_bind_text(ctx->arp, 4, params->label, -1, SQLITE_STATIC);
+  sqlite3_bind_text(ctx->arp, 5, int_to_ip(ip_addr, arp->ip_addr),
+                    -1, SQLITE_TRANSIENT);
+  sqlite3_bind_int(ctx->arp, 6, arp->type);
+  sqlite3_bind_text(ctx->arp, 7, time, -1, SQLITE_STATIC);
+  if (hostname) {
+    sqlite3_bind_text(ctx->arp, 8, hostname, -1, SQLITE_STATIC);
+  } else {
+    sqlite3_bind_null(ctx->arp, 8);
+  }
+
+  return sqlite_step(ctx, ctx->arp);
+}
+
+int sqlite_sink_write_dhcp(void *arg, arpwatch_params *params,
+                           arp_data *arp) {
+  sqlite_context *ctx = (sqlite_context *)arg;
+  char hw_addr[UTILS_MAC_STRLEN];
+
+  sqlite3_bind_text(ctx->dhcp, 1, arp->dhcp_name, -1, SQLITE_STATIC);
+  sqlite3_bind_text(ctx->dhcp, 2, int_to_mac(hw_addr, arp->hw_addr),
+                    -1, SQLITE_TRANSIENT);
+  sqlite3_bind_int(ctx->dhcp, 3, arp->vlan);
+  sqlite3_bind_text(ctx->dhcp, 4, params->location, -1, SQLITE_STATIC);
+
+  return sqlite_step(ctx, ctx->dhcp);
+}
+
+int sqlite_sink_write_epics(void *arg, arpwatch_params *params,
+                            arp_data *arp, int pv, const char *time) {
+  sqlite_context *ctx = (sqlite_context *)arg;
+  char hw_addr[UTILS_MAC_STRLEN];
+  (void)params;
+
+  sqlite3_bind_text(ctx->epics, 1, int_to_mac(hw_addr, arp->hw_addr),
+                    -1, SQLITE_TRANSIENT);
+  sqlite3_bind_int(ctx->epics, 2, arp->vlan);
+  sqlite3_bind_text(ctx->epics, 3, arp->pv_name[pv], -1, SQLITE_STATIC);
+  sqlite3_bind_text(ctx->epics, 4, time, -1, SQLITE_STATIC);
+
+  return sqlite_step(ctx, ctx->epics);
+}
+
+registry_set* sqlite_sink_load_registration(void *arg,
+                                            arpwatch_params *params) {
+  sqlite_context *ctx = (sqlite_context *)arg;
+  sqlite3_stmt *stmt = NULL;
+  registry_set *set = NULL;
+  int count = 0;
+  (void)params;
+
+  if (sqlite3_prepare_v2(ctx->db,
+                         "SELECT COUNT(*) FROM registrationdata;",
+                         -1, &stmt, NULL) != SQLITE_OK) {
+    sqlite_handle_error(ctx->db);
+    return NULL;
+  }
+
+  if (sqlite3_step(stmt) == SQLITE_ROW) {
+    count = sqlite3_column_int(stmt, 0);
+  }
+  sqlite3_finalize(stmt);
+
+  set = registry_set_alloc(count);
+  if (!set) {
+    return NULL;
+  }
+
+  if (sqlite3_prepare_v2(ctx->db,
+                         "SELECT hw_address, not_registered "
+                         "FROM registrationdata;",
+                         -1, &stmt, NULL) != SQLITE_OK) {
+    sqlite_handle_error(ctx->db);
+    registry_set_free(set);
+    return NULL;
+  }
+
+  count = 0;
+  while (sqlite3_step(stmt) == SQLITE_ROW) {
+    unsigned char hw_addr[ETH_ALEN];
+    const char *mac = (const char *)sqlite3_column_text(stmt, 0);
+    if (!mac || mac_to_int(hw_addr, mac)) {
+      ERROR_PRINT("Invalid hw_address %s in registrationdata\n",
+                  mac ? mac : "NULL");
+      continue;
+    }
+
+    if (registry_set_add(set, hw_addr, sqlite3_column_int(stmt, 1))) {
+      // Table changed size between the two queries
+      break;
+    }
+    count++;
+  }
+
+  sqlite3_finalize(stmt);
+
+  DEBUG_PRINT("Loaded %d hw addresses from registrationdata\n", count);
+
+  return set;
+}
+
+const sink_ops sqlite_sink = {
+  .name = "sqlite",
+  .open = sqlite_sink_open,
+  .close = sqlite_sink_close,
+  .begin = sqlite_sink_begin,
+  .commit = sqlite_sink_commit,
+  .write_daemon = sqlite_sink_write_daemon,
+  .write_arp = sqlite_sink_write_arp,
+  .write_dhcp = sqlite_sink_write_dhcp,
+  .write_epics = sqlite_sink_write_epics,
+  .load_registration = sqlite_sink_load_registration
+};
@@ -0,0 +1,209 @@
+//
+//  arptools
+//
+//  Stuart B. Wilkins, Brookhaven National Laboratory
+//
+//
+//  BSD 3-Clause License
+//
+//  Copyright (c) 2021, Brookhaven Science Associates
+//  All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without
+//  modification, are permitted provided that the following conditions are met:
+//
+//  1. Redistributions of source code must retain the above copyright notice,
+//     this list of conditions and the following disclaimer.
+//
+//  2. Redistributions in binary form must reproduce the above copyright notice,
+//     this list of conditions and the following disclaimer in the documentation
+//     and/or other materials provided with the distribution.
+//
+//  3. Neither the name of the copyright holder nor the names of its
+//     contributors may be used to endorse or promote products derived from
+//     this software without specific prior written permission.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+//  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+//  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+//  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+//  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+//  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+//  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+//  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+//  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+//  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+//  THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "timer.h"
+
+#define TIMER_MASK               (TIMER_SLOTS - 1)
+#define TIMER_MAX_TICKS          \
+  (((int64_t)1 << (TIMER_LEVEL_BITS * TIMER_LEVELS)) - 1)
+
+void timer_init(timer_wheel *wheel, int64_t tick, int64_t now) {
+  memset(wheel, 0, sizeof(timer_wheel));
+  wheel->tick = tick;
+  wheel->now = now / tick;
+}
+
+void timer_entry_init(timer_entry *entry, timer_callback callback,
+                      void *data) {
+  entry->next = NULL;
+  entry->link = NULL;
+  entry->expires = 0;
+  entry->callback = callback;
+  entry->data = data;
+}
+
+int timer_pending(const timer_entry *entry) {
+  return entry->link != NULL;
+}
+
+static void timer_link(timer_wheel *wheel, timer_entry *entry) {
+  // Pick the lowest level whose range covers the delay. An entry due
+  // now goes in the level 0 slot about to be run.
+
+  int64_t delta = entry->expires - wheel->now;
+  int level = 0;
+  while ((level < (TIMER_LEVELS - 1)) &&
+         (delta >= ((int64_t)1 << (TIMER_LEVEL_BITS * (level + 1))))) {
+    level++;
+  }
+
+  int slot = (entry->expires >> (TIMER_LEVEL_BITS * level)) & TIMER_MASK;
+  timer_entry **head = &wheel->slot[level][slot];
+
+  entry->next = *head;
+  if (entry->next) {
+    entry->next->link = &entry->next;
+  }
+  entry->link = head;
+  *head = entry;
+}
+
+static void timer_unlink(timer_entry *entry) {
+  *entry->link = entry->next;
+  if (entry->next) {
+    entry->next->link = entry->link;
+  }
+  entry->next = NULL;
+  entry->link = NULL;
+}
+
+void timer_add(timer_wheel *wheel, timer_entry *entry, int64_t expires) {
+  if (entry->link) {
+    timer_unlink(entry);
+  } else {
+    wheel->pending++;
+  }
+
+  int64_t ticks = (expires + wheel->tick - 1) / wheel->tick;
+  if (ticks <= wheel->now) {
+    ticks = wheel->now + 1;
+  } else if ((ticks - wheel->now) > TIMER_MAX_TICKS) {
+    ticks = wheel->now + TIMER_MAX_TICKS;
+  }
+
+  entry->expires = ticks;
+  timer_link(wheel, entry);
+}
+
+void timer_cancel(timer_wheel *wheel, timer_entry *entry) {
+  if (entry->link) {
+    timer_unlink(entry);
+    wheel->pending--;
+  }
+}
+
+static int timer_cascade(timer_wheel *wheel, int level) {
+  // Move the entries of the current slot of level down the wheel.
+  // Returns the slot so the caller knows if the next level wraps.
+
+  int slot = (wheel->now >> (TIMER_LEVEL_BITS * level)) & TIMER_MASK;
+  timer_entry *entry = wheel->slot[level][slot];
+  wheel->slot[level][slot] = NULL;
+
+  while (entry) {
+    timer_entry *next = entry->next;
+    timer_link(wheel, entry);
+    entry = next;
+  }
+
+  return slot;
+}
+
+int timer_advance(timer_wheel *wheel, int64_t now) {
+  int64_t target = now / wheel->tick;
+  int expired = 0;
+
+  while (wheel->now < target) {
+    // Nothing to run, skip straight to the end
+
+    if (!wheel->pending) {
+      wheel->now = target;
+      break;
+    }
+
+    wheel->now++;
+
+    int slot = wheel->now & TIMER_MASK;
+    for (int level = 1; !slot && (level < TIMER_LEVELS); level++) {
+      slot = timer_cascade(wheel, level);
+    }
+
+    // Detach the whole slot first, callbacks may arm entries again
+
+    slot = wheel->now & TIMER_MASK;
+    timer_entry *entry = wheel->slot[0][slot];
+    wheel->slot[0][slot] = NULL;
+    if (entry) {
+      entry->link = &entry;
+    }
+
+    while (entry) {
+      timer_entry *e = entry;
+      timer_unlink(e);
+      wheel->pending--;
+      expired++;
+      if (e->callback) {
+        e->callback(e, e->data);
+      }
+    }
+  }
+
+  return expired;
+}
+
+int64_t timer_next(const timer_wheel *wheel) {
+  if (!wheel->pending) {
+    return -1;
+  }
+
+  // Level 0 slots hold entries due at exactly that tick, a slot of
+  // a higher level needs running when it is cascaded.
+
+  int64_t next = -1;
+  for (int level = 0; level < TIMER_LEVELS; level++) {
+    int shift = TIMER_LEVEL_BITS * level;
+    int64_t base = wheel->now >> shift;
+
+    for (int k = 1; k <= TIMER_SLOTS; k++) {
+      if (wheel->slot[level][(base + k) & TIMER_MASK]) {
+        int64_t when = (base + k) << shift;
+        if ((next < 0) || (when < next)) {
+          next = when;
+        }
+        break;
+      }
+    }
+  }
+
+  return next * wheel->tick;
+}
@@ -0,0 +1,118 @@
+//
+//  arptools
+//
+//  Stuart B. Wilkins, Brookhaven National Laboratory
+//
+//
+//  BSD 3-Clause License
+//
+//  Copyright (c) 2021, Brookhaven Science Associates
+//  All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without
+//  modification, are permitted provided that the following conditions are met:
+//
+//  1. Redistributions of source code must retain the above copyright notice,
+//     this list of conditions and the following disclaimer.
+//
+//  2. Redistributions in binary form must reproduce the above copyright notice,
+//     this list of conditions and the following disclaimer in the documentation
+//     and/or other materials provided with the distribution.
+//
+//  3. Neither the name of the copyright holder nor the names of its
+//     contributors may be used to endorse or promote products derived from
+//     this software without specific prior written permission.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+//  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+//  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+//  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+//  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+//  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+//  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+//  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+//  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+//  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+//  THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+#ifndef SRC_TIMER_H_
+#define SRC_TIMER_H_
+
+#include <stdint.h>
+
+/* Macro Definitions */
+
+#define TIMER_LEVEL_BITS         6
+#define TIMER_SLOTS              (1 << TIMER_LEVEL_BITS)
+#define TIMER_LEVELS             4          // 2^24 ticks in total
+
+//
+// Hierarchical timer wheel. Level 0 holds timers due in the next
+// TIMER_SLOTS ticks, each level above covers TIMER_SLOTS times the
+// range of the one below. When the lower level wraps, a slot of the
+// next level is cascaded down, so each timer is moved at most
+// TIMER_LEVELS - 1 times. Insert and cancel are constant time.
+//
+// Entries are embedded in the structure they time out. The wheel is
+// not locked, callers serialize access.
+//
+
+struct timer_entry;
+typedef void (*timer_callback)(struct timer_entry *entry, void *data);
+
+typedef struct timer_entry {
+  struct timer_entry *next;
+  struct timer_entry **link;     // Link pointing here, NULL if idle
+  int64_t expires;               // Ticks
+  timer_callback callback;
+  void *data;
+} timer_entry;
+
+typedef struct {
+  timer_entry *slot[TIMER_LEVELS][TIMER_SLOTS];
+  int64_t tick;                  // Microseconds per tick
+  int64_t now;                   // Last tick run
+  int pending;
+} timer_wheel;
+
+/* TIMER Functions */
+
+void timer_init(timer_wheel *wheel, int64_t tick, int64_t now);
+/*
+ * Initialize an empty wheel with a resolution of tick microseconds
+ * starting at now (microseconds on any clock used consistently).
+ */
+void timer_entry_init(timer_entry *entry, timer_callback callback,
+                      void *data);
+/*
+ * Initialize an idle entry calling callback with data on expiry.
+ */
+void timer_add(timer_wheel *wheel, timer_entry *entry, int64_t expires);
+/*
+ * Arm entry to expire at expires microseconds, rounded up to the
+ * next tick. An entry already armed is moved. Times in the past
+ * expire on the next tick, times past the end of the wheel are
+ * clamped to it.
+ */
+void timer_cancel(timer_wheel *wheel, timer_entry *entry);
+/*
+ * Disarm entry. Does nothing if the entry is idle.
+ */
+int timer_pending(const timer_entry *entry);
+/*
+ * Return non-zero if entry is armed.
+ */
+int timer_advance(timer_wheel *wheel, int64_t now);
+/*
+ * Run the wheel up to now, calling the callback of each entry that
+ * expired. Entries are idle when their callback runs, so it may arm
+ * them again. Returns the number of entries expired.
+ */
+int64_t timer_next(const timer_wheel *wheel);
+/*
+ * Return the time in microseconds when timer_advance() next has work
+ * to do, or -1 if no entries are armed. Suitable as a wakeup time.
+ */
+
+#endif  // SRC_TIMER_H_
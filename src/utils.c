@@ -44,6 +44,7 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
+#include <arpa/inet.h>
 #include "utils.h"
 #include "debug.h"
 
@@ -51,18 +52,42 @@ char hexchars[] = { '0', '1', '2', '3', '4', '5',
                     '6', '7', '8', '9', 'A', 'B',
                     'C', 'D', 'E', 'F' };
 
-const char * int_to_mac(unsigned char *addr) {
-  static char _mac[30];
+const char * int_to_mac(char *mac, const unsigned char *addr) {
   int j = 0;
   for (int i=0; i < 6; i++) {
-    _mac[j++] = hexchars[(addr[i] >> 4) & 0x0F];
-    _mac[j++] = hexchars[addr[i] & 0x0F];
-    _mac[j++] = ':';
+    mac[j++] = hexchars[(addr[i] >> 4) & 0x0F];
+    mac[j++] = hexchars[addr[i] & 0x0F];
+    mac[j++] = ':';
   }
 
-  _mac[j - 1] = '\0';
+  mac[j - 1] = '\0';
 
-  return _mac;
+  return mac;
+}
+
+const char * int_to_ip(char *ip, struct in_addr addr) {
+  if (!inet_ntop(AF_INET, &addr, ip, INET_ADDRSTRLEN)) {
+    *ip = '\0';
+  }
+
+  return ip;
+}
+
+int mac_to_int(unsigned char *addr, const char *mac) {
+  unsigned int b[6];
+  if (sscanf(mac, "%x:%x:%x:%x:%x:%x",
+             &b[0], &b[1], &b[2], &b[3], &b[4], &b[5]) != 6) {
+    return -1;
+  }
+
+  for (int i=0; i < 6; i++) {
+    if (b[i] > 0xFF) {
+      return -1;
+    }
+    addr[i] = (unsigned char)b[i];
+  }
+
+  return 0;
 }
 
 int netbios_decode(char *dec, char *enc, int len) {
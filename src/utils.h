@@ -38,7 +38,21 @@
 #ifndef SRC_UTILS_H_
 #define SRC_UTILS_H_
 
-const char * int_to_mac(unsigned char *addr);
+#include <netinet/in.h>
+
+#define UTILS_MAC_STRLEN  18
+
+const char * int_to_mac(char *mac, const unsigned char *addr);
+/*
+ * Format addr into mac, which must hold UTILS_MAC_STRLEN bytes.
+ * Returns mac.
+ */
+const char * int_to_ip(char *ip, struct in_addr addr);
+/*
+ * Format addr into ip, which must hold INET_ADDRSTRLEN bytes.
+ * Returns ip.
+ */
+int mac_to_int(unsigned char *addr, const char *mac);
 int netbios_decode(char *dec, char *enc, int len);
 int get_fqdn(char *hostname, size_t hostname_len);
 